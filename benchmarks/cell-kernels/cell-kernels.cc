@@ -0,0 +1,232 @@
+
+// This benchmark compares the throughput of local assembly of the
+// Schroedinger matrices (stiffness with a coefficient, overlap, and
+// potential-weighted overlap) with loops over FEValues and with the
+// compile-time cell kernels, for the element degrees that the
+// models have kernels for.
+#include <qdove/models/cell_kernel.h>
+
+// deal.II
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/full_matrix.h>
+
+// C++
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Assemble the local matrices on all cells with the runtime-sized
+// loops that the models use for general elements, and return the
+// time it took.
+template<int dim>
+double
+assemble_with_fe_values (const dealii::DoFHandler<dim> &dof_handler,
+			 const unsigned int             n_sweeps,
+			 double                        &checksum)
+{
+  const dealii::QGauss<dim> quadrature_formula (dof_handler.get_fe ().degree+1);
+  dealii::FEValues<dim> fe_values (dof_handler.get_fe (), quadrature_formula,
+				   dealii::update_values | dealii::update_gradients | dealii::update_JxW_values);
+
+  const unsigned int dofs_per_cell = dof_handler.get_fe ().dofs_per_cell;
+  const unsigned int n_q_points    = quadrature_formula.size ();
+
+  dealii::FullMatrix<double> cell_kinetic (dofs_per_cell, dofs_per_cell);
+  dealii::FullMatrix<double> cell_overlap (dofs_per_cell, dofs_per_cell);
+  dealii::FullMatrix<double> cell_system (dofs_per_cell, dofs_per_cell);
+  std::vector<double> ke_values (n_q_points, 1.2);
+  std::vector<double> pe_values (n_q_points, 0.3);
+
+  dealii::Timer timer;
+  for (unsigned int sweep=0; sweep<n_sweeps; ++sweep)
+    {
+      typename dealii::DoFHandler<dim>::active_cell_iterator
+	cell = dof_handler.begin_active (),
+	endc = dof_handler.end ();
+      for (; cell!=endc; ++cell)
+	{
+	  fe_values.reinit (cell);
+	  cell_kinetic = 0;
+	  cell_overlap = 0;
+
+	  for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	    for (unsigned int j=0; j<dofs_per_cell; ++j)
+	      for (unsigned int i=0; i<dofs_per_cell; ++i)
+		{
+		  cell_kinetic (i,j) += ke_values[q_point] *
+		    fe_values.shape_grad (i,q_point) * fe_values.shape_grad (j,q_point) * fe_values.JxW (q_point);
+		  cell_overlap (i,j) +=
+		    fe_values.shape_value (i,q_point) * fe_values.shape_value (j,q_point) * fe_values.JxW (q_point);
+		}
+
+	  cell_system = cell_kinetic;
+	  for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	    for (unsigned int j=0; j<dofs_per_cell; ++j)
+	      for (unsigned int i=0; i<dofs_per_cell; ++i)
+		cell_system (i,j) += pe_values[q_point] *
+		  fe_values.shape_value (i,q_point) * fe_values.shape_value (j,q_point) * fe_values.JxW (q_point);
+
+	  checksum += cell_system (0,0);
+	}
+    }
+  return timer.wall_time ();
+}
+
+// Assemble the same local matrices with the compile-time kernel for
+// this element degree, and return the time it took.
+template<int dim, int fe_degree>
+double
+assemble_with_kernel (const dealii::DoFHandler<dim> &dof_handler,
+		      const unsigned int             n_sweeps,
+		      double                        &checksum)
+{
+  typedef qdove::CellKernel<dim,fe_degree,fe_degree+1> Kernel;
+
+  const dealii::QGauss<dim> quadrature_formula (fe_degree+1);
+
+  const unsigned int dofs_per_cell = Kernel::dofs_per_cell;
+  const unsigned int n_q_points    = Kernel::n_q_points;
+
+  dealii::FullMatrix<double> cell_kinetic (dofs_per_cell, dofs_per_cell);
+  dealii::FullMatrix<double> cell_overlap (dofs_per_cell, dofs_per_cell);
+  dealii::FullMatrix<double> cell_system (dofs_per_cell, dofs_per_cell);
+  std::vector<double> ke_values (n_q_points, 1.2);
+  std::vector<double> pe_values (n_q_points, 0.3);
+
+  // The shape functions are tabulated once; on each cell the
+  // kernel only needs the vertices.
+  const qdove::CellKernelData<dim> kernel_data (dof_handler.get_fe (), quadrature_formula);
+  Kernel kernel (kernel_data);
+
+  dealii::Timer timer;
+  for (unsigned int sweep=0; sweep<n_sweeps; ++sweep)
+    {
+      typename dealii::DoFHandler<dim>::active_cell_iterator
+	cell = dof_handler.begin_active (),
+	endc = dof_handler.end ();
+      for (; cell!=endc; ++cell)
+	{
+	  kernel.reinit (cell);
+
+	  kernel.stiffness (&ke_values[0], cell_kinetic);
+	  kernel.mass (0, cell_overlap);
+
+	  cell_system = cell_kinetic;
+	  kernel.mass (&pe_values[0], cell_system, true);
+
+	  checksum += cell_system (0,0);
+	}
+    }
+  return timer.wall_time ();
+}
+
+// Time both ways of assembly for one element degree on a grid with
+// this many refinements.
+template<int dim, int fe_degree>
+void
+run (const unsigned int n_refinements,
+     const unsigned int n_sweeps)
+{
+  dealii::Triangulation<dim> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, -1., 1.);
+  triangulation.refine_global (n_refinements);
+
+  dealii::FE_Q<dim> fe (fe_degree);
+  dealii::DoFHandler<dim> dof_handler (triangulation);
+  dof_handler.distribute_dofs (fe);
+
+  double fe_values_checksum = 0.;
+  double kernel_checksum    = 0.;
+
+  const double fe_values_time = assemble_with_fe_values (dof_handler, n_sweeps, fe_values_checksum);
+  const double kernel_time    = assemble_with_kernel<dim,fe_degree> (dof_handler, n_sweeps, kernel_checksum);
+
+  // Report throughput in millions of cells per second, and check
+  // that both ways give the same matrices.
+  const double n_processed = static_cast<double> (triangulation.n_active_cells ()) * n_sweeps;
+
+  std::cout << std::setw (4)  << dim
+	    << std::setw (8)  << fe_degree
+	    << std::setw (10) << triangulation.n_active_cells ()
+	    << std::setw (16) << 1e-6*n_processed/fe_values_time
+	    << std::setw (16) << 1e-6*n_processed/kernel_time
+	    << std::setw (10) << fe_values_time/kernel_time
+	    << std::setw (14) << std::fabs (fe_values_checksum-kernel_checksum)/std::fabs (fe_values_checksum)
+	    << std::endl;
+
+  dof_handler.clear ();
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	std::cout << std::setw (4)  << "dim"
+		  << std::setw (8)  << "degree"
+		  << std::setw (10) << "n_cells"
+		  << std::setw (16) << "FEValues Mc/s"
+		  << std::setw (16) << "kernel Mc/s"
+		  << std::setw (10) << "speedup"
+		  << std::setw (14) << "rel. diff"
+		  << std::endl;
+
+	for (unsigned int n_refinements=12; n_refinements<=18; n_refinements+=2)
+	  {
+	    run<1,1> (n_refinements, 10);
+	    run<1,2> (n_refinements, 10);
+	    run<1,3> (n_refinements, 10);
+	    run<1,4> (n_refinements, 10);
+	  }
+
+	for (unsigned int n_refinements=4; n_refinements<=7; ++n_refinements)
+	  {
+	    run<2,1> (n_refinements, 10);
+	    run<2,2> (n_refinements, 10);
+	    run<2,3> (n_refinements, 10);
+	    run<2,4> (n_refinements, 10);
+	  }
+
+	for (unsigned int n_refinements=2; n_refinements<=4; ++n_refinements)
+	  {
+	    run<3,1> (n_refinements, 10);
+	    run<3,2> (n_refinements, 10);
+	  }
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
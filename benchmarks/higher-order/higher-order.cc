@@ -0,0 +1,240 @@
+
+// This benchmark compares the number of degrees of freedom and the
+// time needed to reach a given eigenvalue accuracy with elements of
+// degree one to four, on two wells with analytic eigenvalues: the
+// infinite square well on the unit interval, where
+// \f$-u''=Eu\f$ has \f$E_n=(n\pi)^2\f$, and the harmonic
+// oscillator \f$-u''+x^2u=Eu\f$ truncated at \f$|x|=10\f$, where
+// \f$E_n=2n-1\f$. The potential is added to an assembled kinetic
+// part, so that the potential-only assembly is exercised too. A last
+// table does the same for Poisson's problem \f$-u''=\pi^2\sin\pi x\f$
+// on the unit interval, with solution \f$u=\sin\pi x\f$, whose
+// right-hand side is assembled a second time without the stiffness
+// matrix.
+#include <qdove/base/quadrature_field.h>
+#include <qdove/base/test_space.h>
+#include <qdove/base/trial_space.h>
+#include <qdove/models/poisson.h>
+#include <qdove/models/schroedinger.h>
+
+// deal.II
+#include <deal.II/base/timer.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/petsc_vector.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The wells this benchmark knows the eigenvalues of.
+enum Well
+{
+  SquareWell,
+  HarmonicOscillator
+};
+
+// Return the n-th analytic eigenvalue of this well, counting from
+// one.
+double
+analytic_eigenvalue (const Well         well,
+		     const unsigned int n)
+{
+  if (well==SquareWell)
+    return (n*M_PI) * (n*M_PI);
+  return 2.*n - 1.;
+}
+
+// Solve the well with elements of this degree on a grid with this
+// many refinements, and report the largest relative error of the
+// lowest eigenvalues.
+template<int dim>
+void
+run (const Well         well,
+     const unsigned int degree,
+     const unsigned int n_refinements,
+     const unsigned int n_eigenpairs)
+{
+  dealii::Triangulation<dim> triangulation;
+  if (well==SquareWell)
+    dealii::GridGenerator::hyper_cube (triangulation, 0., 1.);
+  else
+    dealii::GridGenerator::hyper_cube (triangulation, -10., 10.);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<dim> trial_space (triangulation);
+  qdove::TestSpace<dim> test_space (trial_space, degree);
+
+  dealii::Timer timer;
+  timer.restart ();
+
+  // The coefficients are given exactly at quadrature points.
+  const dealii::QGauss<dim> quadrature_formula = test_space.quadrature ();
+  qdove::QuadratureField<dim> ke_field (test_space, quadrature_formula);
+  qdove::QuadratureField<dim> pe_field (test_space, quadrature_formula);
+  qdove::QuadratureField<dim> zero_field (test_space, quadrature_formula);
+  ke_field = 1.;
+  zero_field = 0.;
+
+  if (well==HarmonicOscillator)
+    {
+      dealii::FEValues<dim> fe_values (test_space.fe (), quadrature_formula,
+				       dealii::update_quadrature_points);
+      typename dealii::DoFHandler<dim>::active_cell_iterator
+	cell = test_space.dofs ().begin_active (),
+	endc = test_space.dofs ().end ();
+      for (; cell!=endc; ++cell)
+	{
+	  fe_values.reinit (cell);
+	  double *values = pe_field.cell_values (cell);
+	  for (unsigned int q_point=0; q_point<quadrature_formula.size (); ++q_point)
+	    values[q_point] = fe_values.quadrature_point (q_point).square ();
+	}
+    }
+
+  qdove::Schroedinger::Problem<dim> schroedinger_problem (trial_space, test_space, n_eigenpairs);
+  schroedinger_problem.set_solver_type (qdove::Schroedinger::KrylovSchur);
+  schroedinger_problem.reinit ();
+  schroedinger_problem.assemble (ke_field, zero_field);
+  schroedinger_problem.assemble_potential (pe_field);
+  schroedinger_problem.solve ();
+
+  const double solve_time = timer.wall_time ();
+
+  std::vector<double> eigenvalues;
+  std::vector<dealii::PETScWrappers::Vector> eigenvectors;
+  schroedinger_problem.get_solution_eigenpairs (eigenvalues, eigenvectors);
+
+  double error = 0.;
+  for (unsigned int i=0; i<n_eigenpairs; ++i)
+    error = std::max (error, std::fabs (eigenvalues[i]-analytic_eigenvalue (well, i+1)) / analytic_eigenvalue (well, i+1));
+
+  std::cout << std::setw (22) << ((well==SquareWell) ? "square well" : "harmonic oscillator")
+	    << std::setw (8)  << degree
+	    << std::setw (10) << test_space.n_dofs ()
+	    << std::setw (14) << error
+	    << std::setw (14) << solve_time
+	    << std::endl;
+}
+
+// Solve Poisson's problem with elements of this degree on a grid
+// with this many refinements, and report the largest error at the
+// support points.
+template<int dim>
+void
+run_poisson (const unsigned int degree,
+	     const unsigned int n_refinements)
+{
+  dealii::Triangulation<dim> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, 0., 1.);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<dim> trial_space (triangulation);
+  qdove::TestSpace<dim> test_space (trial_space, degree);
+
+  dealii::Timer timer;
+  timer.restart ();
+
+  const dealii::QGauss<dim> quadrature_formula = test_space.quadrature ();
+  qdove::QuadratureField<dim> rhs_field (test_space, quadrature_formula);
+  {
+    dealii::FEValues<dim> fe_values (test_space.fe (), quadrature_formula,
+				     dealii::update_quadrature_points);
+    typename dealii::DoFHandler<dim>::active_cell_iterator
+      cell = test_space.dofs ().begin_active (),
+      endc = test_space.dofs ().end ();
+    for (; cell!=endc; ++cell)
+      {
+	fe_values.reinit (cell);
+	double *values = rhs_field.cell_values (cell);
+	for (unsigned int q_point=0; q_point<quadrature_formula.size (); ++q_point)
+	  values[q_point] = M_PI * M_PI * std::sin (M_PI * fe_values.quadrature_point (q_point)[0]);
+      }
+  }
+
+  // The first call assembles the stiffness matrix, the second one
+  // the right-hand side only.
+  qdove::Poisson::Problem<dim> poisson_problem (trial_space, test_space);
+  poisson_problem.reinit ();
+  poisson_problem.assemble (rhs_field);
+  poisson_problem.reinit ();
+  poisson_problem.assemble (rhs_field);
+  poisson_problem.solve ();
+
+  const double solve_time = timer.wall_time ();
+
+  const dealii::PETScWrappers::Vector &solution = poisson_problem.solution ();
+
+  std::vector<dealii::Point<dim> > support_points (test_space.n_dofs ());
+  dealii::DoFTools::map_dofs_to_support_points (dealii::MappingQ1<dim> (), test_space.dofs (), support_points);
+
+  double error = 0.;
+  for (unsigned int i=0; i<test_space.n_dofs (); ++i)
+    error = std::max (error, std::fabs (solution (i)-std::sin (M_PI * support_points[i][0])));
+
+  std::cout << std::setw (22) << "poisson"
+	    << std::setw (8)  << degree
+	    << std::setw (10) << test_space.n_dofs ()
+	    << std::setw (14) << error
+	    << std::setw (14) << solve_time
+	    << std::endl;
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	std::cout << std::setw (22) << "well"
+		  << std::setw (8)  << "degree"
+		  << std::setw (10) << "n_dofs"
+		  << std::setw (14) << "rel. error"
+		  << std::setw (14) << "time (s)"
+		  << std::endl;
+
+	const Well wells[] = { SquareWell, HarmonicOscillator };
+	for (unsigned int w=0; w<2; ++w)
+	  for (unsigned int degree=1; degree<=4; ++degree)
+	    for (unsigned int n_refinements=3; n_refinements<=11; n_refinements+=2)
+	      run<1> (wells[w], degree, n_refinements, 4);
+
+	for (unsigned int degree=1; degree<=4; ++degree)
+	  for (unsigned int n_refinements=3; n_refinements<=11; n_refinements+=2)
+	    run_poisson<1> (degree, n_refinements);
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,2 @@
+make clean && \
+rm -rf CMakeCache.txt CMakeFiles cmake_install.cmake  Makefile *~
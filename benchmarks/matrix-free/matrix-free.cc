@@ -0,0 +1,176 @@
+
+// This benchmark compares the throughput and memory of the
+// matrix-free Hamiltonian operator with that of an assembled PETSc
+// matrix of the same problem.
+#include <qdove/base/test_space.h>
+#include <qdove/base/trial_space.h>
+#include <qdove/models/hamiltonian_operator.h>
+
+// deal.II
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/compressed_sparsity_pattern.h>
+#include <deal.II/lac/constraint_matrix.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/petsc_sparse_matrix.h>
+#include <deal.II/lac/petsc_vector.h>
+
+// C++
+#include <iomanip>
+#include <iostream>
+
+// Assemble the (unscaled) Hamiltonian with unit kinetic and
+// potential energy functions into a PETSc matrix.
+template<int dim>
+void
+assemble_matrix (qdove::TestSpace<dim>                 &test_space,
+		 const dealii::ConstraintMatrix        &constraints,
+		 dealii::PETScWrappers::SparseMatrix   &matrix)
+{
+  dealii::CompressedSparsityPattern sparsity_pattern (test_space.n_dofs ());
+  dealii::DoFTools::make_sparsity_pattern (test_space.dofs (), sparsity_pattern, constraints, false);
+  matrix.reinit (sparsity_pattern);
+
+  const dealii::QGauss<dim> quadrature_formula (2);
+  dealii::FEValues<dim> fe_values (test_space.fe (), quadrature_formula,
+				   dealii::update_values | dealii::update_gradients | dealii::update_JxW_values);
+
+  const unsigned int dofs_per_cell = test_space.n_dofs_per_cell ();
+  const unsigned int n_q_points    = quadrature_formula.size ();
+
+  dealii::FullMatrix<double> cell_matrix (dofs_per_cell, dofs_per_cell);
+  std::vector<dealii::types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+  typename dealii::DoFHandler<dim>::active_cell_iterator
+    cell = test_space.dofs ().begin_active (),
+    endc = test_space.dofs ().end ();
+
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      cell_matrix = 0;
+
+      for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	for (unsigned int i=0; i<dofs_per_cell; ++i)
+	  for (unsigned int j=0; j<dofs_per_cell; ++j)
+	    cell_matrix (i, j) += (fe_values.shape_grad (i, q_point) * fe_values.shape_grad (j, q_point) +
+				   fe_values.shape_value (i, q_point) * fe_values.shape_value (j, q_point))
+	      * fe_values.JxW (q_point);
+
+      cell->get_dof_indices (local_dof_indices);
+      constraints.distribute_local_to_global (cell_matrix, local_dof_indices, matrix);
+    }
+
+  matrix.compress (dealii::VectorOperation::add);
+}
+
+// Time n_products matrix-vector products with the assembled matrix
+// and the matrix-free operator on a grid with this many refinements.
+template<int dim>
+void
+run (const unsigned int n_refinements,
+     const unsigned int n_products)
+{
+  dealii::Triangulation<dim> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, -1., 1.);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<dim> trial_space (triangulation);
+  qdove::TestSpace<dim> test_space (trial_space);
+
+  dealii::ConstraintMatrix constraints;
+  dealii::DoFTools::make_zero_boundary_constraints (test_space.dofs (), constraints);
+  constraints.close ();
+
+  const unsigned int n_dofs = test_space.n_dofs ();
+
+  // Assembled matrix.
+  dealii::PETScWrappers::SparseMatrix matrix;
+  assemble_matrix (test_space, constraints, matrix);
+
+  // Matrix-free operator.
+  dealii::Vector<double> unit_function (n_dofs);
+  unit_function = 1.;
+
+  qdove::Schroedinger::HamiltonianOperator<dim,1> hamiltonian_operator;
+  hamiltonian_operator.reinit (test_space.dofs (), constraints);
+  hamiltonian_operator.set_kinetic_energy (unit_function);
+  hamiltonian_operator.set_potential_energy (unit_function);
+
+  dealii::PETScWrappers::Vector src (n_dofs);
+  dealii::PETScWrappers::Vector dst (n_dofs);
+  for (unsigned int i=0; i<n_dofs; ++i)
+    src (i) = 1.+i%7;
+  src.compress (dealii::VectorOperation::insert);
+
+  dealii::Timer timer;
+
+  timer.restart ();
+  for (unsigned int i=0; i<n_products; ++i)
+    matrix.vmult (dst, src);
+  const double assembled_time = timer.wall_time ();
+
+  timer.restart ();
+  for (unsigned int i=0; i<n_products; ++i)
+    hamiltonian_operator.vmult (dst, src);
+  const double matrix_free_time = timer.wall_time ();
+
+  // Report throughput in millions of degrees of freedom per second.
+  const double n_processed = static_cast<double> (n_dofs) * n_products;
+
+  std::cout << std::setw (10) << n_dofs
+	    << std::setw (14) << 1e-6*n_processed/assembled_time
+	    << std::setw (14) << 1e-6*n_processed/matrix_free_time
+	    << std::setw (14) << matrix.memory_consumption ()
+	    << std::setw (14) << hamiltonian_operator.memory_consumption ()
+	    << std::endl;
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	std::cout << std::setw (10) << "n_dofs"
+		  << std::setw (14) << "SpMV MDoF/s"
+		  << std::setw (14) << "MF MDoF/s"
+		  << std::setw (14) << "SpMV bytes"
+		  << std::setw (14) << "MF bytes"
+		  << std::endl;
+
+	for (unsigned int n_refinements=10; n_refinements<=18; n_refinements+=2)
+	  run<1> (n_refinements, 100);
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
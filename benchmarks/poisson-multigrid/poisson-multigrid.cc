@@ -0,0 +1,104 @@
+
+// This benchmark compares the number of conjugate gradient iterations
+// and the solve time of Poisson's problem with the available
+// preconditioners across refinement levels.
+#include <qdove/base/test_space.h>
+#include <qdove/base/trial_space.h>
+#include <qdove/models/poisson.h>
+
+// deal.II
+#include <deal.II/base/timer.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/petsc_vector.h>
+
+// C++
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Solve Poisson's problem with a unit right-hand side on a grid
+// with this many refinements and this preconditioner.
+template<int dim>
+void
+run (const unsigned int                       n_refinements,
+     const qdove::Poisson::PreconditionerType preconditioner_type,
+     const std::string                       &name)
+{
+  dealii::Triangulation<dim> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, -1., 1.);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<dim> trial_space (triangulation);
+  qdove::TestSpace<dim> test_space (trial_space);
+
+  qdove::Poisson::Problem<dim> poisson_problem (trial_space, test_space);
+  poisson_problem.set_preconditioner_type (preconditioner_type);
+
+  dealii::PETScWrappers::Vector rhs_function (test_space.n_dofs ());
+  rhs_function = 1.;
+
+  poisson_problem.reinit ();
+  poisson_problem.assemble (rhs_function);
+
+  // The time includes setting up the preconditioner.
+  dealii::Timer timer;
+  timer.restart ();
+  const unsigned int n_iterations = poisson_problem.solve ();
+  const double solve_time = timer.wall_time ();
+
+  if (test_space.this_mpi_process ()==0)
+    std::cout << std::setw (10) << test_space.n_dofs ()
+	      << std::setw (22) << name
+	      << std::setw (12) << n_iterations
+	      << std::setw (14) << solve_time
+	      << std::endl;
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	if (dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD)==0)
+	  std::cout << std::setw (10) << "n_dofs"
+		    << std::setw (22) << "preconditioner"
+		    << std::setw (12) << "iterations"
+		    << std::setw (14) << "time (s)"
+		    << std::endl;
+
+	for (unsigned int n_refinements=8; n_refinements<=18; n_refinements+=2)
+	  {
+	    run<1> (n_refinements, qdove::Poisson::BlockJacobi, "BlockJacobi");
+	    run<1> (n_refinements, qdove::Poisson::AlgebraicMultigrid, "AlgebraicMultigrid");
+	  }
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
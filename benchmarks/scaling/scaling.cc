@@ -0,0 +1,144 @@
+
+// This benchmark tracks the time to assemble and solve Schroedinger's
+// and Poisson's problems against the number of degrees of freedom in
+// one, two and three dimensions. Schroedinger's problem is the
+// isotropic harmonic oscillator \f$-\Delta u+|x|^2u=Eu\f$ on
+// \f$[-5,5]^d\f$, and Poisson's problem has a unit right-hand side
+// on the same grid.
+#include <qdove/base/quadrature_field.h>
+#include <qdove/base/test_space.h>
+#include <qdove/base/trial_space.h>
+#include <qdove/models/poisson.h>
+#include <qdove/models/schroedinger.h>
+
+// deal.II
+#include <deal.II/base/timer.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/petsc_vector.h>
+
+// C++
+#include <iomanip>
+#include <iostream>
+
+// Assemble and solve both problems on a grid with this many
+// refinements, and report the times of each step.
+template<int dim>
+void
+run (const unsigned int n_refinements)
+{
+  dealii::Triangulation<dim> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, -5., 5.);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<dim> trial_space (triangulation);
+  qdove::TestSpace<dim> test_space (trial_space);
+
+  const dealii::QGauss<dim> quadrature_formula = test_space.quadrature ();
+  qdove::QuadratureField<dim> ke_field (test_space, quadrature_formula);
+  qdove::QuadratureField<dim> pe_field (test_space, quadrature_formula);
+  ke_field = 1.;
+
+  dealii::FEValues<dim> fe_values (test_space.fe (), quadrature_formula,
+				   dealii::update_quadrature_points);
+  typename dealii::DoFHandler<dim>::active_cell_iterator
+    cell = test_space.dofs ().begin_active (),
+    endc = test_space.dofs ().end ();
+  for (; cell!=endc; ++cell)
+    {
+      fe_values.reinit (cell);
+      double *values = pe_field.cell_values (cell);
+      for (unsigned int q_point=0; q_point<quadrature_formula.size (); ++q_point)
+	values[q_point] = fe_values.quadrature_point (q_point).square ();
+    }
+
+  dealii::Timer timer;
+
+  // Schroedinger's problem.
+  qdove::Schroedinger::Problem<dim> schroedinger_problem (trial_space, test_space, 4);
+  schroedinger_problem.set_solver_type (qdove::Schroedinger::KrylovSchur);
+
+  timer.restart ();
+  schroedinger_problem.reinit ();
+  schroedinger_problem.assemble (ke_field, pe_field);
+  const double schroedinger_assembly_time = timer.wall_time ();
+
+  timer.restart ();
+  schroedinger_problem.solve ();
+  const double schroedinger_solve_time = timer.wall_time ();
+
+  // Poisson's problem.
+  qdove::Poisson::Problem<dim> poisson_problem (trial_space, test_space);
+  poisson_problem.set_preconditioner_type (qdove::Poisson::AlgebraicMultigrid);
+
+  dealii::PETScWrappers::Vector rhs_function (test_space.n_dofs ());
+  rhs_function = 1.;
+
+  timer.restart ();
+  poisson_problem.reinit ();
+  poisson_problem.assemble (rhs_function);
+  const double poisson_assembly_time = timer.wall_time ();
+
+  timer.restart ();
+  poisson_problem.solve ();
+  const double poisson_solve_time = timer.wall_time ();
+
+  std::cout << std::setw (5)  << dim
+	    << std::setw (10) << test_space.n_dofs ()
+	    << std::setw (16) << schroedinger_assembly_time
+	    << std::setw (16) << schroedinger_solve_time
+	    << std::setw (16) << poisson_assembly_time
+	    << std::setw (16) << poisson_solve_time
+	    << std::endl;
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	std::cout << std::setw (5)  << "dim"
+		  << std::setw (10) << "n_dofs"
+		  << std::setw (16) << "S assembly (s)"
+		  << std::setw (16) << "S solve (s)"
+		  << std::setw (16) << "P assembly (s)"
+		  << std::setw (16) << "P solve (s)"
+		  << std::endl;
+
+	for (unsigned int n_refinements=8; n_refinements<=16; n_refinements+=2)
+	  run<1> (n_refinements);
+	for (unsigned int n_refinements=3; n_refinements<=8; ++n_refinements)
+	  run<2> (n_refinements);
+	for (unsigned int n_refinements=2; n_refinements<=5; ++n_refinements)
+	  run<3> (n_refinements);
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,422 @@
+
+// This benchmark times the main phases of a Schroedinger-Poisson
+// calculation: assembly and solution of Schroedinger's and Poisson's
+// problems, Fermi-Dirac number densities, interpolation of Fick's
+// analytic solution and one full self-consistent cycle. The problem
+// is the GaAs well of step-1, swept over mesh sizes and numbers of
+// electron states, and Schroedinger's problem is solved with each of
+// the eigenspectrum backends that scale to these sizes. Every phase is run a few times to warm up and
+// then timed over several runs, of which the minimum, median, mean
+// and standard deviation are reported. The results are also written
+// as JSON (to suite.json, or the file named on the command line), so
+// that runs with different backends or releases can be compared by
+// script.
+#include <qdove/base/test_space.h>
+#include <qdove/base/trial_space.h>
+#include <qdove/materials/constants.h>
+#include <qdove/models/fick.h>
+#include <qdove/models/poisson.h>
+#include <qdove/models/schroedinger.h>
+#include <qdove/models/self_consistent.h>
+#include <qdove/models/statistics.h>
+
+// deal.II
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/lac/petsc_vector.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Number of untimed runs before, and of timed runs of, every phase.
+const unsigned int n_warmup_runs = 2;
+const unsigned int n_timed_runs  = 10;
+
+// The eigenspectrum backends that are timed: the sparse Krylov-Schur
+// solver, the direct tridiagonal solver and the matrix-free
+// operators with the Jacobi-Davidson solver. The dense LAPACK solver
+// is left out, since its cost grows with the cube of the number of
+// degrees of freedom.
+struct Backend
+{
+  const char                      *name;
+  qdove::Schroedinger::SolverType  solver_type;
+  bool                             matrix_free;
+};
+
+const Backend backends[] =
+{
+  { "KrylovSchur", qdove::Schroedinger::KrylovSchur,    false },
+  { "Tridiagonal", qdove::Schroedinger::Tridiagonal,    false },
+  { "matrix-free", qdove::Schroedinger::JacobiDavidson, true  }
+};
+const unsigned int n_backends = sizeof (backends) / sizeof (backends[0]);
+
+// Statistics of the timed runs of one phase.
+struct Measurement
+{
+  std::string  phase;
+  unsigned int n_dofs;
+  unsigned int n_eigenpairs;
+  unsigned int n_iterations;
+  double       min_time;
+  double       median_time;
+  double       mean_time;
+  double       stddev_time;
+};
+
+std::vector<Measurement> measurements;
+
+// Compute the statistics of these run times, print them and keep
+// them for the JSON output. Phases that do not depend on the number
+// of electron states have n_eigenpairs zero, and phases without an
+// iterative solver have n_iterations zero.
+void
+record (const std::string   &phase,
+	const unsigned int   n_dofs,
+	const unsigned int   n_eigenpairs,
+	const unsigned int   n_iterations,
+	std::vector<double>  times)
+{
+  std::sort (times.begin (), times.end ());
+
+  const unsigned int n = times.size ();
+
+  Measurement measurement;
+  measurement.phase        = phase;
+  measurement.n_dofs       = n_dofs;
+  measurement.n_eigenpairs = n_eigenpairs;
+  measurement.n_iterations = n_iterations;
+  measurement.min_time     = times[0];
+  measurement.median_time  = (n%2==1) ? times[n/2] : 0.5*(times[n/2-1]+times[n/2]);
+
+  double sum = 0.;
+  for (unsigned int i=0; i<n; ++i)
+    sum += times[i];
+  measurement.mean_time = sum/n;
+
+  double sum_of_squares = 0.;
+  for (unsigned int i=0; i<n; ++i)
+    sum_of_squares += (times[i]-measurement.mean_time) * (times[i]-measurement.mean_time);
+  measurement.stddev_time = (n>1) ? std::sqrt (sum_of_squares/(n-1)) : 0.;
+
+  measurements.push_back (measurement);
+
+  std::cout << std::left  << std::setw (56) << phase
+	    << std::right << std::setw (10) << n_dofs
+	    << std::setw (6)  << n_eigenpairs
+	    << std::setw (8)  << n_iterations
+	    << std::setw (14) << measurement.min_time
+	    << std::setw (14) << measurement.median_time
+	    << std::setw (14) << measurement.mean_time
+	    << std::setw (14) << measurement.stddev_time
+	    << std::endl;
+}
+
+// Write all measurements as JSON.
+void
+write_json (std::ostream &out)
+{
+  out << std::setprecision (9)
+      << "{\n"
+      << "  \"n_warmup_runs\": "   << n_warmup_runs << ",\n"
+      << "  \"n_timed_runs\": "    << n_timed_runs << ",\n"
+      << "  \"n_mpi_processes\": " << dealii::Utilities::MPI::n_mpi_processes (MPI_COMM_WORLD) << ",\n"
+      << "  \"measurements\": [";
+
+  for (unsigned int i=0; i<measurements.size (); ++i)
+    out << ((i==0) ? "\n" : ",\n")
+	<< "    {\"phase\": \""     << measurements[i].phase << "\", "
+	<< "\"n_dofs\": "           << measurements[i].n_dofs << ", "
+	<< "\"n_eigenpairs\": "     << measurements[i].n_eigenpairs << ", "
+	<< "\"n_iterations\": "     << measurements[i].n_iterations << ", "
+	<< "\"min\": "              << measurements[i].min_time << ", "
+	<< "\"median\": "           << measurements[i].median_time << ", "
+	<< "\"mean\": "             << measurements[i].mean_time << ", "
+	<< "\"stddev\": "           << measurements[i].stddev_time << "}";
+
+  out << "\n  ]\n}" << std::endl;
+}
+
+// Time assembly and solution of this Schroedinger problem, which
+// has not been initialised yet, with this backend.
+void
+time_schroedinger (qdove::Schroedinger::Problem<1>     &problem,
+		   const Backend                       &backend,
+		   const dealii::PETScWrappers::Vector &kinetic,
+		   const dealii::PETScWrappers::Vector &potential,
+		   const unsigned int                   n_dofs,
+		   const unsigned int                   n_eigenpairs)
+{
+  const std::string suffix = std::string (" (") + backend.name + ")";
+  const unsigned int n_runs = n_warmup_runs + n_timed_runs;
+
+  problem.set_solver_type (backend.solver_type);
+  problem.set_matrix_free (backend.matrix_free);
+  problem.reinit ();
+
+  dealii::Timer timer;
+  std::vector<double> times;
+
+  for (unsigned int i=0; i<n_runs; ++i)
+    {
+      timer.restart ();
+      problem.assemble (kinetic, potential);
+      if (i>=n_warmup_runs)
+	times.push_back (timer.wall_time ());
+    }
+  record ("Schroedinger::assemble" + suffix, n_dofs, n_eigenpairs, 0, times);
+
+  unsigned int n_iterations = 0;
+  times.clear ();
+  for (unsigned int i=0; i<n_runs; ++i)
+    {
+      timer.restart ();
+      n_iterations = problem.solve ();
+      if (i>=n_warmup_runs)
+	times.push_back (timer.wall_time ());
+    }
+  record ("Schroedinger::solve" + suffix, n_dofs, n_eigenpairs, n_iterations, times);
+}
+
+// Time all phases on a grid with this many refinements, for each of
+// these numbers of electron states.
+void
+run (const unsigned int               n_refinements,
+     const std::vector<unsigned int> &eigenpair_counts)
+{
+  const double radius       = 50e-10;
+  const double band_edge    = 0.5 * qdove::E0;
+  const double fermi_energy = band_edge * 0.95;
+  const double doping       = 1e25;
+
+  dealii::Triangulation<1> triangulation;
+  dealii::GridGenerator::hyper_cube (triangulation, -radius, radius);
+  triangulation.refine_global (n_refinements);
+
+  qdove::TrialSpace<1> trial_space (triangulation);
+  qdove::TestSpace<1> test_space (trial_space);
+
+  const unsigned int n_dofs = test_space.n_dofs ();
+  const unsigned int n_runs = n_warmup_runs + n_timed_runs;
+
+  dealii::Timer timer;
+  std::vector<double> times;
+
+  // Fick's analytic solution is the material profile.
+  qdove::Fick::Solution<1> fick_solution (trial_space, test_space);
+  fick_solution.reinit ();
+  fick_solution.set_initial_length (0.5*radius);
+  fick_solution.set_initial_height (1.);
+  fick_solution.set_initial_rate (1e-10);
+
+  dealii::PETScWrappers::Vector material_function (n_dofs);
+
+  times.clear ();
+  for (unsigned int i=0; i<n_runs; ++i)
+    {
+      timer.restart ();
+      fick_solution.interpolate_analytic_solution (material_function);
+      if (i>=n_warmup_runs)
+	times.push_back (timer.wall_time ());
+    }
+  record ("Fick::interpolate_analytic_solution", n_dofs, 0, 0, times);
+
+  // Material functions, as in step-1.
+  dealii::PETScWrappers::Vector potential (n_dofs);
+  dealii::PETScWrappers::Vector effective_mass (n_dofs);
+  dealii::PETScWrappers::Vector kinetic (n_dofs);
+  dealii::PETScWrappers::Vector doping_profile (n_dofs);
+  for (unsigned int i=0; i<n_dofs; ++i)
+    {
+      potential[i]      = 0.9 * band_edge * (1.-material_function[i]);
+      effective_mass[i] = qdove::mstar_GaAs;
+      kinetic[i]        = (qdove::HBAR*qdove::HBAR) / (2.*qdove::mstar_GaAs*qdove::M0);
+      doping_profile[i] = (potential[i] > fermi_energy) ? doping : 0.;
+    }
+  potential.compress (dealii::VectorOperation::insert);
+  effective_mass.compress (dealii::VectorOperation::insert);
+  kinetic.compress (dealii::VectorOperation::insert);
+  doping_profile.compress (dealii::VectorOperation::insert);
+
+  dealii::PETScWrappers::Vector density_of_states;
+  qdove::FermiDirac::compute_density_of_states (effective_mass, density_of_states);
+
+  // Poisson's problem does not depend on the number of states. A
+  // Poisson problem keeps its stiffness matrix and starts from its
+  // last solution, so every run is timed on a new problem; the solve
+  // includes the setup of the preconditioner.
+  {
+    std::vector<double> assembly_times;
+    std::vector<double> solve_times;
+    unsigned int n_iterations = 0;
+    for (unsigned int i=0; i<n_runs; ++i)
+      {
+	qdove::Poisson::Problem<1> poisson_problem (trial_space, test_space);
+	poisson_problem.reinit ();
+
+	timer.restart ();
+	poisson_problem.assemble (doping_profile);
+	const double assembly_time = timer.wall_time ();
+
+	timer.restart ();
+	n_iterations = poisson_problem.solve ();
+	const double solve_time = timer.wall_time ();
+
+	if (i>=n_warmup_runs)
+	  {
+	    assembly_times.push_back (assembly_time);
+	    solve_times.push_back (solve_time);
+	  }
+      }
+    record ("Poisson::assemble", n_dofs, 0, 0, assembly_times);
+    record ("Poisson::solve", n_dofs, 0, n_iterations, solve_times);
+  }
+
+  for (unsigned int e=0; e<eigenpair_counts.size (); ++e)
+    {
+      const unsigned int n_eigenpairs = eigenpair_counts[e];
+      if (n_eigenpairs>=n_dofs/2)
+	continue;
+
+      // Schroedinger's problem with every backend. The states of
+      // the first one are kept for the statistics below.
+      qdove::Schroedinger::Problem<1> schroedinger_problem (trial_space, test_space, n_eigenpairs);
+      time_schroedinger (schroedinger_problem, backends[0], kinetic, potential, n_dofs, n_eigenpairs);
+      for (unsigned int b=1; b<n_backends; ++b)
+	{
+	  qdove::Schroedinger::Problem<1> problem (trial_space, test_space, n_eigenpairs);
+	  time_schroedinger (problem, backends[b], kinetic, potential, n_dofs, n_eigenpairs);
+	}
+
+      // Fermi-Dirac statistics of the states just found, read in
+      // place.
+      const std::vector<double> &eigenvalues
+	= schroedinger_problem.solution_eigenvalues ();
+      const std::vector<dealii::PETScWrappers::Vector> &eigenvectors
+	= schroedinger_problem.solution_eigenvectors ();
+
+      dealii::PETScWrappers::Vector density (n_dofs);
+
+      times.clear ();
+      for (unsigned int i=0; i<n_runs; ++i)
+	{
+	  timer.restart ();
+	  qdove::FermiDirac::compute_number_density (eigenvectors, eigenvalues, fermi_energy,
+						     density_of_states, density);
+	  if (i>=n_warmup_runs)
+	    times.push_back (timer.wall_time ());
+	}
+      record ("FermiDirac::compute_number_density", n_dofs, n_eigenpairs, 0, times);
+
+      // The same from the contiguous block of the states.
+      const qdove::MultiVector &states = schroedinger_problem.solution_multivector ();
+
+      times.clear ();
+      for (unsigned int i=0; i<n_runs; ++i)
+	{
+	  timer.restart ();
+	  qdove::FermiDirac::compute_number_density (states, eigenvalues, fermi_energy,
+						     density_of_states, density);
+	  if (i>=n_warmup_runs)
+	    times.push_back (timer.wall_time ());
+	}
+      record ("FermiDirac::compute_number_density (block)", n_dofs, n_eigenpairs, 0, times);
+
+      // One cycle of the self-consistent problem, from the
+      // band-edge potential each time, with the backends that it
+      // can use.
+      for (unsigned int b=0; b<n_backends; ++b)
+	{
+	  if (backends[b].matrix_free)
+	    continue;
+
+	  qdove::SelfConsistent::Problem<1> self_consistent_problem (trial_space, test_space, n_eigenpairs);
+	  self_consistent_problem.set_solver_type (backends[b].solver_type);
+	  self_consistent_problem.set_effective_mass (effective_mass);
+	  self_consistent_problem.set_band_edge (potential);
+	  self_consistent_problem.set_doping (doping_profile);
+	  self_consistent_problem.set_material (fermi_energy, qdove::permittivity_GaAs);
+	  self_consistent_problem.set_tolerance (0., 1);
+
+	  times.clear ();
+	  for (unsigned int i=0; i<n_runs; ++i)
+	    {
+	      timer.restart ();
+	      self_consistent_problem.run ();
+	      if (i>=n_warmup_runs)
+		times.push_back (timer.wall_time ());
+	    }
+	  record (std::string ("SelfConsistent::cycle (") + backends[b].name + ")", n_dofs, n_eigenpairs, 0, times);
+	}
+    }
+}
+
+int main (int argc, char **argv)
+{
+  try
+    {
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
+      {
+	const std::string json_filename = (argc>1) ? argv[1] : "suite.json";
+
+	std::vector<unsigned int> eigenpair_counts;
+	eigenpair_counts.push_back (4);
+	eigenpair_counts.push_back (16);
+	eigenpair_counts.push_back (64);
+
+	std::cout << std::left  << std::setw (56) << "phase"
+		  << std::right << std::setw (10) << "n_dofs"
+		  << std::setw (6)  << "k"
+		  << std::setw (8)  << "its"
+		  << std::setw (14) << "min (s)"
+		  << std::setw (14) << "median (s)"
+		  << std::setw (14) << "mean (s)"
+		  << std::setw (14) << "stddev (s)"
+		  << std::endl;
+
+	for (unsigned int n_refinements=8; n_refinements<=14; n_refinements+=2)
+	  run (n_refinements, eigenpair_counts);
+
+	if (dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD)==0)
+	  {
+	    std::ofstream json (json_filename.c_str ());
+	    write_json (json);
+	  }
+      }
+    }
+  catch (std::exception &exc)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Exception on processing: " << std::endl
+                << exc.what() << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+
+      return 1;
+    }
+  catch (...)
+    {
+      std::cerr << std::endl << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      std::cerr << "Unknown exception!" << std::endl
+                << "Aborting!" << std::endl
+                << "----------------------------------------------------"
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 // space and trial spaces that make up the finite element system.
 #include <qdove/base/test_space.h>
 #include <qdove/base/trial_space.h>
+#include <qdove/base/profiler.h>
 #include <qdove/materials/constants.h>
 
 // Start by solving Schroedinger's problem 
@@ -71,6 +72,8 @@ void
 SchroedingerProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &vector,
 					 const std::string                   &name)
 {
+  qdove::Profiler::Scope profiler_scope ("output");
+
   // Output a vector to gnuplot style file. 
   std::ostringstream filename;
   filename << "solution-" << name << ".gpl";
@@ -83,6 +86,8 @@ SchroedingerProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &ve
   // generate default patches and output.
   data_out.build_patches ();
   data_out.write_gnuplot (output);
+
+  qdove::Profiler::add_bytes ("output", output.tellp ());
 }
 
 
@@ -122,6 +127,10 @@ SchroedingerProblem<dim>::run ()
   dealii::PETScWrappers::Vector potential (test_space.n_dofs ());
 
   schroedinger_problem.assemble (eff_mass, potential);
+
+  // This is a one-dimensional problem with linear elements, so the
+  // fast tridiagonal solver can be used.
+  schroedinger_problem.set_solver_type (qdove::Schroedinger::Tridiagonal);
   schroedinger_problem.solve ();
   schroedinger_problem.get_solution_eigenpairs (eigenvalues, eigenvectors);
   write_gnuplot (eigenvectors[0], "electron_function");
@@ -154,7 +163,7 @@ int main (int argc, char **argv)
 {
   try
     {
-      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, 1);
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
       {
 	// Create a grid
 	dealii::Triangulation<1> triangulation;
@@ -5,19 +5,15 @@
 // space and trial spaces that make up the finite element system.
 #include <qdove/base/test_space.h>
 #include <qdove/base/trial_space.h>
+#include <qdove/base/profiler.h>
 #include <qdove/materials/constants.h>
 
 // Use the *solution* to a fick equation as a material function
 #include <qdove/models/fick.h>
 
-// Start by solving Schroedinger's problem
-#include <qdove/models/schroedinger.h>
-
-// and next by solving Poissons's problem
-#include <qdove/models/poisson.h>
-
-// Fermi-Dirac statistic play a role later here
-#include <qdove/models/statistics.h>
+// The self-consistent problem couples Schroedinger's problem,
+// Poisson's problem and Fermi-Dirac statistics.
+#include <qdove/models/self_consistent.h>
 
 // Also make use of the predefined generalised eigenspectrum system -
 // we need this for the Schroedinger problem.
@@ -31,6 +27,7 @@
 // away yet...
 #include <deal.II/grid/tria.h>
 #include <deal.II/grid/grid_generator.h>
+#include <deal.II/base/conditional_ostream.h>
 #include <deal.II/numerics/data_out.h>
 
 // The purpose of this example is to have a working (dimensionless)
@@ -50,6 +47,9 @@ public:
   void run ();
 
 private:
+  // Screen output, written by the first MPI process only
+  dealii::ConditionalOStream pcout;
+
   // The description of the finite element basis
   qdove::TrialSpace<dim> trial_space;
 
@@ -59,29 +59,23 @@ private:
   // Fick's problem, which is used to obtain a material profile.
   qdove::Fick::Solution<1> fick_solution;
 
-  // The eigenspectrum system that will be solved by SLEPc
-  qdove::Schroedinger::Problem<dim> schroedinger_problem;
-
-  // The system of equations that will be solved by PETSc
-  qdove::Poisson::Problem<dim> poisson_problem;
+  // The coupled Schroedinger-Poisson problem
+  qdove::SelfConsistent::Problem<dim> self_consistent_problem;
 
   // The eigenpairs from schroedinger's problem
   std::vector<dealii::PETScWrappers::Vector> eigenvectors;
   std::vector<double>                        eigenvalues;
 
-  // The solution from poisson's problem
-  dealii::PETScWrappers::Vector solution;
-
 };
 
 template<int dim>
 SelfConsistentProblem<dim>::SelfConsistentProblem (dealii::Triangulation<dim> &triangulation)
   :
+  pcout (std::cout, dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD)==0),
   trial_space (triangulation),
   test_space (trial_space),
   fick_solution (trial_space, test_space),
-  schroedinger_problem (trial_space, test_space, 10),
-  poisson_problem (trial_space, test_space)
+  self_consistent_problem (trial_space, test_space, 10)
 {}
 
 template<int dim>
@@ -94,6 +88,13 @@ SelfConsistentProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &
              const std::string                   &name,
              const unsigned int                   cycle)
 {
+  // Every process holds the whole solution; only the first one
+  // writes it.
+  if (test_space.this_mpi_process ()!=0)
+    return;
+
+  qdove::Profiler::Scope profiler_scope ("output");
+
   // Output a vector to gnuplot style file.
   std::ostringstream filename;
   filename << "solution-" << name << "-" << cycle << ".gpl";
@@ -106,6 +107,8 @@ SelfConsistentProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &
   // generate default patches and output.
   data_out.build_patches ();
   data_out.write_gnuplot (output);
+
+  qdove::Profiler::add_bytes ("output", output.tellp ());
 }
 
 
@@ -113,7 +116,7 @@ template<int dim>
 void
 SelfConsistentProblem<dim>::run ()
 {
-  std::cout << "Test space:" << std::endl
+  pcout << "Test space:" << std::endl
       << "   Finite element type:          "
       << test_space.fe ().get_name ()
       << std::endl
@@ -153,105 +156,97 @@ SelfConsistentProblem<dim>::run ()
     kinetic[i] = (qdove::HBAR*qdove::HBAR) / (2.*eff_mass[i]*qdove::M0);
   write_gnuplot (kinetic, "kinetic", 0);
 
-  // set up the initial guess for the electron potential (i.e. electrostatic potential multiplied by elementary charge)
-  dealii::PETScWrappers::Vector potential (test_space.n_dofs ());
-  potential = initial_potential;
-  potential *= 0.9; //start with no space charge region
+  // The band-edge potential is the initial potential without a
+  // space charge region.
+  dealii::PETScWrappers::Vector band_edge_potential (initial_potential);
+  band_edge_potential *= 0.9;
+
+  // Ionised dopants sit in the barrier, where the band edge lies
+  // above the Fermi energy.
+  dealii::PETScWrappers::Vector doping_profile (test_space.n_dofs ());
+  for (std::size_t i=0; i<doping_profile.size (); ++i)
+    doping_profile[i] = (band_edge_potential[i] > fermi_energy) ? doping : 0.;
+  write_gnuplot (doping_profile, "doping", 0);
 
   //
-  // Main iteration Schroedinger <-> Poisson
+  // Iterate Schroedinger <-> Poisson to self-consistency
   //
-  for (std::size_t cycle = 0; cycle < 100; ++cycle)
-  {
-    write_gnuplot (potential, "potential", cycle);
-
-    // Get started on Schroedinger's problem
-    std::cout << "Schroedinger's problem:" << std::endl;
-    schroedinger_problem.reinit ();
-    schroedinger_problem.assemble (kinetic, potential);
-    schroedinger_problem.solve ();
-    schroedinger_problem.get_solution_eigenpairs (eigenvalues, eigenvectors);
-    write_gnuplot (eigenvectors[0], "electron_function", cycle);
-
-    // output
-    std::cout << "   Eigenvalues:                  ";
-    for (unsigned int i=0; i<eigenvalues.size (); ++i)
-      std::cout << eigenvalues[i] << " ";
-    std::cout << std::endl;
-
-    std::cout << "   Scaled values (meV):           ";
-    for (unsigned int i=0; i<eigenvalues.size (); ++i)
-      std::cout << eigenvalues[i]/(1e-03*qdove::E0) << " ";
-    std::cout << std::endl;
-
-    // Make the density of states (dos)
-    dealii::PETScWrappers::Vector dos (test_space.n_dofs ());
-    qdove::FermiDirac::compute_density_of_states (eff_mass, dos);
-
-    // and then the density
-    dealii::PETScWrappers::Vector density (test_space.n_dofs());
-    qdove::FermiDirac::compute_number_density (eigenvectors, eigenvalues, fermi_energy, dos, density);
-    write_gnuplot (density, "density", cycle);
-
-    // Set up RHS for Poisson's equation.
-    //
-    // First copy the density over, add the doping profile, and thten
-    // multiply by 4*\pi*e*e/permittivity
-    dealii::PETScWrappers::Vector rho (density);
-    for (std::size_t i=0; i<solution.size (); ++i)
-      if (potential[i] > fermi_energy)
-        rho[i] = -doping;
-    rho *= 4.0 * qdove::PI * qdove::E0 * qdove::E0 / (qdove::permittivity_GaAs);
-    write_gnuplot (rho, "rho", cycle);
-
-    // Solve Poisson:
-    std::cout << "Poisson's problem:" << std::endl;
-    poisson_problem.reinit ();
-    poisson_problem.assemble (rho);
-    poisson_problem.solve ();
-    poisson_problem.get_solution_vector (solution);
-    write_gnuplot (solution, "poisson_solution", cycle);
-
-    // Update potential:
-    double max_update = 0;
-    for (std::size_t i=0; i<solution.size(); ++i)
-    {
-      double old_value = potential[i] - initial_potential[i];
-      max_update = std::max(max_update, std::fabs(solution[i] - old_value));
-    }
-
-    double cutoff_update_value = 0.02 * qdove::E0;
-    double alpha = (max_update > cutoff_update_value) 
-      ? cutoff_update_value / max_update 
-      : 1.0; // update by at most 10 mV for stability reasons
-
-    alpha = 0.1;
-    std::cout << "alpha: " << alpha << std::endl;
-
-    for (std::size_t i=0; i<potential.size(); ++i)
-    {
-      double old_value = potential[i] - 0.9 * initial_potential[i];
-      double update    = solution[i] - old_value;
-
-      potential[i] += alpha * update;
-    }
-  }
+  self_consistent_problem.set_effective_mass (eff_mass);
+  self_consistent_problem.set_band_edge (band_edge_potential);
+  self_consistent_problem.set_doping (doping_profile);
+  self_consistent_problem.set_material (fermi_energy, qdove::permittivity_GaAs);
+  self_consistent_problem.set_mixing (qdove::SelfConsistent::Anderson, 0.1, 5);
+  self_consistent_problem.set_tolerance (1e-5*qdove::E0, 100);
+
+  // Converge on the initial mesh, and then on meshes that are
+  // refined adaptively around the well.
+  const unsigned int n_cycles = self_consistent_problem.run_adaptive (5);
+
+  pcout << "Self-consistent problem:" << std::endl
+            << "   Cycles:                       "
+            << n_cycles << std::endl
+            << "   Number of degrees of freedom: "
+            << test_space.n_dofs () << std::endl
+            << "   Residual (meV):               "
+            << self_consistent_problem.residual_norm ()/(1e-03*qdove::E0) << std::endl;
+
+  // One count per cycle, over all meshes.
+  const std::vector<unsigned int> &n_iterations = self_consistent_problem.eigensolver_iterations ();
+  pcout << "   Solver iterations:            ";
+  for (unsigned int i=0; i<n_iterations.size (); ++i)
+    pcout << n_iterations[i] << " ";
+  pcout << std::endl;
+
+  self_consistent_problem.get_solution_eigenpairs (eigenvalues, eigenvectors);
+  write_gnuplot (eigenvectors[0], "electron_function", n_cycles);
+
+  pcout << "   Eigenvalues:                  ";
+  for (unsigned int i=0; i<eigenvalues.size (); ++i)
+    pcout << eigenvalues[i] << " ";
+  pcout << std::endl;
+
+  pcout << "   Scaled values (meV):           ";
+  for (unsigned int i=0; i<eigenvalues.size (); ++i)
+    pcout << eigenvalues[i]/(1e-03*qdove::E0) << " ";
+  pcout << std::endl;
+
+  dealii::PETScWrappers::Vector potential;
+  self_consistent_problem.get_potential (potential);
+  write_gnuplot (potential, "potential", n_cycles);
+
+  dealii::PETScWrappers::Vector density;
+  self_consistent_problem.get_density (density);
+  write_gnuplot (density, "density", n_cycles);
 }
 
 int main (int argc, char **argv)
 {
   try
     {
-      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, 1);
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
       {
   // Create a grid
   dealii::Triangulation<1> triangulation;
   dealii::GridGenerator::hyper_cube (triangulation, -50e-10, 50e-10);
-  triangulation.refine_global (9);
+  triangulation.refine_global (7);
+
+  // Record where the time goes.
+  qdove::Profiler::enable ();
 
   // Run Schroedinger's problem on that grid
   SelfConsistentProblem<1> self_consistent_problem (triangulation);
   self_consistent_problem.run ();
+
+  // Summarise the phases of the first process on screen, and for
+  // scripts in JSON.
+  if (dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD)==0)
+    {
+      std::cout << std::endl;
+      qdove::Profiler::print_summary (std::cout);
+
+      std::ofstream profile ("profile.json");
+      qdove::Profiler::print_json (profile);
+    }
       }
     }
   catch (std::exception &exc)
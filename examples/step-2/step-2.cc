@@ -5,6 +5,7 @@
 // space and trial spaces that make up the finite element system.
 #include <qdove/base/test_space.h>
 #include <qdove/base/trial_space.h>
+#include <qdove/base/profiler.h>
 #include <qdove/materials/constants.h>
 
 // Use the *solution* to a fick equation as a material function
@@ -31,6 +32,7 @@
 // away yet...
 #include <deal.II/grid/tria.h>
 #include <deal.II/grid/grid_generator.h>
+#include <deal.II/base/conditional_ostream.h>
 #include <deal.II/numerics/data_out.h>
 
 // The purpose of this example is to have a working (dimensionless)
@@ -50,6 +52,9 @@ public:
   void run ();
 
 private:
+  // Screen output, written by the first MPI process only
+  dealii::ConditionalOStream pcout;
+
   // The description of the finite element basis
   qdove::TrialSpace<dim> trial_space;
 
@@ -77,6 +82,7 @@ private:
 template<int dim>
 SelfConsistentProblem<dim>::SelfConsistentProblem (dealii::Triangulation<dim> &triangulation)
   :
+  pcout (std::cout, dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD)==0),
   trial_space (triangulation),
   test_space (trial_space),
   fick_solution (trial_space, test_space),
@@ -94,6 +100,13 @@ SelfConsistentProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &
              const std::string                   &name,
              const unsigned int                   cycle)
 {
+  // Every process holds the whole solution; only the first one
+  // writes it.
+  if (test_space.this_mpi_process ()!=0)
+    return;
+
+  qdove::Profiler::Scope profiler_scope ("output");
+
   // Output a vector to gnuplot style file.
   std::ostringstream filename;
   filename << "solution-" << name << "-" << cycle << ".gpl";
@@ -106,6 +119,8 @@ SelfConsistentProblem<dim>::write_gnuplot (const dealii::PETScWrappers::Vector &
   // generate default patches and output.
   data_out.build_patches ();
   data_out.write_gnuplot (output);
+
+  qdove::Profiler::add_bytes ("output", output.tellp ());
 }
 
 
@@ -113,7 +128,7 @@ template<int dim>
 void
 SelfConsistentProblem<dim>::run ()
 {
-  std::cout << "Test space:" << std::endl
+  pcout << "Test space:" << std::endl
       << "   Finite element type:          "
       << test_space.fe ().get_name ()
       << std::endl
@@ -167,6 +182,10 @@ SelfConsistentProblem<dim>::run ()
   double E_bonding = 0.005 * qdove::E0; //5meV bonding energy of the ions
   double E_fermi = energy_height - E_bonding;
 
+  // Only the lowest few states are needed, so use a sparse
+  // eigensolver instead of the dense default.
+  schroedinger_problem.set_solver_type (qdove::Schroedinger::KrylovSchur);
+
   //
   // Main iteration Schroedinger <-> Poisson
   //
@@ -175,24 +194,41 @@ SelfConsistentProblem<dim>::run ()
     write_gnuplot (potential, "potential", cycle);
 
     // Get started on Schroedinger's problem
-    std::cout << "Schroedinger's problem:" << std::endl;
-    schroedinger_problem.reinit ();
+    pcout << "Schroedinger's problem:" << std::endl;
+    // The kinetic energy term does not change between cycles, so
+    // after the first cycle only the potential energy is assembled.
+    if (cycle==0)
+      {
+        schroedinger_problem.reinit ();
+        schroedinger_problem.assemble (kinetic_energy_prefactor, potential);
 
-    schroedinger_problem.assemble (kinetic_energy_prefactor, potential);
-    schroedinger_problem.solve ();
+        pcout << "   Memory saved by preallocation: "
+                  << schroedinger_problem.memory_saved_by_preallocation ()
+                  << " bytes" << std::endl;
+      }
+    else
+      schroedinger_problem.assemble_potential (potential);
+
+    // Warm start from the eigenpairs of the previous cycle.
+    if (cycle>0)
+      schroedinger_problem.set_initial_eigenpairs (eigenvalues, eigenvectors);
+    const unsigned int n_iterations = schroedinger_problem.solve ();
     schroedinger_problem.get_solution_eigenpairs (eigenvalues, eigenvectors);
     write_gnuplot (eigenvectors[0], "electron_function", cycle);
 
     // output
-    std::cout << "   Eigenvalues:                  ";
+    pcout << "   Solver iterations:            "
+              << n_iterations << std::endl;
+
+    pcout << "   Eigenvalues:                  ";
     for (unsigned int i=0; i<eigenvalues.size (); ++i)
-      std::cout << eigenvalues[i] << " ";
-    std::cout << std::endl;
+      pcout << eigenvalues[i] << " ";
+    pcout << std::endl;
 
-    std::cout << "   Scaled values (meV):           ";
+    pcout << "   Scaled values (meV):           ";
     for (unsigned int i=0; i<eigenvalues.size (); ++i)
-      std::cout << eigenvalues[i]/(1e-03*qdove::E0) << " ";
-    std::cout << std::endl;
+      pcout << eigenvalues[i]/(1e-03*qdove::E0) << " ";
+    pcout << std::endl;
 
     // Compute density from the eigenfunctions and eigenvalues:
     double kBT = 300.0 * qdove::KB;
@@ -219,8 +255,12 @@ SelfConsistentProblem<dim>::run ()
     write_gnuplot (rho, "rho", cycle);
 
     // Solve Poisson:
-    std::cout << "Poisson's problem:" << std::endl;
+    pcout << "Poisson's problem:" << std::endl;
     poisson_problem.reinit ();
+    if (cycle==0)
+      pcout << "   Memory saved by preallocation: "
+                << poisson_problem.memory_saved_by_preallocation ()
+                << " bytes" << std::endl;
     poisson_problem.assemble (rho);
     poisson_problem.solve ();
     poisson_problem.get_solution_vector (solution);
@@ -238,7 +278,7 @@ SelfConsistentProblem<dim>::run ()
     double alpha = (max_update > cutoff_update_value) ? cutoff_update_value / max_update : 1.0; //update by at most 10 mV for stability reasons
 
     alpha = 0.2;
-    std::cout << "alpha: " << alpha << std::endl;
+    pcout << "alpha: " << alpha << std::endl;
 
     for (std::size_t i=0; i<potential.size(); ++i)
     {
@@ -253,12 +293,23 @@ int main (int argc, char **argv)
 {
   try
     {
-      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, 1);
+      dealii::Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, dealii::numbers::invalid_unsigned_int);
       {
-  // Create a grid
+  // Create a grid of the four layers of the heterostructure, with
+  // fine cells at the three interfaces and coarse cells in the
+  // bulk. The diffusion lengths are those of the material function
+  // below. The interfaces are resolved more finely than by a uniform
+  // grid with four times as many cells (refine_global (8)).
   dealii::Triangulation<1> triangulation;
-  dealii::GridGenerator::hyper_cube (triangulation, 0, 200e-10);
-  triangulation.refine_global (8);
+  {
+    const double thickness[]        = { 50e-10, 50e-10, 50e-10, 50e-10 };
+    const double diffusion_length[] = { 2e-10, 2e-10, 2e-10 };
+
+    qdove::TrialSpace<1> trial_space (triangulation);
+    trial_space.make_graded_grid (std::vector<double> (thickness, thickness+4),
+				  std::vector<double> (diffusion_length, diffusion_length+3),
+				  64);
+  }
 
   // Run Schroedinger's problem on that grid
   SelfConsistentProblem<1> self_consistent_problem (triangulation);
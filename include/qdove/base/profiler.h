@@ -0,0 +1,171 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_profiler_h
+#define __qdove_profiler_h
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace qdove
+{
+
+  /**
+     \brief Wall time, call counts, solver iterations and allocated
+     bytes of the phases of the solver pipeline.
+
+     The models mark their phases (for example
+     <code>"Schroedinger::solve"</code>) with a Profiler::Scope,
+     which measures the wall time from its construction to its
+     destruction, and report the iterations of their solvers and the
+     bytes of the objects they allocate or write. Phases may nest
+     (<code>"Schroedinger::normalise"</code> is part of
+     <code>"Schroedinger::solve"</code>), so the times of all phases
+     do not add up to the total.
+
+     Profiling is disabled by default; then a scope only tests a
+     flag, and nothing is recorded. Phases are recorded by the thread
+     that calls the models, so scopes must not be opened by worker
+     threads.
+
+     A summary of all phases can be written as a table or as JSON:
+     @code
+       qdove::Profiler::enable ();
+       // ... solve ...
+       qdove::Profiler::print_summary (std::cout);
+       qdove::Profiler::print_json (json_file);
+     @endcode
+
+     @author Toby D. Young 2013.
+  */
+  class Profiler
+  {
+  public:
+
+    /**
+       Measure the wall time of a phase from construction to
+       destruction, and count one call of it.
+    */
+    class Scope
+    {
+    public:
+
+      /**
+	 Constructor. Start measuring this phase. The name must
+	 outlive the scope (a string literal).
+      */
+      Scope (const char *phase);
+
+      /**
+	 Destructor. Stop measuring and record the phase.
+      */
+      ~Scope ();
+
+    private:
+
+      /**
+	 Name of the phase, or null if profiling was disabled when
+	 the scope was opened.
+      */
+      const char *phase;
+
+      /**
+	 Wall time at which the scope was opened.
+      */
+      double start_time;
+    };
+
+    /**
+       Enable or disable profiling.
+    */
+    static void enable (const bool enable = true);
+
+    /**
+       Return true if profiling is enabled.
+    */
+    static bool is_enabled ();
+
+    /**
+       Add the iterations of a solver to a phase.
+    */
+    static void add_iterations (const char        *phase,
+				const unsigned int n_iterations);
+
+    /**
+       Add the bytes of objects allocated by a phase.
+    */
+    static void add_bytes (const char        *phase,
+			   const std::size_t  n_bytes);
+
+    /**
+       Forget all recorded phases.
+    */
+    static void reset ();
+
+    /**
+       Write a table of all recorded phases.
+    */
+    static void print_summary (std::ostream &out);
+
+    /**
+       Write all recorded phases as a JSON object, keyed by phase.
+    */
+    static void print_json (std::ostream &out);
+
+  private:
+
+    /**
+       Data recorded for one phase.
+    */
+    struct Phase
+    {
+      Phase ();
+
+      unsigned int       n_calls;
+      double             wall_time;
+      unsigned long long n_iterations;
+      std::size_t        n_bytes;
+    };
+
+    /**
+       Return the wall time in seconds.
+    */
+    static double wall_clock ();
+
+    /**
+       Flag indicating if profiling is enabled.
+    */
+    static bool enabled;
+
+    /**
+       All recorded phases, by name.
+    */
+    static std::map<std::string, Phase> phases;
+  };
+
+} // namespace qdove
+
+#endif // __qdove_profiler_h
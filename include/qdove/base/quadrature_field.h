@@ -0,0 +1,244 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_quadrature_field_h
+#define __qdove_quadrature_field_h
+
+#include <qdove/base/test_space.h>
+
+#include <deal.II/base/numbers.h>
+#include <deal.II/base/quadrature.h>
+#include <deal.II/lac/petsc_vector.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace qdove
+{
+  /**
+     A field given by its values at the quadrature points of all
+     active cells of a test space. Material functions, densities and
+     potentials stored this way are used by the models directly at
+     quadrature points, without interpolating them from degrees of
+     freedom, which is exact for functions that are known pointwise.
+
+     Values are stored contiguously cell by cell, and the values of a
+     cell are found from its level and index. The field is only valid
+     for the mesh and the quadrature formula it was set up for; the
+     models check the former with dof_revision().
+
+     @author Toby D. Young 2013.
+  */
+  template<int dim>
+    class QuadratureField
+    {
+    public:
+      /**
+	 Constructor
+      */
+      QuadratureField ();
+
+      /**
+	 Constructor. Set up the field on the active cells of this test
+	 space for this quadrature formula.
+      */
+      QuadratureField (qdove::TestSpace<dim>         &test_space,
+		       const dealii::Quadrature<dim> &quadrature);
+
+      /**
+	 Set up the field on the active cells of this test space for
+	 this quadrature formula. All values are set to zero.
+      */
+      void reinit (qdove::TestSpace<dim>         &test_space,
+		   const dealii::Quadrature<dim> &quadrature);
+
+      /**
+	 Set up the field with the same layout as another one. All
+	 values are set to zero.
+      */
+      void reinit (const QuadratureField<dim> &field);
+
+      /**
+	 Set the field to the values of a function given at degrees of
+	 freedom of the test space.
+      */
+      void interpolate (qdove::TestSpace<dim>               &test_space,
+			const dealii::Quadrature<dim>       &quadrature,
+			const dealii::PETScWrappers::Vector &function);
+
+      /**
+	 Return the number of quadrature points per cell.
+      */
+      unsigned int n_q_points () const;
+
+      /**
+	 Return the total number of values.
+      */
+      std::size_t size () const;
+
+      /**
+	 Return the revision of the degrees of freedom of the test
+	 space (see TestSpace::dof_revision()) that the field was set
+	 up for. The field is stale once the test space has another
+	 revision.
+      */
+      unsigned int dof_revision () const;
+
+      /**
+	 Return a pointer to the values of this cell.
+      */
+      template<class CellIterator>
+	double *cell_values (const CellIterator &cell);
+
+      /**
+	 Return a pointer to the values of this cell.
+      */
+      template<class CellIterator>
+	const double *cell_values (const CellIterator &cell) const;
+
+      /**
+	 Copy the values of this cell.
+      */
+      template<class CellIterator>
+	void get_cell_values (const CellIterator  &cell,
+			      std::vector<double> &values) const;
+
+      /**
+	 Access to all values, cell by cell.
+      */
+      double       *begin ();
+      const double *begin () const;
+      double       *end ();
+      const double *end () const;
+
+      /**
+	 Set all values to a constant.
+      */
+      QuadratureField<dim> &operator= (const double value);
+
+      /**
+	 Multiply all values by a constant.
+      */
+      QuadratureField<dim> &operator*= (const double factor);
+
+      /**
+	 Add a multiple of another field with the same layout.
+      */
+      void add (const double                a,
+		const QuadratureField<dim> &field);
+
+      /**
+	 Return the smallest value.
+      */
+      double min () const;
+
+      /**
+	 Return the largest absolute value.
+      */
+      double linfty_norm () const;
+
+      /**
+	 Return an estimate of the memory used by this object, in
+	 bytes.
+      */
+      std::size_t memory_consumption () const;
+
+    private:
+
+      /**
+	 Return the offset of the values of the cell with this level
+	 and index.
+      */
+      std::size_t cell_offset (const int level,
+			       const int index) const;
+
+      /**
+	 Number of quadrature points per cell.
+      */
+      unsigned int q_points;
+
+      /**
+	 Revision of the degrees of freedom of the test space.
+      */
+      unsigned int revision;
+
+      /**
+	 Offsets of the values of each cell, by level and index.
+      */
+      std::vector<std::vector<std::size_t> > offsets;
+
+      /**
+	 Values, cell by cell.
+      */
+      std::vector<double> values;
+    };
+
+  /* -------------------------- inline functions ------------------------- */
+
+  template<int dim>
+  inline
+  std::size_t
+  QuadratureField<dim>::cell_offset (const int level,
+				     const int index) const
+  {
+    assert ((static_cast<unsigned int> (level)<offsets.size ()) &&
+	    (static_cast<unsigned int> (index)<offsets[level].size ()) &&
+	    (offsets[level][index]!=static_cast<std::size_t> (dealii::numbers::invalid_unsigned_int)) &&
+	    "This cell is not part of the field.");
+    return offsets[level][index];
+  }
+
+  template<int dim>
+  template<class CellIterator>
+  inline
+  double *
+  QuadratureField<dim>::cell_values (const CellIterator &cell)
+  {
+    return &values[0] + cell_offset (cell->level (), cell->index ());
+  }
+
+  template<int dim>
+  template<class CellIterator>
+  inline
+  const double *
+  QuadratureField<dim>::cell_values (const CellIterator &cell) const
+  {
+    return &values[0] + cell_offset (cell->level (), cell->index ());
+  }
+
+  template<int dim>
+  template<class CellIterator>
+  inline
+  void
+  QuadratureField<dim>::get_cell_values (const CellIterator  &cell,
+					 std::vector<double> &cell_values) const
+  {
+    assert ((cell_values.size ()==q_points) && "Incompatible vector sizes.");
+    const double *begin = &values[0] + cell_offset (cell->level (), cell->index ());
+    std::copy (begin, begin+q_points, cell_values.begin ());
+  }
+}
+
+#endif // __qdove_quadrature_field_h
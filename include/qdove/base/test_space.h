@@ -27,42 +27,108 @@
 
 #include <qdove/base/trial_space.h>
 
+#include <deal.II/base/mpi.h>
+#include <deal.II/base/quadrature_lib.h>
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/fe/fe_system.h>
 #include <deal.II/fe/fe_q.h>
+#include <deal.II/lac/petsc_vector.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <vector>
 
 namespace qdove
 {
   /**
      Implementation of a finite element test space.
+
+     If the program runs on more than one MPI process, the grid is
+     partitioned into one subdomain per process each time degrees
+     of freedom are distributed, and degrees of freedom are numbered
+     subdomain by subdomain. Process \f$p\f$ then owns the
+     contiguous range of degrees of freedom of subdomain \f$p\f$,
+     which is the layout of distributed PETSc objects. Every
+     process still holds the whole grid and all degrees of freedom
+     (as in deal.II's step-17); only objects built on this layout,
+     such as the matrix and vectors of Poisson's problem, are
+     distributed.
   */
   template<int dim>
     class TestSpace
     {
     public:
       /**
-	 Constructor 
+	 Constructor. The finite element is made of Lagrange
+	 polynomials of this degree.
       */
-      TestSpace ();
+      TestSpace (const unsigned int degree = 1);
 
       /**
-	 Constructor 
+	 Constructor. The finite element is made of Lagrange
+	 polynomials of this degree.
       */
-      TestSpace (qdove::TrialSpace<dim> &trial_space);
+      TestSpace (qdove::TrialSpace<dim> &trial_space,
+		 const unsigned int      degree = 1);
 
       /**
 	 Destructor 
       */
       ~TestSpace () 
 	{
+	  triangulation_listener.disconnect ();
 	  dof_handler.clear ();
 	}
 
+      /**
+	 Distribute degrees of freedom on the finite element space if
+	 the triangulation has changed since they were last
+	 distributed. Otherwise, this function does nothing.
+      */
+      void distribute_dofs ();
+
+      /**
+	 Return a counter that is increased each time degrees of
+	 freedom are distributed. Objects that depend on the layout of
+	 degrees of freedom can compare this value to find out if they
+	 need to be rebuilt.
+      */
+      unsigned int dof_revision () const;
+
       /**
 	 Return the number of degrees of freedom in this space 
       */
       unsigned int n_dofs ();
 
+      /**
+	 Return the number of degrees of freedom owned by this MPI
+	 process.
+      */
+      unsigned int n_locally_owned_dofs ();
+
+      /**
+	 Return the number of degrees of freedom owned by each MPI
+	 process.
+      */
+      const std::vector<dealii::types::global_dof_index> &n_locally_owned_dofs_per_process ();
+
+      /**
+	 Return the MPI communicator of this space.
+      */
+      MPI_Comm mpi_communicator () const;
+
+      /**
+	 Return the number of MPI processes, which is also the number
+	 of subdomains of the grid.
+      */
+      unsigned int n_mpi_processes () const;
+
+      /**
+	 Return the rank of this MPI process, which is also the
+	 subdomain id of the cells it works on.
+      */
+      unsigned int this_mpi_process () const;
+
       /**
 	 Return the number of degrees of freedom per cell 
       */
@@ -82,13 +148,40 @@ namespace qdove
 	 Return a reference to the finite element used by this space
       */
       dealii::FESystem<dim, dim> &fe ();
+
+      /**
+	 Return the polynomial degree of the finite element.
+      */
+      unsigned int degree () const;
+
+      /**
+	 Return the quadrature formula that the models integrate with
+	 on this space, which is the Gauss formula with one more point
+	 per direction than the polynomial degree. Fields given at
+	 quadrature points must be set up with this formula.
+      */
+      dealii::QGauss<dim> quadrature () const;
+
+      /**
+	 Compute the integral of each basis function, so that the
+	 integral of a function given at degrees of freedom is the
+	 dot product of its values with these weights.
+      */
+      void compute_nodal_weights (dealii::PETScWrappers::Vector &weights);
       
     private:
+
+      /**
+	 Mark the degrees of freedom as out of date. This is called
+	 whenever the triangulation changes.
+      */
+      void mark_dofs_stale ();
       
       /**
-	 The trial space associated with this test space.
+	 The trial space associated with this test space, or null if
+	 the test space was constructed without one.
       */
-      qdove::TrialSpace<dim> trial_space; 
+      qdove::TrialSpace<dim> *trial_space;
       
       /**
 	 Handler of degrees of freedom. 
@@ -99,6 +192,36 @@ namespace qdove
 	 Finite element. 
       */
       dealii::FESystem<dim, dim> finite_element;  
+
+      /**
+	 Flag indicating if the triangulation has changed since
+	 degrees of freedom were last distributed.
+      */
+      bool dofs_are_stale;
+
+      /**
+	 Number of times degrees of freedom have been distributed.
+      */
+      unsigned int n_distributions;
+
+      /**
+	 Connection to the signal the triangulation sends when it
+	 changes.
+      */
+      boost::signals2::connection triangulation_listener;
+
+      /**
+	 MPI communicator, the number of processes in it and the rank
+	 of this process.
+      */
+      MPI_Comm     communicator;
+      unsigned int n_processes;
+      unsigned int this_process;
+
+      /**
+	 Number of degrees of freedom owned by each process.
+      */
+      std::vector<dealii::types::global_dof_index> dofs_per_process;
     };
 }
 
@@ -28,6 +28,8 @@
 #include <deal.II/grid/tria.h>
 #include <deal.II/lac/constraint_matrix.h>
 
+#include <vector>
+
 namespace qdove
 {
   enum Constraints
@@ -63,10 +65,44 @@ namespace qdove
       dealii::Triangulation<dim>* triangulation ();
 
       /**
-	 Make a unit grid. 
+	 Make a unit grid: the unit hypercube as a single cell. The
+	 triangulation must be empty.
       */
       void make_unit_grid ();
 
+      /**
+	 Make a graded grid of a stack of layers with these
+	 thicknesses, starting at <code>origin</code>. The material
+	 changes across the interface between two layers over a
+	 distance given by the diffusion length of that interface
+	 (the rate of Fick::Solution), so there must be one diffusion
+	 length less than thicknesses.
+
+	 The grid has exactly <code>n_cells</code> cells. The
+	 fraction <code>interface_fraction</code> of them is shared
+	 equally between the interfaces and concentrated within a few
+	 diffusion lengths of them; the rest are spread evenly over
+	 the stack. Cell sizes are graded smoothly in between, as the
+	 vertices equidistribute this cell density. The triangulation
+	 must be empty.
+
+	 @note This is only implemented in one dimension.
+      */
+      void make_graded_grid (const std::vector<double> &thicknesses,
+			     const std::vector<double> &diffusion_lengths,
+			     const unsigned int         n_cells,
+			     const double               origin             = 0.,
+			     const double               interface_fraction = 0.5);
+
+      /**
+	 Partition the cells of the grid into this many subdomains of
+	 about equal size and small interfaces (using METIS), by
+	 setting the subdomain id of each cell. Every MPI process
+	 holds the whole grid, and process \f$p\f$ works on subdomain
+	 \f$p\f$.
+      */
+      void partition (const unsigned int n_partitions);
+
     private:
 
       /**
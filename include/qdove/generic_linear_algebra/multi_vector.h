@@ -0,0 +1,236 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_multi_vector_h
+#define __qdove_multi_vector_h
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/petsc_matrix_base.h>
+#include <deal.II/lac/petsc_vector.h>
+#include <deal.II/lac/petsc_parallel_vector.h>
+#include <deal.II/base/types.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace qdove
+{
+
+  /**
+     \brief A set of vectors of equal size stored contiguously in
+     one column-major array.
+
+     Operations on all columns at once are done as blocked
+     operations: the product with a sparse matrix is one
+     sparse-matrix times dense-matrix product (SpMM) instead of one
+     matrix-vector product per column, and inner products between
+     all columns of two multivectors are one BLAS-3 matrix product
+     (GEMM). This is what the eigenvectors of Schroedinger's problem
+     are needed for: normalisation, orthogonality checks, matrix
+     elements and the accumulation of densities.
+
+     The array is laid out as a sequential PETSc dense matrix, which
+     wraps it without copying. A multivector is therefore not
+     distributed; every process holds all of it. Distributed
+     vectors can be made views of the rows a process owns, and
+     gather_rows() then copies these rows to all processes.
+
+     @author Toby D. Young 2013.
+  */
+  class MultiVector
+  {
+  public:
+
+    /**
+       Constructor. Create an empty multivector.
+    */
+    MultiVector ();
+
+    /**
+       Constructor. Create a multivector with this many rows and
+       columns, set to zero.
+    */
+    MultiVector (const unsigned int n_rows,
+		 const unsigned int n_columns);
+
+    /**
+       Resize to this many rows and columns, and set to zero.
+    */
+    void reinit (const unsigned int n_rows,
+		 const unsigned int n_columns);
+
+    /**
+       Resize to the size of these vectors, and copy them into the
+       columns.
+    */
+    void reinit (const std::vector<dealii::PETScWrappers::Vector> &vectors);
+
+    /**
+       Number of rows, the size of each column.
+    */
+    unsigned int n_rows () const;
+
+    /**
+       Number of columns.
+    */
+    unsigned int n_columns () const;
+
+    /**
+       Access element (i,j).
+    */
+    double &operator () (const unsigned int i,
+			 const unsigned int j);
+
+    /**
+       Read element (i,j).
+    */
+    double operator () (const unsigned int i,
+			const unsigned int j) const;
+
+    /**
+       Return a pointer to the n_rows() contiguous elements of column
+       j.
+    */
+    double *column (const unsigned int j);
+
+    /**
+       Return a pointer to the n_rows() contiguous elements of column
+       j.
+    */
+    const double *column (const unsigned int j) const;
+
+    /**
+       Copy column j into a vector.
+    */
+    void extract_column (const unsigned int             j,
+			 dealii::PETScWrappers::Vector &vector) const;
+
+    /**
+       Make a vector a view of column j. The PETSc vector it holds is
+       replaced by one created over the elements of the column, so
+       it owns no elements of its own and writing to it writes to the
+       column. The view is invalid after the next reinit() of this
+       multivector.
+    */
+    void view_column (const unsigned int             j,
+		      dealii::PETScWrappers::Vector &vector);
+
+    /**
+       Make a distributed vector a view of column j. On each process
+       of the communicator, the vector is created over the
+       n_local_rows elements of the column starting at first_row,
+       which are the rows that process owns. The view is invalid
+       after the next reinit() of this multivector.
+    */
+    void view_column (const unsigned int                  j,
+		      const MPI_Comm                     &communicator,
+		      const unsigned int                  first_row,
+		      const unsigned int                  n_local_rows,
+		      dealii::PETScWrappers::MPI::Vector &vector);
+
+    /**
+       Copy the rows each process of the communicator owns to all
+       other processes, in all columns. The rows of process p are
+       the n_rows_per_process[p] rows following those of process
+       p-1, as for the views of view_column(). This is how
+       distributed views written by a parallel solver are made
+       available in full on every process.
+    */
+    void gather_rows (const MPI_Comm                                     &communicator,
+		      const std::vector<dealii::types::global_dof_index> &n_rows_per_process);
+
+    /**
+       Multiply column j by factors[j], for all columns.
+    */
+    void scale_columns (const std::vector<double> &factors);
+
+    /**
+       Compute dst=AX, where X is this multivector, with one sparse
+       times dense matrix product.
+    */
+    void mmult (MultiVector                             &dst,
+		const dealii::PETScWrappers::MatrixBase &matrix) const;
+
+    /**
+       Compute dst=X<sup>T</sup>Y of this multivector X and another
+       one, Y, with one BLAS-3 product. With Y=MX this is the matrix
+       of inner products of all columns of X with respect to M.
+    */
+    void Tmmult (dealii::FullMatrix<double> &dst,
+		 const MultiVector          &other) const;
+
+    /**
+       Compute the inner products of each column of this multivector
+       with the same column of another one, that is the diagonal of
+       X<sup>T</sup>Y, without the off-diagonal elements.
+    */
+    void column_dots (std::vector<double> &dots,
+		      const MultiVector   &other) const;
+
+    /**
+       Add \f$\sum_jw_jX_{ij}^2\f$ to dst[i], for all rows i, where j
+       runs over the n columns starting at first and w<sub>j</sub> is
+       weights[j-first]. This is the density of these states
+       weighted by w. Taking the columns a few at a time lets a
+       caller keep the weights in a small buffer of its own.
+    */
+    void add_weighted_squares (const unsigned int  first,
+			       const unsigned int  n,
+			       const double       *weights,
+			       double             *dst) const;
+
+    /**
+       Compute \f$\sum_iw_iX_{ij}^2\f$ of each column j, the squared
+       norm of each column weighted by w.
+    */
+    void weighted_column_norms_square (const double        *weights,
+				       std::vector<double> &norms) const;
+
+    /**
+       Return an estimate of the memory used by this object, in
+       bytes.
+    */
+    std::size_t memory_consumption () const;
+
+  private:
+
+    /**
+       Number of rows.
+    */
+    unsigned int rows;
+
+    /**
+       Number of columns.
+    */
+    unsigned int columns;
+
+    /**
+       Elements, column by column.
+    */
+    std::vector<double> values;
+  };
+
+} // namespace qdove
+
+#endif // __qdove_multi_vector_h
@@ -0,0 +1,99 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_precondition_gamg_h
+#define __qdove_precondition_gamg_h
+
+#include <deal.II/lac/petsc_matrix_base.h>
+#include <deal.II/lac/petsc_precondition.h>
+
+namespace qdove
+{
+  /**
+     A wrapper around PETSc's native algebraic multigrid
+     preconditioner, GAMG. Unlike BoomerAMG, this does not need PETSc
+     to be configured with hypre. The number of iterations of a
+     Krylov solver preconditioned with it is nearly independent of the
+     number of degrees of freedom for elliptic problems such as
+     Poisson's problem.
+
+     @author Toby D. Young 2013.
+  */
+  class PreconditionGAMG
+    :
+    public dealii::PETScWrappers::PreconditionerBase
+  {
+  public:
+
+    /**
+       Parameters of the multigrid hierarchy.
+    */
+    struct AdditionalData
+    {
+      /**
+	 Constructor. By default, use smoothed aggregation on a
+	 symmetric matrix graph.
+      */
+      AdditionalData (const bool         symmetric_operator = true,
+		      const unsigned int n_smoothing_steps  = 1);
+
+      /**
+	 Flag indicating if the matrix is symmetric.
+      */
+      bool symmetric_operator;
+
+      /**
+	 Number of smoothing steps of the prolongator; zero gives
+	 plain aggregation.
+      */
+      unsigned int n_smoothing_steps;
+    };
+
+    /**
+       Empty constructor. Call initialize() before use.
+    */
+    PreconditionGAMG ();
+
+    /**
+       Constructor. Set up the preconditioner for this matrix.
+    */
+    PreconditionGAMG (const dealii::PETScWrappers::MatrixBase &matrix,
+		      const AdditionalData                    &additional_data = AdditionalData ());
+
+    /**
+       Set up the preconditioner for this matrix.
+    */
+    void initialize (const dealii::PETScWrappers::MatrixBase &matrix,
+		     const AdditionalData                    &additional_data = AdditionalData ());
+
+  private:
+
+    /**
+       Parameters of the multigrid hierarchy.
+    */
+    AdditionalData additional_data;
+  };
+}
+
+#endif // __qdove_precondition_gamg_h
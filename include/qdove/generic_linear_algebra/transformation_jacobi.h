@@ -0,0 +1,92 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_transformation_jacobi_h
+#define __qdove_transformation_jacobi_h
+
+#include <deal.II/lac/slepc_spectral_transformation.h>
+#include <deal.II/lac/vector.h>
+
+#include <petscpc.h>
+
+namespace qdove
+{
+  /**
+     The preconditioning spectral transformation of Davidson-type
+     eigenspectrum solvers with a diagonal (Jacobi) preconditioner
+     that is given as a vector. The correction equation is then
+     solved without access to the entries of the matrices, so this
+     can be used with matrix-free operators. The inverse diagonal
+     should be that of \f$A-\sigma B\f$, where \f$\sigma\f$ is the
+     shift, and must outlive the solver. Only sequential vectors are
+     supported.
+
+     @author Toby D. Young 2013.
+  */
+  class TransformationJacobi
+    :
+    public dealii::SLEPcWrappers::TransformationBase
+  {
+  public:
+
+    /**
+       Constructor. Precondition with this inverse diagonal around
+       this shift.
+    */
+    TransformationJacobi (const dealii::Vector<double> &inverse_diagonal,
+			  const double                  shift);
+
+  protected:
+
+    /**
+       Set the preconditioning transformation and a shell
+       preconditioner that applies the inverse diagonal.
+    */
+    virtual
+      void set_transformation_type (ST &st) const;
+
+  private:
+
+    /**
+       Apply the inverse diagonal: dst = D^{-1}*src. This is the
+       application routine of the shell preconditioner.
+    */
+    static
+      PetscErrorCode apply (PC  pc,
+			    Vec src,
+			    Vec dst);
+
+    /**
+       Pointer to the inverse diagonal.
+    */
+    const dealii::Vector<double> *inverse_diagonal;
+
+    /**
+       Shift of the preconditioned operator.
+    */
+    const double shift;
+  };
+}
+
+#endif // __qdove_transformation_jacobi_h
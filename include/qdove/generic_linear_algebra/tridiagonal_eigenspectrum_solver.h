@@ -0,0 +1,132 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_tridiagonal_eigenspectrum_solver_h
+#define __qdove_tridiagonal_eigenspectrum_solver_h
+
+#include <vector>
+
+namespace qdove
+{
+  /**
+     A solver for the lowest eigenpairs of a generalised symmetric
+     tridiagonal eigenspectrum system \f$(A-B\lambda)x=0\f$, where
+     \f$B\f$ is positive definite. This is the structure of the
+     Schroedinger problem discretised with linear elements in one
+     dimension.
+
+     Eigenvalues are found by bisection on Sturm counts: by Sylvester's
+     law of inertia, the number of negative pivots of the
+     \f$LDL^T\f$ factorisation of \f$A-\sigma B\f$ is the number of
+     eigenvalues below \f$\sigma\f$. Eigenvectors are then found by
+     inverse iteration. Both steps cost \f$O(N)\f$ per eigenpair, so
+     computing the lowest \f$k\f$ eigenpairs costs \f$O(Nk)\f$.
+
+     @author Toby D. Young 2013.
+  */
+  class TridiagonalEigenspectrumSolver
+  {
+  public:
+
+    /**
+       Constructor. Eigenvalues are computed to within this relative
+       tolerance.
+    */
+    TridiagonalEigenspectrumSolver (const double tolerance = 1e-14);
+
+    /**
+       Destructor
+    */
+    ~TridiagonalEigenspectrumSolver () {};
+
+    /**
+       Solve for the lowest <code>n_eigenpairs</code> eigenpairs.  The
+       matrices are given by their diagonals and their first
+       off-diagonals, which have one entry less. Eigenvalues are
+       returned in ascending order and eigenvectors are normalised
+       such that \f$x^TBx=1\f$.
+    */
+    void solve (const std::vector<double>           &a_diagonal,
+		const std::vector<double>           &a_off_diagonal,
+		const std::vector<double>           &b_diagonal,
+		const std::vector<double>           &b_off_diagonal,
+		std::vector<double>                 &values,
+		std::vector<std::vector<double> >   &vectors,
+		const unsigned int                   n_eigenpairs);
+
+    /**
+       Return the number of bisection steps taken by the last solve.
+    */
+    unsigned int last_step () const;
+
+  private:
+
+    /**
+       Return the number of eigenvalues less than <code>sigma</code>.
+    */
+    unsigned int count_eigenvalues_below (const double sigma) const;
+
+    /**
+       Find the eigenvector to the eigenvalue <code>lambda</code> by
+       inverse iteration, starting from and returning
+       <code>vector</code>.
+    */
+    void inverse_iteration (const double         lambda,
+			    std::vector<double> &vector);
+
+    /**
+       Apply \f$B\f$ to a vector.
+    */
+    void vmult_b (std::vector<double>       &dst,
+		  const std::vector<double> &src) const;
+
+    /**
+       Relative tolerance of the eigenvalues.
+    */
+    const double tolerance;
+
+    /**
+       Pointers to the matrix entries of the current solve.
+    */
+    const std::vector<double> *a_diagonal;
+    const std::vector<double> *a_off_diagonal;
+    const std::vector<double> *b_diagonal;
+    const std::vector<double> *b_off_diagonal;
+
+    /**
+       Number of bisection steps taken by the last solve.
+    */
+    unsigned int n_steps;
+
+    /**
+       Workspace of the tridiagonal factorisation with partial
+       pivoting used in inverse iteration: the lower band, the
+       diagonal, the two upper bands and the row interchanges.
+    */
+    std::vector<double> lower, diagonal, upper, upper_2;
+    std::vector<bool>   pivoted;
+  };
+}
+
+#endif // __qdove_tridiagonal_eigenspectrum_solver_h
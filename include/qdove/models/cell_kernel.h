@@ -0,0 +1,430 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_cell_kernel_h
+#define __qdove_cell_kernel_h
+
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/quadrature.h>
+#include <deal.II/base/tensor.h>
+#include <deal.II/base/utilities.h>
+#include <deal.II/fe/fe.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace qdove
+{
+
+  /**
+     Return whether this cell is affine, that is the image of the
+     reference cell under an affine map: a parallelogram in two
+     dimensions or a parallelepiped in three. Lines always are. Only
+     affine cells can be integrated with the cell kernels.
+  */
+  template <int dim, class CellIterator>
+    bool cell_is_affine (const CellIterator &cell)
+    {
+      if (dim==1)
+	return true;
+
+      // Each vertex must lie where the edges from the first vertex
+      // put it.
+      for (unsigned int v=1; v<dealii::GeometryInfo<dim>::vertices_per_cell; ++v)
+	{
+	  dealii::Point<dim> vertex = cell->vertex (0);
+	  for (unsigned int d=0; d<dim; ++d)
+	    if (v & (1<<d))
+	      vertex += cell->vertex (1<<d) - cell->vertex (0);
+	  if (vertex.distance (cell->vertex (v)) > 1e-12*cell->diameter ())
+	    return false;
+	}
+
+      return true;
+    }
+
+
+  /**
+     \brief Shape function values, gradients and quadrature weights
+     on the reference cell.
+
+     These are the same on every cell, so they are tabulated once per
+     assembly and shared by the cell kernels, which only scale them
+     with the Jacobian of each cell. Values are stored by quadrature
+     point, gradients by quadrature point and direction.
+
+     @author Toby D. Young 2013.
+  */
+  template <int dim>
+    class CellKernelData
+    {
+    public:
+
+      /**
+	 Tabulate the shape functions of this finite element at the
+	 points of this quadrature formula on the reference cell.
+      */
+      CellKernelData (const dealii::FiniteElement<dim> &fe,
+		      const dealii::Quadrature<dim>     &quadrature)
+	:
+	dofs_per_cell (fe.dofs_per_cell),
+	n_q_points (quadrature.size ()),
+	values (n_q_points*dofs_per_cell),
+	gradients (n_q_points*dim*dofs_per_cell),
+	weights (quadrature.get_weights ())
+      {
+	for (unsigned int q=0; q<n_q_points; ++q)
+	  for (unsigned int i=0; i<dofs_per_cell; ++i)
+	    {
+	      values[q*dofs_per_cell+i] = fe.shape_value (i, quadrature.point (q));
+	      const dealii::Tensor<1,dim> gradient = fe.shape_grad (i, quadrature.point (q));
+	      for (unsigned int d=0; d<dim; ++d)
+		gradients[(q*dim+d)*dofs_per_cell+i] = gradient[d];
+	    }
+      }
+
+      const unsigned int  dofs_per_cell;
+      const unsigned int  n_q_points;
+      std::vector<double> values;
+      std::vector<double> gradients;
+      std::vector<double> weights;
+    };
+
+
+  /**
+     \brief Cell assembly kernels for a fixed element degree and
+     quadrature size.
+
+     The number of shape functions and quadrature points are compile
+     time constants, so that all loops have constant trip counts that
+     the compiler can unroll and vectorise. A kernel reads the shape
+     functions on the reference cell from a CellKernelData object
+     once, and is then set up on each cell from its vertices alone:
+     cells must be affine (see cell_is_affine()), so that values are
+     those on the reference cell, integration weights are scaled by
+     the determinant of the Jacobian, and gradients are mapped by
+     its inverse. It then
+     computes local matrices and vectors from coefficients given at
+     quadrature points (a null coefficient means unity).
+
+     The local arrays live on the stack and are sized for small
+     elements: up to degree four in one and two dimensions, and up to
+     degree two in three. The models fall back to looping over
+     FEValues for larger elements and for cells that are not
+     affine.
+
+     @author Toby D. Young 2013.
+  */
+  template <int dim, int fe_degree, int n_q_points_1d>
+    class CellKernel
+    {
+    public:
+
+      /**
+	 Number of shape functions on a cell.
+      */
+      static const unsigned int dofs_per_cell = dealii::Utilities::fixed_int_power<fe_degree+1,dim>::value;
+
+      /**
+	 Number of quadrature points on a cell.
+      */
+      static const unsigned int n_q_points = dealii::Utilities::fixed_int_power<n_q_points_1d,dim>::value;
+
+      /**
+	 Constructor. Use the shape functions tabulated in this
+	 object, which must outlive the kernel.
+      */
+      CellKernel (const CellKernelData<dim> &data)
+	:
+	values (&data.values[0]),
+	gradients (&data.gradients[0]),
+	weights (&data.weights[0])
+      {
+	assert ((data.dofs_per_cell==dofs_per_cell) &&
+		(data.n_q_points==n_q_points) &&
+		"The kernel does not match this finite element or quadrature.");
+      }
+
+      /**
+	 Compute the Jacobian of this affine cell from its vertices,
+	 and with it the integration weights and the metric that maps
+	 products of reference gradients to the cell.
+      */
+      template <class CellIterator>
+      void reinit (const CellIterator &cell)
+      {
+	// The columns of the Jacobian are the edges from the first
+	// vertex in each direction.
+	dealii::Tensor<2,dim> jacobian;
+	for (unsigned int d=0; d<dim; ++d)
+	  for (unsigned int e=0; e<dim; ++e)
+	    jacobian[e][d] = cell->vertex (1<<d)[e] - cell->vertex (0)[e];
+
+	assert (cell_is_affine<dim> (cell) && "The cell kernels only apply to affine cells.");
+
+	const double                determinant = std::fabs (dealii::determinant (jacobian));
+	const dealii::Tensor<2,dim> inverse     = dealii::invert (jacobian);
+
+	for (unsigned int d=0; d<dim; ++d)
+	  for (unsigned int e=0; e<dim; ++e)
+	    {
+	      metric[d][e] = 0.;
+	      for (unsigned int k=0; k<dim; ++k)
+		metric[d][e] += inverse[d][k] * inverse[e][k];
+	    }
+
+	for (unsigned int q=0; q<n_q_points; ++q)
+	  JxW[q] = weights[q] * determinant;
+      }
+
+      /**
+	 Compute the stiffness matrix
+	 \f$A_{ij}=\int c\nabla\phi_i\cdot\nabla\phi_j\f$, or add it
+	 to <code>matrix</code>.
+      */
+      void stiffness (const double               *coefficient,
+		      dealii::FullMatrix<double> &matrix,
+		      const bool                  add = false) const
+      {
+	double cell_weights[n_q_points];
+	compute_weights (coefficient, cell_weights);
+
+	// Reference gradients multiplied with the metric and the
+	// weights, so that the products below are those of gradients
+	// on the cell.
+	double scaled[n_q_points][dim][dofs_per_cell];
+	for (unsigned int q=0; q<n_q_points; ++q)
+	  for (unsigned int d=0; d<dim; ++d)
+	    for (unsigned int i=0; i<dofs_per_cell; ++i)
+	      {
+		double sum = 0.;
+		for (unsigned int e=0; e<dim; ++e)
+		  sum += metric[d][e] * gradients[(q*dim+e)*dofs_per_cell+i];
+		scaled[q][d][i] = cell_weights[q] * sum;
+	      }
+
+	double local[dofs_per_cell][dofs_per_cell];
+	for (unsigned int i=0; i<dofs_per_cell; ++i)
+	  for (unsigned int j=i; j<dofs_per_cell; ++j)
+	    {
+	      double sum = 0.;
+	      for (unsigned int q=0; q<n_q_points; ++q)
+		for (unsigned int d=0; d<dim; ++d)
+		  sum += scaled[q][d][i] * gradients[(q*dim+d)*dofs_per_cell+j];
+	      local[i][j] = local[j][i] = sum;
+	    }
+
+	write (local, matrix, add);
+      }
+
+      /**
+	 Compute the mass matrix \f$M_{ij}=\int c\phi_i\phi_j\f$, or
+	 add it to <code>matrix</code>.
+      */
+      void mass (const double               *coefficient,
+		 dealii::FullMatrix<double> &matrix,
+		 const bool                  add = false) const
+      {
+	double cell_weights[n_q_points];
+	compute_weights (coefficient, cell_weights);
+
+	double local[dofs_per_cell][dofs_per_cell];
+	for (unsigned int i=0; i<dofs_per_cell; ++i)
+	  for (unsigned int j=i; j<dofs_per_cell; ++j)
+	    {
+	      double sum = 0.;
+	      for (unsigned int q=0; q<n_q_points; ++q)
+		sum += cell_weights[q] * values[q*dofs_per_cell+i] * values[q*dofs_per_cell+j];
+	      local[i][j] = local[j][i] = sum;
+	    }
+
+	write (local, matrix, add);
+      }
+
+      /**
+	 Compute the load vector \f$F_i=\int f\phi_i\f$.
+      */
+      void rhs (const double           *function,
+		dealii::Vector<double> &vector) const
+      {
+	double cell_weights[n_q_points];
+	compute_weights (function, cell_weights);
+
+	for (unsigned int i=0; i<dofs_per_cell; ++i)
+	  {
+	    double sum = 0.;
+	    for (unsigned int q=0; q<n_q_points; ++q)
+	      sum += cell_weights[q] * values[q*dofs_per_cell+i];
+	    vector (i) = sum;
+	  }
+      }
+
+    private:
+
+      /**
+	 Multiply the integration weights with the coefficient.
+      */
+      void compute_weights (const double *coefficient,
+			    double        (&cell_weights)[n_q_points]) const
+      {
+	if (coefficient)
+	  for (unsigned int q=0; q<n_q_points; ++q)
+	    cell_weights[q] = coefficient[q] * JxW[q];
+	else
+	  for (unsigned int q=0; q<n_q_points; ++q)
+	    cell_weights[q] = JxW[q];
+      }
+
+      /**
+	 Copy or add a local matrix to a FullMatrix.
+      */
+      static void write (const double               (&local)[dofs_per_cell][dofs_per_cell],
+			 dealii::FullMatrix<double> &matrix,
+			 const bool                  add)
+      {
+	if (add)
+	  for (unsigned int i=0; i<dofs_per_cell; ++i)
+	    for (unsigned int j=0; j<dofs_per_cell; ++j)
+	      matrix (i, j) += local[i][j];
+	else
+	  for (unsigned int i=0; i<dofs_per_cell; ++i)
+	    for (unsigned int j=0; j<dofs_per_cell; ++j)
+	      matrix (i, j) = local[i][j];
+      }
+
+      /**
+	 Shape function values and gradients, and quadrature
+	 weights, on the reference cell.
+      */
+      const double *values;
+      const double *gradients;
+      const double *weights;
+
+      /**
+	 Product of the inverse Jacobian of the current cell with its
+	 transpose.
+      */
+      double metric[dim][dim];
+
+      /**
+	 Integration weights on the current cell.
+      */
+      double JxW[n_q_points];
+    };
+
+
+  /**
+     \brief Closed-form cell kernel for linear elements in one
+     dimension with the two-point Gauss formula.
+
+     On a cell of length \f$h\f$ the shape functions take the values
+     \f$g=(1+1/\sqrt{3})/2\f$ and \f$1-g\f$ at the two quadrature
+     points, and have gradients \f$\mp1/h\f$. The local matrices are
+     then written down directly in terms of \f$h\f$ and the two
+     coefficient values, without any loop over quadrature points.
+
+     @author Toby D. Young 2013.
+  */
+  template <>
+    class CellKernel<1,1,2>
+    {
+    public:
+
+      static const unsigned int dofs_per_cell = 2;
+      static const unsigned int n_q_points    = 2;
+
+      CellKernel (const CellKernelData<1> &data)
+	:
+	h (0.)
+      {
+	assert ((data.dofs_per_cell==dofs_per_cell) &&
+		(data.n_q_points==n_q_points) &&
+		"The kernel does not match this finite element or quadrature.");
+	(void) data;
+      }
+
+      /**
+	 Read the length of the current cell from its vertices.
+      */
+      template <class CellIterator>
+      void reinit (const CellIterator &cell)
+      {
+	h = std::fabs (cell->vertex (1)[0] - cell->vertex (0)[0]);
+      }
+
+      void stiffness (const double               *coefficient,
+		      dealii::FullMatrix<double> &matrix,
+		      const bool                  add = false) const
+      {
+	const double a = (coefficient ? .5*(coefficient[0]+coefficient[1]) : 1.) / h;
+	if (!add)
+	  matrix = 0;
+	matrix (0, 0) += a;  matrix (0, 1) -= a;
+	matrix (1, 0) -= a;  matrix (1, 1) += a;
+      }
+
+      void mass (const double               *coefficient,
+		 dealii::FullMatrix<double> &matrix,
+		 const bool                  add = false) const
+      {
+	// g^2, (1-g)^2 and g(1-g) at the Gauss points.
+	static const double gg = 1./3. + 1./(2.*std::sqrt (3.));
+	static const double hh = 1./3. - 1./(2.*std::sqrt (3.));
+	static const double gh = 1./6.;
+
+	const double c0 = (coefficient ? coefficient[0] : 1.) * .5 * h;
+	const double c1 = (coefficient ? coefficient[1] : 1.) * .5 * h;
+	if (!add)
+	  matrix = 0;
+	matrix (0, 0) += c0*gg + c1*hh;
+	matrix (0, 1) += (c0+c1)*gh;
+	matrix (1, 0) += (c0+c1)*gh;
+	matrix (1, 1) += c0*hh + c1*gg;
+      }
+
+      void rhs (const double           *function,
+		dealii::Vector<double> &vector) const
+      {
+	static const double g = .5 + .5/std::sqrt (3.);
+
+	const double f0 = (function ? function[0] : 1.) * .5 * h;
+	const double f1 = (function ? function[1] : 1.) * .5 * h;
+	vector (0) = f0*g + f1*(1.-g);
+	vector (1) = f0*(1.-g) + f1*g;
+      }
+
+    private:
+
+      /**
+	 Length of the current cell.
+      */
+      double h;
+    };
+
+} // namespace qdove
+
+#endif // __qdove_cell_kernel_h
@@ -93,7 +93,10 @@ namespace qdove
 
        This is an analytical solution to Fick's Laws, where the
        initial condition is either a rectangle function \f$\Omega \in\f$
-       span\f$[-x:x]\f$, or a single transition at \f$x\f$.
+       span\f$[-x:x]\f$, or a single transition at \f$x\f$. In more
+       than one dimension the rectangle function is a box
+       \f$[-x:x]^d\f$, and the single transition is a plane normal
+       to the first coordinate axis.
 
        @author Toby D. Young and Karl Rupp 2013
     */
@@ -0,0 +1,326 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_hamiltonian_operator_h
+#define __qdove_hamiltonian_operator_h
+
+#include <qdove/base/quadrature_field.h>
+
+#include <deal.II/base/table.h>
+#include <deal.II/base/vectorization.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/lac/constraint_matrix.h>
+#include <deal.II/lac/vector.h>
+#include <deal.II/lac/petsc_vector_base.h>
+#include <deal.II/lac/petsc_matrix_free.h>
+#include <deal.II/matrix_free/matrix_free.h>
+
+namespace qdove
+{
+
+  namespace Schroedinger
+  {
+
+    /**
+       \brief A matrix-free representation of the overlap matrix of
+       Schroedinger's problem.
+
+       The consistent overlap (mass) matrix is applied cell by cell
+       with sum factorisation on the reference cell. Rows of
+       constrained degrees of freedom are replaced by the identity.
+       The operator shares the matrix-free data of the Hamiltonian
+       that owns it.
+
+       @author Toby D. Young 2013.
+    */
+    template <int dim, int fe_degree>
+      class OverlapOperator
+      :
+      public dealii::PETScWrappers::MatrixFree
+      {
+      public:
+
+	/**
+	   Constructor
+	*/
+	OverlapOperator ();
+
+	/**
+	   Setup the operator on this matrix-free data, and compute
+	   its diagonal.
+	*/
+	void reinit (const dealii::MatrixFree<dim,double> &matrix_free,
+		     const unsigned int                    n_dofs);
+
+	/**
+	   Matrix-vector multiplication: dst = M*src.
+	*/
+	virtual
+	  void vmult (dealii::PETScWrappers::VectorBase       &dst,
+		      const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Transposed matrix-vector multiplication. The operator is
+	   symmetric, so this is the same as vmult().
+	*/
+	virtual
+	  void Tvmult (dealii::PETScWrappers::VectorBase       &dst,
+		       const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Adding matrix-vector multiplication: dst += M*src.
+	*/
+	virtual
+	  void vmult_add (dealii::PETScWrappers::VectorBase       &dst,
+			  const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Adding transposed matrix-vector multiplication.
+	*/
+	virtual
+	  void Tvmult_add (dealii::PETScWrappers::VectorBase       &dst,
+			   const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Return the diagonal of the overlap matrix. This is zero for
+	   constrained degrees of freedom.
+	*/
+	const dealii::Vector<double> &diagonal () const;
+
+	/**
+	   Return an estimate of the memory used by this object, in
+	   bytes, not counting the shared matrix-free data.
+	*/
+	std::size_t memory_consumption () const;
+
+      private:
+
+	/**
+	   Apply the overlap matrix on a range of cells.
+	*/
+	void local_apply (const dealii::MatrixFree<dim,double>               &data,
+			  dealii::Vector<double>                             &dst,
+			  const dealii::Vector<double>                       &src,
+			  const std::pair<unsigned int,unsigned int>         &cell_range) const;
+
+	/**
+	   Pointer to the matrix-free data of the Hamiltonian.
+	*/
+	const dealii::MatrixFree<dim,double> *matrix_free;
+
+	/**
+	   Diagonal of the overlap matrix.
+	*/
+	dealii::Vector<double> overlap_diagonal;
+
+	/**
+	   Work vectors of the operator application.
+	*/
+	mutable dealii::Vector<double> src_values;
+	mutable dealii::Vector<double> dst_values;
+      };
+
+    /**
+       \brief A matrix-free representation of the Hamiltonian of
+       Schroedinger's problem.
+
+       The operator is applied cell by cell with sum factorisation on
+       the reference cell, from kinetic and potential energy
+       coefficients cached at quadrature points. No matrix is
+       stored. Together with the consistent overlap matrix, given by
+       overlap_operator(), it forms the same generalised
+       eigenspectrum problem as the assembled matrices. Since neither
+       can be factorised, that problem is solved with a
+       preconditioned (Davidson-type) solver, for which
+       compute_inverse_diagonal() provides a Jacobi preconditioner.
+
+       Rows of constrained degrees of freedom are replaced by a
+       multiple of the identity in the Hamiltonian, and by the
+       identity in the overlap matrix, so that their spurious
+       eigenvalues lie above the spectrum of interest.
+
+       @author Toby D. Young 2013.
+    */
+    template <int dim, int fe_degree>
+      class HamiltonianOperator
+      :
+      public dealii::PETScWrappers::MatrixFree
+      {
+      public:
+
+	/**
+	   Constructor
+	*/
+	HamiltonianOperator ();
+
+	/**
+	   Setup the operator on this degree of freedom handler with
+	   these constraints.
+	*/
+	void reinit (const dealii::DoFHandler<dim>  &dof_handler,
+		     const dealii::ConstraintMatrix &constraints);
+
+	/**
+	   Set the kinetic energy function, given at degrees of
+	   freedom, and cache its values at quadrature points.
+	*/
+	void set_kinetic_energy (const dealii::Vector<double> &ke_function);
+
+	/**
+	   Set the potential energy function, given at degrees of
+	   freedom, and cache its values at quadrature points.
+	*/
+	void set_potential_energy (const dealii::Vector<double> &pe_function);
+
+	/**
+	   Set the kinetic energy function from its values at
+	   quadrature points.
+	*/
+	void set_kinetic_energy (const qdove::QuadratureField<dim> &ke_field);
+
+	/**
+	   Set the potential energy function from its values at
+	   quadrature points.
+	*/
+	void set_potential_energy (const qdove::QuadratureField<dim> &pe_field);
+
+	/**
+	   Matrix-vector multiplication: dst = A*src.
+	*/
+	virtual
+	  void vmult (dealii::PETScWrappers::VectorBase       &dst,
+		      const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Transposed matrix-vector multiplication. The operator is
+	   symmetric, so this is the same as vmult().
+	*/
+	virtual
+	  void Tvmult (dealii::PETScWrappers::VectorBase       &dst,
+		       const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Adding matrix-vector multiplication: dst += A*src.
+	*/
+	virtual
+	  void vmult_add (dealii::PETScWrappers::VectorBase       &dst,
+			  const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Adding transposed matrix-vector multiplication.
+	*/
+	virtual
+	  void Tvmult_add (dealii::PETScWrappers::VectorBase       &dst,
+			   const dealii::PETScWrappers::VectorBase &src) const;
+
+	/**
+	   Return the consistent overlap matrix of the same
+	   discretisation.
+	*/
+	const OverlapOperator<dim,fe_degree> &overlap_operator () const;
+
+	/**
+	   Compute the inverse of the diagonal of \f$H-\sigma M\f$,
+	   where \f$\sigma\f$ is this shift, as a Jacobi preconditioner
+	   of the generalised eigenspectrum problem.
+	*/
+	void compute_inverse_diagonal (const double            shift,
+				       dealii::Vector<double> &inverse_diagonal) const;
+
+	/**
+	   Return an estimate of the memory used by this object, in
+	   bytes.
+	*/
+	std::size_t memory_consumption () const;
+
+      private:
+
+	/**
+	   Apply the Hamiltonian on a range of cells.
+	*/
+	void local_apply (const dealii::MatrixFree<dim,double>               &data,
+			  dealii::Vector<double>                             &dst,
+			  const dealii::Vector<double>                       &src,
+			  const std::pair<unsigned int,unsigned int>         &cell_range) const;
+
+	/**
+	   Evaluate a function given at degrees of freedom at all
+	   quadrature points.
+	*/
+	void evaluate_coefficient (const dealii::Vector<double>                          &function,
+				   dealii::Table<2, dealii::VectorizedArray<double> >   &coefficient) const;
+
+	/**
+	   Copy a function given at quadrature points into the layout
+	   of the matrix-free cell batches.
+	*/
+	void evaluate_coefficient (const qdove::QuadratureField<dim>                     &field,
+				   dealii::Table<2, dealii::VectorizedArray<double> >   &coefficient) const;
+
+	/**
+	   Compute the diagonal of the Hamiltonian, and from it the
+	   value that replaces the diagonal of constrained rows.
+	*/
+	void compute_diagonal ();
+
+	/**
+	   Matrix-free data: degree of freedom indices, constraints
+	   and mapping data on all cells.
+	*/
+	dealii::MatrixFree<dim,double> matrix_free;
+
+	/**
+	   Kinetic and potential energy functions at quadrature points.
+	*/
+	dealii::Table<2, dealii::VectorizedArray<double> > ke_coefficient;
+	dealii::Table<2, dealii::VectorizedArray<double> > pe_coefficient;
+
+	/**
+	   The consistent overlap matrix.
+	*/
+	OverlapOperator<dim,fe_degree> overlap;
+
+	/**
+	   Diagonal of the Hamiltonian. This is zero for constrained
+	   degrees of freedom.
+	*/
+	dealii::Vector<double> hamiltonian_diagonal;
+
+	/**
+	   Diagonal of constrained rows.
+	*/
+	double constrained_diagonal;
+
+	/**
+	   Work vectors of the operator application.
+	*/
+	mutable dealii::Vector<double> src_values;
+	mutable dealii::Vector<double> dst_values;
+      };
+
+  } // namespace Schroedinger
+
+} // namespace qdove
+
+#endif // __qdove_hamiltonian_operator_h
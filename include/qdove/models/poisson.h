@@ -27,14 +27,21 @@
 
 #include <qdove/base/trial_space.h>
 #include <qdove/base/test_space.h>
+#include <qdove/base/quadrature_field.h>
+#include <qdove/models/cell_kernel.h>
 
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
 #include <deal.II/lac/constraint_matrix.h>
 #include <deal.II/lac/petsc_vector.h>
-#include <deal.II/lac/petsc_sparse_matrix.h>
+#include <deal.II/lac/petsc_parallel_vector.h>
+#include <deal.II/lac/petsc_parallel_sparse_matrix.h>
 
 #include <deal.II/lac/solver_control.h>
 #include <deal.II/lac/petsc_solver.h>
 #include <deal.II/lac/petsc_precondition.h>
+#include <deal.II/base/std_cxx1x/shared_ptr.h>
 
 namespace qdove
 {
@@ -42,8 +49,32 @@ namespace qdove
   namespace Poisson
   {
 
+    /**
+       A list of preconditioners that can be used with the conjugate
+       gradient solver of Poisson's problem.
+
+       <code>BlockJacobi</code> is cheap to set up, but the number of
+       iterations grows with the number of degrees of freedom.
+       <code>AlgebraicMultigrid</code> makes use of PETSc's GAMG and
+       <code>BoomerAMG</code> of hypre's BoomerAMG (which PETSc must
+       be configured with); for both the number of iterations is
+       nearly independent of the mesh size.
+    */
+    enum PreconditionerType
+    {
+      BlockJacobi,
+      AlgebraicMultigrid,
+      BoomerAMG
+    }; // enum PreconditionerType
+
     /**
        \brief An implementation of Poisson's problem. 
+
+       The system matrix and vectors are distributed over the MPI
+       processes of the test space, each of which owns the rows of
+       its subdomain and assembles on the cells of its subdomain
+       only. Functions are passed in, and the solution is handed
+       out, as vectors that every process holds in full.
        
        @author Toby D. Young 2013.
     */
@@ -70,26 +101,179 @@ namespace qdove
 	~Problem ();
 	
 	/**
-	   Reinitialise matrices and vectors. 
+	   Reinitialise matrices and vectors. If the mesh has not
+	   changed since the last call, the sparsity pattern, matrices,
+	   vectors and constraints are kept, and only the system vector
+	   is zeroed. The stiffness matrix, its preconditioner and the
+	   last solution are kept too.
 	*/
 	void reinit ();
 	
 	/**
-	   Assemble matrices and vectors. 
+	   Assemble matrices and vectors. The stiffness matrix is only
+	   assembled the first time after the mesh has changed (or
+	   after a reaction term has been assembled); otherwise only
+	   the right-hand-side vector is.
 	*/
 	void assemble (const dealii::PETScWrappers::Vector &rhs_function);
+
+	/**
+	   Assemble matrices and vectors of Poisson's problem with a
+	   reaction term, \f$-\nabla^2u+cu=f\f$, where \f$c\f$ is the
+	   reaction function. The reaction function should be
+	   non-negative so that the system stays positive definite.
+	*/
+	void assemble (const dealii::PETScWrappers::Vector &rhs_function,
+		       const dealii::PETScWrappers::Vector &reaction_function);
+
+	/**
+	   Assemble matrices and vectors from a right-hand-side function
+	   given at quadrature points. The field must be set up with the
+	   quadrature formula of the test space.
+	*/
+	void assemble (const qdove::QuadratureField<dim> &rhs_field);
 	
 	/**
-	   Solve the system. 
+	   Solve the system, starting from the last solution. 
 	*/
 	unsigned int solve ();
 	
 	/**
-	   Get the solution vector. 
+	   Set the type of preconditioner. The default is
+	   <code>BlockJacobi</code>.
+	*/
+	void set_preconditioner_type (const PreconditionerType type);
+
+	/**
+	   Get a copy of the solution vector; use solution() to read it
+	   in place.
 	*/
 	void get_solution_vector (dealii::PETScWrappers::Vector &vector);
 
+	/**
+	   Return the whole solution vector, without copying it. This is
+	   gathered on every process once per solve(), so it can be
+	   handed to the sequential models and statistics directly. Its
+	   contents change with the next solve().
+	*/
+	const dealii::PETScWrappers::Vector &solution () const;
+
+	/**
+	   Return the number of bytes saved by preallocating the system
+	   matrix with its exact sparsity pattern instead of
+	   max_couplings_between_dofs() entries per row.
+	*/
+	std::size_t memory_saved_by_preallocation () const;
+
       private:
+
+	/**
+	   Scratch data of the threaded assembly; each thread works on
+	   its own copy.
+	*/
+	struct AssemblyScratchData
+	{
+	  AssemblyScratchData (const dealii::FiniteElement<dim> &fe,
+			       const dealii::Quadrature<dim>     &quadrature,
+			       const dealii::UpdateFlags          update_flags,
+			       const dealii::Vector<double>      *rhs_function,
+			       const qdove::QuadratureField<dim> *rhs_field,
+			       const dealii::Vector<double>      *reaction_function,
+			       const bool                         rhs_only);
+
+	  AssemblyScratchData (const AssemblyScratchData &scratch_data);
+
+	  dealii::FEValues<dim> fe_values;
+
+	  /**
+	     Shape functions on the reference cell, for the cell
+	     kernels.
+	  */
+	  qdove::CellKernelData<dim> kernel_data;
+
+	  /**
+	     Values of the right-hand-side function at quadrature
+	     points of a cell.
+	  */
+	  std::vector<double> cell_rhs_function;
+
+	  /**
+	     Values of the reaction function at quadrature points of a
+	     cell.
+	  */
+	  std::vector<double> cell_reaction_function;
+
+	  /**
+	     Right-hand-side function.
+	  */
+	  const dealii::Vector<double> *rhs_function;
+
+	  /**
+	     Right-hand-side function at quadrature points, used
+	     instead of the function above if it is set.
+	  */
+	  const qdove::QuadratureField<dim> *rhs_field;
+
+	  /**
+	     Reaction function, or a null pointer if there is no
+	     reaction term.
+	  */
+	  const dealii::Vector<double> *reaction_function;
+
+	  /**
+	     Flag indicating that only the right-hand-side vector is
+	     assembled.
+	  */
+	  bool rhs_only;
+	};
+
+	/**
+	   Local contributions of one cell, handed from the worker
+	   threads to copy_local_to_global().
+	*/
+	struct AssemblyCopyData
+	{
+	  AssemblyCopyData (const unsigned int dofs_per_cell);
+
+	  dealii::FullMatrix<double> cell_system;
+	  dealii::Vector<double>     cell_rhs;
+	  std::vector<unsigned int>  local_dof_indices;
+	  bool                       rhs_only;
+	};
+
+	/**
+	   Assemble the system on all cells from local copies of the
+	   right-hand-side function (or the right-hand-side field) and
+	   the (optional) reaction function. If <code>rhs_only</code>
+	   is set, the system matrix is left alone.
+	*/
+	void assemble_system (const dealii::Vector<double>      *rhs_function,
+			      const qdove::QuadratureField<dim> *rhs_field,
+			      const dealii::Vector<double>      *reaction_function,
+			      const bool                         rhs_only);
+
+	/**
+	   Assemble the local contributions of one cell.
+	*/
+	void local_assemble (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+			     AssemblyScratchData                                          &scratch_data,
+			     AssemblyCopyData                                             &copy_data);
+
+	/**
+	   Compute the local matrix and vector of one cell, with the
+	   functions already evaluated at quadrature points, using the
+	   compile-time cell kernel for this element degree.
+	*/
+	template <int fe_degree>
+	void compute_cell_system (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+				  const AssemblyScratchData                                    &scratch_data,
+				  AssemblyCopyData                                             &copy_data) const;
+
+	/**
+	   Distribute the local contributions of one cell to the global
+	   matrix and vector.
+	*/
+	void copy_local_to_global (const AssemblyCopyData &copy_data);
 	
 	/**
 	   Pointer to trial space.
@@ -106,20 +290,58 @@ namespace qdove
 	*/
 	bool init;
 	
+	/**
+	   Revision of the degrees of freedom of the test space for
+	   which matrices, vectors and constraints were set up.
+	*/
+	unsigned int dof_revision;
+
+	/**
+	   Number of bytes saved by exact preallocation.
+	*/
+	std::size_t preallocation_memory_saved;
+	
 	/**
 	   System matrix to the linear algebra equation set.
 	*/
-	dealii::PETScWrappers::SparseMatrix system_matrix;
+	dealii::PETScWrappers::MPI::SparseMatrix system_matrix;
+
+	/**
+	   Type of preconditioner.
+	*/
+	PreconditionerType preconditioner_type;
+
+	/**
+	   Preconditioner of the system matrix.
+	*/
+	dealii::std_cxx1x::shared_ptr<dealii::PETScWrappers::PreconditionerBase> preconditioner;
+
+	/**
+	   Flag indicating if the system matrix holds the stiffness
+	   matrix only (without a reaction term).
+	*/
+	bool stiffness_is_assembled;
+
+	/**
+	   Flag indicating if the preconditioner has been set up for the
+	   current system matrix.
+	*/
+	bool preconditioner_is_initialised;
 
 	/**
 	   System vector (or rhs vector) to the linear algebra equation set.
 	*/
-	dealii::PETScWrappers::Vector       system_vector;
+	dealii::PETScWrappers::MPI::Vector  system_vector;
 
 	/**
 	   Solution vector to the linear algebra equation set.
 	*/
-	dealii::PETScWrappers::Vector       solution_vector;
+	dealii::PETScWrappers::MPI::Vector  solution_vector;
+
+	/**
+	   The whole solution vector, gathered on every process.
+	*/
+	dealii::PETScWrappers::Vector       localized_solution_vector;
 	
 	/**
 	   A matrix defining the row/column positions of constraints.
@@ -27,10 +27,19 @@
 
 #include <qdove/base/trial_space.h>
 #include <qdove/base/test_space.h>
+#include <qdove/base/quadrature_field.h>
+#include <qdove/models/cell_kernel.h>
+#include <qdove/models/hamiltonian_operator.h>
+#include <qdove/generic_linear_algebra/multi_vector.h>
 
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
 #include <deal.II/lac/constraint_matrix.h>
 #include <deal.II/lac/petsc_vector.h>
 #include <deal.II/lac/petsc_sparse_matrix.h>
+#include <deal.II/lac/petsc_parallel_vector.h>
+#include <deal.II/lac/petsc_parallel_sparse_matrix.h>
 
 #include <deal.II/lac/solver_control.h>
 #include <deal.II/lac/slepc_solver.h>
@@ -41,8 +50,46 @@ namespace qdove
   namespace Schroedinger
   {
 
+    /**
+       A list of eigenspectrum solvers that can be used to solve
+       Schroedinger's problem.
+
+       <code>LAPACK</code> is a dense solver that computes the whole
+       spectrum and is only suitable for small problems. The remaining
+       solvers are sparse iterative solvers that compute only the
+       requested number of eigenpairs closest to a target energy. The
+       Krylov-Schur and Lanczos solvers make use of a shift-and-invert
+       spectral transformation around that target energy. The
+       Jacobi-Davidson solver needs no factorisation and is the only
+       one available with the matrix-free operators.
+
+       <code>Tridiagonal</code> is a direct solver for the lowest
+       eigenpairs of one-dimensional problems with linear elements,
+       where the system and overlap matrices are tridiagonal. It does
+       not make use of SLEPc and its cost grows linearly with the
+       number of degrees of freedom.
+    */
+    enum SolverType
+    {
+      LAPACK,
+      KrylovSchur,
+      Lanczos,
+      JacobiDavidson,
+      Tridiagonal
+    }; // enum SolverType
+
     /**
        \brief An implementation of Schroedinger's problem.
+
+       The system, kinetic and overlap matrices are distributed over
+       the MPI processes of the test space, each of which owns the
+       rows of its subdomain and assembles on the cells of its
+       subdomain only, and the sparse eigensolvers run on the
+       communicator. The solution eigenvectors are then gathered, so
+       that every process holds them in full, as it does the
+       functions passed in. The tridiagonal solver and the
+       matrix-free operator are sequential; with them every process
+       solves the whole problem.
        
        @author Toby D. Young 2013.
     */
@@ -70,7 +117,10 @@ namespace qdove
       ~Problem ();
 
       /**
-	 Reinitialise matrices and vectors.
+	 Reinitialise matrices and vectors. If the mesh has not
+	 changed since the last call, the sparsity pattern, matrices,
+	 vectors and constraints are kept, and only the system matrix
+	 is zeroed.
       */
       void reinit  ();
 
@@ -81,18 +131,253 @@ namespace qdove
                      const dealii::PETScWrappers::Vector &pe_function);
 
       /**
-          Solve the system.
+         Assemble only the potential energy term of the Schroedinger
+         problem. The kinetic energy and overlap matrices are reused
+         from the last call to assemble(), which must have been made
+         on the same mesh and with the same kinetic energy function.
+         This is the cheap path for a self-consistent loop in which
+         only the potential changes. The system matrix is the same as
+         that of assemble(), including its constrained rows.
+      */
+      void assemble_potential (const dealii::PETScWrappers::Vector &pe_function);
+
+      /**
+         Assemble the Schroedinger problem from kinetic and potential
+         energy functions given at quadrature points. The fields must
+         be set up with the quadrature formula of the test space.
+      */
+      void assemble (const qdove::QuadratureField<dim> &ke_field,
+                     const qdove::QuadratureField<dim> &pe_field);
+
+      /**
+         Assemble only the potential energy term of the Schroedinger
+         problem from a potential energy function given at
+         quadrature points. See assemble_potential() above.
+      */
+      void assemble_potential (const qdove::QuadratureField<dim> &pe_field);
+
+      /**
+          Solve the system. With the <code>Tridiagonal</code> solver,
+          this throws a std::runtime_error if there are fewer
+          unconstrained degrees of freedom than eigenpairs.
       */
       unsigned int solve ();
 
       /**
-         Get the solution eigenpairs.
+         Set the type of eigenspectrum solver used by solve(). The
+         default is the dense LAPACK solver.
+      */
+      void set_solver_type (const SolverType type);
+
+      /**
+         Set the target energy of the iterative solvers. The
+         eigenpairs closest to this energy are computed. If no target
+         energy is set, the minimum of the potential energy function
+         is used, which lies below the lowest eigenvalue.
+      */
+      void set_target_energy (const double energy);
+
+      /**
+         Set an initial guess for the next call to solve(), typically
+         the eigenpairs of the previous self-consistent cycle. The
+         iterative solvers start from the subspace spanned by these
+         eigenvectors and, unless a target energy has been set
+         explicitly, shift towards the lowest of these eigenvalues.
+         The initial guess is used once and is ignored by the LAPACK
+         solver.
+      */
+      void set_initial_eigenpairs (const std::vector<double>                        &values,
+                                   const std::vector<dealii::PETScWrappers::Vector> &vectors);
+
+      /**
+         Use matrix-free Hamiltonian and overlap operators instead of
+         assembled matrices. In this mode no matrices are stored: the
+         Hamiltonian is applied cell by cell from the kinetic and
+         potential energy functions at quadrature points, and the
+         consistent overlap matrix is applied in the same way, so the
+         eigenpairs are those of the assembled problem. Only the
+         Jacobi-Davidson solver can be used, preconditioned with the
+         diagonal of the shifted Hamiltonian. The operator is only
+         available for linear elements. This must be set before the
+         problem is initialised.
+      */
+      void set_matrix_free (const bool matrix_free);
+
+      /**
+         Return the memory used by the matrices and the eigenvector
+         blocks, or by the matrix-free operator, in bytes.
+      */
+      std::size_t memory_consumption () const;
+
+      /**
+         Return the number of bytes saved by preallocating the
+         matrices with their exact sparsity pattern instead of
+         max_couplings_between_dofs() entries per row.
+      */
+      std::size_t memory_saved_by_preallocation () const;
+
+      /**
+         Get the solution eigenpairs. This copies every eigenvector;
+         use solution_eigenvalues(), solution_eigenvectors() or
+         solution_multivector() to read them in place.
       */
       void get_solution_eigenpairs (std::vector<double>                        &values,
                                     std::vector<dealii::PETScWrappers::Vector> &vectors);
 
+      /**
+         Return the solution eigenvalues, without copying them. The
+         reference stays valid as long as the problem, but its
+         contents change with the next solve().
+      */
+      const std::vector<double> &solution_eigenvalues () const;
+
+      /**
+         Return the solution eigenvectors, without copying them. The
+         reference stays valid as long as the problem, but its
+         contents change with the next solve() or reinit().
+      */
+      const std::vector<dealii::PETScWrappers::Vector> &solution_eigenvectors () const;
+
+      /**
+         Return the solution eigenvectors as the columns of one
+         contiguous multivector, for blocked operations on all of
+         them. This is the storage of the vectors returned by
+         solution_eigenvectors(), not a copy of them.
+      */
+      const qdove::MultiVector &solution_multivector () const;
+
+      /**
+         Compute the matrix of overlaps
+         \f$\langle\psi_i|\psi_j\rangle\f$ of all solution
+         eigenvectors, which is the identity matrix up to the
+         accuracy of the eigensolver. This is one sparse times dense
+         matrix product with the overlap matrix followed by one
+         dense matrix product. Not available in matrix-free mode.
+      */
+      void compute_overlaps (dealii::FullMatrix<double> &overlaps) const;
+
     private:
 
+      /**
+         Scratch data of the threaded assembly; each thread works on
+         its own copy.
+      */
+      struct AssemblyScratchData
+      {
+        AssemblyScratchData (const dealii::FiniteElement<dim> &fe,
+                             const dealii::Quadrature<dim>     &quadrature,
+                             const dealii::UpdateFlags          update_flags,
+                             const dealii::Vector<double>      *ke_function,
+                             const dealii::Vector<double>      *pe_function,
+                             const qdove::QuadratureField<dim> *ke_field = 0,
+                             const qdove::QuadratureField<dim> *pe_field = 0);
+
+        AssemblyScratchData (const AssemblyScratchData &scratch_data);
+
+        dealii::FEValues<dim> fe_values;
+
+        /**
+           Shape functions on the reference cell, for the cell
+           kernels.
+        */
+        qdove::CellKernelData<dim> kernel_data;
+
+        /**
+           Values of the functions at quadrature points of a cell.
+        */
+        std::vector<double> cell_ke_function;
+        std::vector<double> cell_pe_function;
+
+        /**
+           Kinetic and potential energy functions. If there is no
+           kinetic energy function, only the potential energy term is
+           assembled.
+        */
+        const dealii::Vector<double> *ke_function;
+        const dealii::Vector<double> *pe_function;
+
+        /**
+           Kinetic and potential energy functions at quadrature
+           points. These are used instead of the functions above if
+           they are set.
+        */
+        const qdove::QuadratureField<dim> *ke_field;
+        const qdove::QuadratureField<dim> *pe_field;
+      };
+
+      /**
+         Local contributions of one cell, handed from the worker
+         threads to copy_local_to_global().
+      */
+      struct AssemblyCopyData
+      {
+        AssemblyCopyData (const unsigned int dofs_per_cell);
+
+        dealii::FullMatrix<double> cell_system;
+        dealii::FullMatrix<double> cell_kinetic;
+        dealii::FullMatrix<double> cell_overlap;
+        std::vector<unsigned int>  local_dof_indices;
+
+        /**
+           Flag indicating if only the potential energy term was
+           assembled.
+        */
+        bool potential_only;
+      };
+
+      /**
+         Assemble on all cells on all available threads, with copies
+         of this scratch data.
+      */
+      void assemble_cells (const AssemblyScratchData &scratch_data);
+
+      /**
+         Set the diagonal of constrained rows of the system matrix
+         from those of the kinetic energy and overlap matrices and
+         this bound of the potential energy function.
+      */
+      void set_constrained_diagonal (const double potential_bound);
+
+      /**
+         Assemble the local contributions of one cell.
+      */
+      void local_assemble (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+                           AssemblyScratchData                                          &scratch_data,
+                           AssemblyCopyData                                             &copy_data);
+
+      /**
+         Compute the local matrices of one cell, with the
+         coefficients already evaluated at quadrature points, using
+         the compile-time cell kernel for this element degree.
+      */
+      template <int fe_degree>
+      void compute_cell_matrices (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+                                  const AssemblyScratchData                                    &scratch_data,
+                                  AssemblyCopyData                                             &copy_data) const;
+
+      /**
+         Distribute the local contributions of one cell to the global
+         matrices.
+      */
+      void copy_local_to_global (const AssemblyCopyData &copy_data);
+
+      /**
+         Solve the system with the matrix-free operator.
+      */
+      unsigned int solve_matrix_free ();
+
+      /**
+         Return the energy around which the iterative solvers look
+         for eigenpairs.
+      */
+      double compute_target_energy () const;
+
+      /**
+         Compute the product of the overlap matrix with all solution
+         eigenvectors into the overlap block.
+      */
+      void multiply_overlap_block () const;
+
       /**
          Pointer to trial space.
       */
@@ -107,12 +392,18 @@ namespace qdove
 	 System matrix (or hamiltonian matrix) to the eigenspectrum
 	 problem.
       */
-      dealii::PETScWrappers::SparseMatrix        system_matrix;
+      dealii::PETScWrappers::MPI::SparseMatrix   system_matrix;
+
+      /**
+	 Kinetic energy part of the system matrix, kept for
+	 assemble_potential().
+      */
+      dealii::PETScWrappers::MPI::SparseMatrix   kinetic_matrix;
 
       /**
 	 Overlap matrix (or mass matrix) to the eigenspectrum problem.
       */
-      dealii::PETScWrappers::SparseMatrix        overlap_matrix;
+      dealii::PETScWrappers::MPI::SparseMatrix   overlap_matrix;
 
       /**
 	 Solution eigenvalues to the eigenspectrum problem.
@@ -120,10 +411,19 @@ namespace qdove
       std::vector<double>                        solution_values;
 
       /**
-	 Solution eigenvectors to the eigenspectrum problem.
+	 Solution eigenvectors to the eigenspectrum problem. These are
+	 views of the columns of the solution block, so the
+	 eigensolvers write straight into it.
       */
       std::vector<dealii::PETScWrappers::Vector> solution_vectors;
 
+      /**
+	 The rows of the solution eigenvectors this process owns, as
+	 distributed views of the solution block. The sparse
+	 eigensolvers write to these.
+      */
+      std::vector<dealii::PETScWrappers::MPI::Vector> distributed_vectors;
+
       /**
 	 A matrix defining the row/column positions of constraints.
       */
@@ -134,6 +434,91 @@ namespace qdove
       */
       const unsigned int n_eigenpairs;
 
+      /**
+         Type of eigenspectrum solver.
+      */
+      SolverType solver_type;
+
+      /**
+         Target energy of the iterative solvers.
+      */
+      double target_energy;
+
+      /**
+         Flag indicating if the target energy has been set by the
+         user.
+      */
+      bool target_energy_is_set;
+
+      /**
+         Minimum of the potential energy function seen during the last
+         assembly; used as the default target energy.
+      */
+      double potential_minimum;
+
+      /**
+         Initial vector of the iterative solvers; the sum of the
+         eigenvectors given to set_initial_eigenpairs().
+      */
+      dealii::PETScWrappers::Vector              initial_vector;
+
+      /**
+         Solution eigenvectors, stored contiguously. This owns the
+         elements of the solution vectors.
+      */
+      qdove::MultiVector                         solution_block;
+
+      /**
+         Product of the overlap matrix with the solution
+         eigenvectors; kept to avoid reallocation in every solve.
+      */
+      mutable qdove::MultiVector                 overlap_block;
+
+      /**
+         Lowest eigenvalue given to set_initial_eigenpairs().
+      */
+      double initial_value;
+
+      /**
+         Flag indicating if an initial guess is available for the next
+         solve.
+      */
+      bool initial_guess_is_set;
+
+      /**
+         Degrees of freedom that are not constrained, ordered by
+         their position. In one dimension with linear elements, the
+         system and overlap matrices are tridiagonal in this order.
+      */
+      std::vector<dealii::types::global_dof_index> tridiagonal_ordering;
+
+      /**
+         Flag indicating if the kinetic energy and overlap matrices
+         have been assembled.
+      */
+      bool kinetic_is_assembled;
+
+      /**
+         Revision of the degrees of freedom of the test space for
+         which matrices, vectors and constraints were set up.
+      */
+      unsigned int dof_revision;
+
+      /**
+         Number of bytes saved by exact preallocation.
+      */
+      std::size_t preallocation_memory_saved;
+
+      /**
+         Flag indicating if the matrix-free operator is used.
+      */
+      bool use_matrix_free;
+
+      /**
+         Matrix-free Hamiltonian operator.
+      */
+      HamiltonianOperator<dim,1> hamiltonian_operator;
+
       /**
          Flag indicating if the problem has been initialised.
       */
@@ -0,0 +1,408 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __qdove_self_consistent_h
+#define __qdove_self_consistent_h
+
+#include <qdove/base/trial_space.h>
+#include <qdove/base/test_space.h>
+#include <qdove/base/quadrature_field.h>
+#include <qdove/models/schroedinger.h>
+#include <qdove/models/poisson.h>
+
+#include <deal.II/lac/petsc_vector.h>
+
+#include <deque>
+
+namespace qdove
+{
+
+  namespace SelfConsistent
+  {
+
+    /**
+       A list of schemes that mix the input and output potentials of
+       one cycle into the input potential of the next cycle.
+
+       <code>Linear</code> adds a fixed fraction of the residual to
+       the input potential. <code>Anderson</code> (also known as Pulay
+       or DIIS mixing) and <code>Broyden</code> (Broyden's second
+       method) build an approximate inverse Jacobian of the residual
+       from the input potentials and residuals of the last few
+       cycles, and usually converge in far fewer cycles.
+
+       <code>PredictorCorrector</code> does not mix potentials.
+       Instead, Poisson's problem is solved as a nonlinear problem by
+       Newton's method, with an electron density that is predicted
+       from the current electron states by shifting their energies
+       with the change of the potential (see Trellakis et al., J.
+       Appl. Phys. 81, 7880 (1997)). The solution is taken as the
+       input potential of the next cycle. This is robust at high
+       doping and needs no mixing parameter.
+    */
+    enum MixingType
+    {
+      Linear,
+      Anderson,
+      Broyden,
+      PredictorCorrector
+    }; // enum MixingType
+
+    /**
+       \brief A self-consistent Schroedinger-Poisson problem.
+
+       Given a potential \f$V\f$, Schroedinger's problem gives the
+       electron states, Fermi-Dirac statistics give the electron
+       density \f$n\f$, and Poisson's problem with the charge density
+       \f$n-N_D\f$ gives the Hartree potential \f$V_H\f$. The output
+       potential of the cycle is then \f$F(V)=V_0+V_H\f$, where
+       \f$V_0\f$ is the band-edge potential. This is repeated until
+       the maximum norm of the residual \f$F(V)-V\f$ falls below a
+       tolerance.
+
+       A problem in one, two or three dimensions models a quantum
+       well, wire or dot: the density of states and the occupancy of
+       the electron states are those of that confinement (see
+       FermiDirac::Confinement).
+
+       @author Toby D. Young 2013.
+    */
+    template <int dim>
+      class Problem
+      {
+      public:
+
+	/**
+	   Constructor. Generate the problem using these trial and
+	   test spaces, and compute this number of electron states.
+	*/
+	Problem (qdove::TrialSpace<dim> &trial,
+		 qdove::TestSpace<dim>  &test,
+		 const unsigned int      n_eigenpairs = 1);
+
+	/**
+	   Destructor
+	*/
+	~Problem ();
+
+	/**
+	   Set the mixing scheme, the mixing parameter and the number
+	   of previous cycles kept by the Anderson and Broyden schemes.
+	*/
+	void set_mixing (const MixingType   type,
+			 const double       alpha   = 0.1,
+			 const unsigned int history = 5);
+
+	/**
+	   Set the tolerance of the maximum norm of the residual, in
+	   units of energy, and the maximum number of cycles.
+	*/
+	void set_tolerance (const double       tolerance,
+			    const unsigned int max_cycles = 100);
+
+	/**
+	   Set the effective mass function, in units of the electron
+	   mass. This sets both the kinetic energy term and the density
+	   of states.
+	*/
+	void set_effective_mass (const dealii::PETScWrappers::Vector &effective_mass);
+
+	/**
+	   Set the band-edge potential \f$V_0\f$.
+	*/
+	void set_band_edge (const dealii::PETScWrappers::Vector &band_edge);
+
+	/**
+	   Set the density of ionised dopants \f$N_D\f$.
+	*/
+	void set_doping (const dealii::PETScWrappers::Vector &doping);
+
+	/**
+	   Set the Fermi energy and the permittivity of the material.
+	*/
+	void set_material (const double fermi_energy,
+			   const double permittivity);
+
+	/**
+	   Find the Fermi energy from charge neutrality in every cycle,
+	   instead of keeping the one given to set_material(): the
+	   electrons in the computed states then neutralise the ionised
+	   dopants.
+	*/
+	void set_charge_neutrality (const bool charge_neutrality);
+
+	/**
+	   Return the Fermi energy of the last cycle.
+	*/
+	double get_fermi_energy () const;
+
+	/**
+	   Set the temperature, in Kelvin, of the Fermi-Dirac
+	   statistics. The default is 300K.
+	*/
+	void set_temperature (const double temperature);
+
+	/**
+	   Set the type of eigenspectrum solver used for Schroedinger's
+	   problem.
+	*/
+	void set_solver_type (const qdove::Schroedinger::SolverType type);
+
+	/**
+	   Iterate to self-consistency, starting from this potential,
+	   or from the band-edge potential if none is given. Return the
+	   number of cycles taken; the problem has converged if
+	   residual_norm() is below the tolerance.
+	*/
+	unsigned int run ();
+	unsigned int run (const dealii::PETScWrappers::Vector &initial_potential);
+
+	/**
+	   Iterate to self-consistency on the current mesh, and then
+	   this many times more on adaptively refined meshes. After
+	   each converged run, the error of the electron states and of
+	   the potential is estimated on each cell, the cells with the
+	   largest fraction of the error are refined and those with the
+	   smallest fraction are coarsened. Material functions,
+	   potential and electron states are then transferred to the
+	   new mesh, and the next run starts from them. Return the
+	   total number of cycles taken.
+	*/
+	unsigned int run_adaptive (const unsigned int n_refinements,
+				   const double       refine_fraction  = 0.3,
+				   const double       coarsen_fraction = 0.03);
+
+	/**
+	   Maximum norm of the residual of the last cycle.
+	*/
+	double residual_norm () const;
+
+	/**
+	   Return the number of iterations of the eigenspectrum solver
+	   in each cycle of the last call of run() or run_adaptive(),
+	   in the order of cycles.
+	*/
+	const std::vector<unsigned int> &eigensolver_iterations () const;
+
+	/**
+	   Get the self-consistent potential.
+	*/
+	void get_potential (dealii::PETScWrappers::Vector &vector) const;
+
+	/**
+	   Get the electron density of the last cycle.
+	*/
+	void get_density (dealii::PETScWrappers::Vector &vector) const;
+
+	/**
+	   Get the electron states of the last cycle.
+	*/
+	void get_solution_eigenpairs (std::vector<double>                        &values,
+				      std::vector<dealii::PETScWrappers::Vector> &vectors) const;
+
+	/**
+	   Return the energies of the electron states of the last
+	   cycle, without copying them.
+	*/
+	const std::vector<double> &solution_eigenvalues () const;
+
+	/**
+	   Return the electron states of the last cycle, without
+	   copying them.
+	*/
+	const std::vector<dealii::PETScWrappers::Vector> &solution_eigenvectors () const;
+
+      private:
+
+	/**
+	   Compute the output potential of one cycle from the input
+	   potential.
+	*/
+	void compute_output_potential (const unsigned int                   cycle,
+				       const dealii::PETScWrappers::Vector &input_potential,
+				       dealii::PETScWrappers::Vector       &output_potential);
+
+	/**
+	   Solve the nonlinear Poisson problem of the predictor-corrector
+	   scheme with Newton's method, for the electron states of the
+	   input potential.
+	*/
+	void solve_nonlinear_poisson (const dealii::PETScWrappers::Vector &input_potential,
+				      dealii::PETScWrappers::Vector       &output_potential);
+
+	/**
+	   Compute the input potential of the next cycle from the input
+	   potential and the residual of this cycle.
+	*/
+	void mix (dealii::PETScWrappers::Vector       &potential,
+		  const dealii::PETScWrappers::Vector &residual);
+
+	/**
+	   Refine and coarsen the mesh from Kelly's error estimator
+	   applied to the electron states and the potential, and
+	   transfer all functions given at degrees of freedom to the
+	   new mesh.
+	*/
+	void refine_mesh (const double refine_fraction,
+			  const double coarsen_fraction);
+
+	/**
+	   Pointer to trial space.
+	*/
+	qdove::TrialSpace<dim> *trial_space;
+
+	/**
+	   Pointer to test space.
+	*/
+	qdove::TestSpace<dim>  *test_space;
+
+	/**
+	   Schroedinger's problem.
+	*/
+	qdove::Schroedinger::Problem<dim> schroedinger_problem;
+
+	/**
+	   Poisson's problem.
+	*/
+	qdove::Poisson::Problem<dim> poisson_problem;
+
+	/**
+	   Mixing scheme, mixing parameter and number of previous
+	   cycles kept.
+	*/
+	MixingType   mixing_type;
+	double       alpha;
+	unsigned int history;
+
+	/**
+	   Tolerance of the residual and maximum number of cycles. The
+	   tolerance is also used for Newton's method in the
+	   predictor-corrector scheme.
+	*/
+	double       tolerance;
+	unsigned int max_cycles;
+
+	/**
+	   Maximum number of Newton steps of the predictor-corrector
+	   scheme in one cycle.
+	*/
+	unsigned int max_newton_steps;
+
+	/**
+	   Fermi energy, permittivity and temperature.
+	*/
+	double fermi_energy;
+	double permittivity;
+	double temperature;
+
+	/**
+	   Flag indicating if the Fermi energy is found from charge
+	   neutrality.
+	*/
+	bool charge_neutrality;
+
+	/**
+	   Kinetic energy term, density of states, band-edge potential
+	   and doping profile.
+	*/
+	dealii::PETScWrappers::Vector kinetic;
+	dealii::PETScWrappers::Vector density_of_states;
+	dealii::PETScWrappers::Vector band_edge;
+	dealii::PETScWrappers::Vector doping;
+
+	/**
+	   Kinetic energy term, density of states and doping profile
+	   at the quadrature points of the test space, set up at the
+	   start of each run.
+	*/
+	qdove::QuadratureField<dim> kinetic_field;
+	qdove::QuadratureField<dim> density_of_states_field;
+	qdove::QuadratureField<dim> doping_field;
+
+	/**
+	   Input potential and charge density of the current cycle at
+	   the quadrature points of the test space.
+	*/
+	qdove::QuadratureField<dim> potential_field;
+	qdove::QuadratureField<dim> charge_field;
+
+	/**
+	   Integrals of the basis functions of the test space.
+	*/
+	dealii::PETScWrappers::Vector nodal_weights;
+
+	/**
+	   Current potential and electron density.
+	*/
+	dealii::PETScWrappers::Vector potential;
+	dealii::PETScWrappers::Vector density;
+
+	/**
+	   Electron states of the last cycle of the last run. During a
+	   run, the states are read in place from the Schroedinger
+	   problem.
+	*/
+	std::vector<double>                        eigenvalues;
+	std::vector<dealii::PETScWrappers::Vector> eigenvectors;
+
+	/**
+	   Maximum norm of the residual of the last cycle.
+	*/
+	double last_residual_norm;
+
+	/**
+	   Iterations of the eigenspectrum solver in each cycle.
+	*/
+	std::vector<unsigned int> n_eigensolver_iterations;
+
+	/**
+	   Flag indicating if the input potential and residual of a
+	   previous cycle of this run are available.
+	*/
+	bool have_previous_cycle;
+
+	/**
+	   Input potential and residual of the previous cycle, and the
+	   differences of input potentials and residuals of the last
+	   few cycles, oldest first, for Anderson mixing.
+	*/
+	dealii::PETScWrappers::Vector             previous_potential;
+	dealii::PETScWrappers::Vector             previous_residual;
+	std::deque<dealii::PETScWrappers::Vector> potential_differences;
+	std::deque<dealii::PETScWrappers::Vector> residual_differences;
+
+	/**
+	   Broyden updates of the negative inverse Jacobian of the
+	   residual, which applied to a vector \f$x\f$ is \f$\alpha
+	   x+\sum_i u_i(v_i\cdot x)\f$.
+	*/
+	std::deque<dealii::PETScWrappers::Vector> broyden_u;
+	std::deque<dealii::PETScWrappers::Vector> broyden_v;
+      };
+
+  } // namespace SelfConsistent
+
+} // namespace qdove
+
+#endif // __qdove_self_consistent_h
@@ -25,6 +25,10 @@
 #ifndef __qdove_statistics_h
 #define __qdove_statistics_h
 
+#include <qdove/base/test_space.h>
+#include <qdove/base/quadrature_field.h>
+#include <qdove/generic_linear_algebra/multi_vector.h>
+
 #include <deal.II/lac/petsc_vector.h>
 
 namespace qdove
@@ -37,6 +41,43 @@ namespace qdove
   */
   namespace FermiDirac
   {
+
+    /**
+       The number of directions in which the electrons of a device
+       are confined, which is the number of dimensions it is modelled
+       in. Electrons move freely in the remaining directions, and
+       their density of states and occupancy depend on how many
+       there are:
+
+       - <code>QuantumWell</code> (one dimension): two free
+         directions, density of states \f$m^*/\pi\hbar^2\f$ and
+         occupancy \f$k_BT\ln(1+\exp(x))\f$;
+
+       - <code>QuantumWire</code> (two dimensions): one free
+         direction, density of states
+         \f$\sqrt{2m^*/\pi}/\hbar\f$ and occupancy
+         \f$\sqrt{k_BT}F_{-1/2}(x)\f$, where \f$F_{-1/2}\f$ is the
+         complete Fermi-Dirac integral;
+
+       - <code>QuantumDot</code> (three dimensions): no free
+         direction, density of states one and occupancy
+         \f$2/(1+\exp(-x))\f$;
+
+       where \f$x=(E_F-E_i)/k_BT\f$. In each case the number density
+       \f$g\sum_i|\psi_i|^2f(x_i)\f$ is per unit volume.
+    */
+    enum Confinement
+    {
+      QuantumWell,
+      QuantumWire,
+      QuantumDot
+    }; // enum Confinement
+
+    /**
+       Return the confinement of a device modelled in this many
+       dimensions.
+    */
+    Confinement confinement_of_dimension (const unsigned int dim);
     
     /**
        Compute the density function for a given wavefunction such
@@ -47,36 +88,175 @@ namespace qdove
     
     /**
        Compute the number density function from a given wavefunction
-       and density of states.
-       
-       \todo Currently this only works at default temperature
-       \f$300\,\f$K.
+       and density of states at this temperature (in Kelvin).
     */
     void compute_number_density (const dealii::PETScWrappers::Vector &wavefunction,
 				 const double                        &energy_value,
 				 const double                        &fermi_energy_value,
 				 const dealii::PETScWrappers::Vector &density_of_states,
-				 dealii::PETScWrappers::Vector       &density);
+				 dealii::PETScWrappers::Vector       &density,
+				 const double                         temperature = 300.,
+				 const Confinement                    confinement = QuantumWell);
     
     /**
        Compute the number density function from a set of wavefunctions
-       and densities of states.
-       
-       \todo Currently this only works at default temperature
-       \f$300\,\f$K.
+       and densities of states. This is done in one pass over each
+       wavefunction without temporary vectors; the density is only
+       reinitialised if it has the wrong size.
     */
     void compute_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
 				 const std::vector<double>                        &energy_value,
 				 const double                                     &fermi_energy_value,
 				 const dealii::PETScWrappers::Vector              &density_of_states,
-				 dealii::PETScWrappers::Vector                    &density);
+				 dealii::PETScWrappers::Vector                    &density,
+				 const double                                      temperature = 300.,
+				 const Confinement                                 confinement = QuantumWell);
+
+    /**
+       Same as above, for wavefunctions stored as the columns of a
+       multivector. The squares of all wavefunctions are accumulated
+       block by block of rows, so that the density stays in cache.
+    */
+    void compute_number_density (const qdove::MultiVector            &wavefunction,
+				 const std::vector<double>           &energy_value,
+				 const double                        &fermi_energy_value,
+				 const dealii::PETScWrappers::Vector &density_of_states,
+				 dealii::PETScWrappers::Vector       &density,
+				 const double                         temperature = 300.,
+				 const Confinement                    confinement = QuantumWell);
+
+    /**
+       Compute the number density functions for a batch of pairs of
+       temperature and Fermi energy from one set of wavefunctions, so
+       that a temperature or Fermi level sweep does not need more
+       eigenspectrum solves. Each wavefunction is read only once for
+       the whole batch.
+    */
+    void compute_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_value,
+				 const std::vector<double>                        &temperatures,
+				 const std::vector<double>                        &fermi_energy_values,
+				 const dealii::PETScWrappers::Vector              &density_of_states,
+				 std::vector<dealii::PETScWrappers::Vector>       &densities,
+				 const Confinement                                 confinement = QuantumWell);
+    
+    /**
+       Predict the number density function, and its derivative with
+       respect to the potential, after the potential has changed by
+       \f$\delta V\f$ without recomputing the wavefunctions. The
+       energy of each state is shifted locally by the potential
+       shift, so that
+       \f$n=\sum_i g|\psi_i|^2f((E_F-E_i-\delta V)/k_BT)\f$, with the
+       occupancy \f$f\f$ of this confinement.
+    */
+    void compute_predicted_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+					   const std::vector<double>                        &energy_values,
+					   const double                                     &fermi_energy_value,
+					   const dealii::PETScWrappers::Vector              &density_of_states,
+					   const dealii::PETScWrappers::Vector              &potential_shift,
+					   dealii::PETScWrappers::Vector                    &density,
+					   dealii::PETScWrappers::Vector                    &density_derivative,
+					   const double                                      temperature = 300.,
+					   const Confinement                                 confinement = QuantumWell);
     
     /**
-       Compute the density of states from a given effective mass
-       function.
+       Compute the integral \f$a_i=\int g|\psi_i|^2\f$ of each
+       state weighted by the density of states, using the nodal
+       weights of the test space (see
+       TestSpace::compute_nodal_weights()). The number of electrons
+       in state \f$i\f$ is then \f$a_if((E_F-E_i)/k_BT)\f$, with the
+       occupancy \f$f\f$ of the confinement, so that the Fermi energy can be found without touching the
+       wavefunctions again.
+    */
+    void compute_state_weights (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				const dealii::PETScWrappers::Vector              &density_of_states,
+				const dealii::PETScWrappers::Vector              &nodal_weights,
+				std::vector<double>                              &state_weights);
+
+    /**
+       Same as above, for wavefunctions stored as the columns of a
+       multivector.
+    */
+    void compute_state_weights (const qdove::MultiVector            &wavefunction,
+				const dealii::PETScWrappers::Vector &density_of_states,
+				const dealii::PETScWrappers::Vector &nodal_weights,
+				std::vector<double>                 &state_weights);
+
+    /**
+       Find the Fermi energy at which the states hold this number of
+       electrons (per unit area of a well, per unit length of a wire,
+       or in total in a dot), from the state weights computed by
+       compute_state_weights(). A dot holds at most two electrons per
+       state. The number of electrons grows
+       monotonically with the Fermi energy, and the root is found
+       with Newton's method safeguarded by bisection, at a cost of
+       \f$O(n_{states})\f$ per iteration.
+    */
+    double compute_fermi_energy (const std::vector<double> &state_weights,
+				 const std::vector<double> &energy_values,
+				 const double               number_of_electrons,
+				 const double               temperature = 300.,
+				 const Confinement          confinement = QuantumWell);
+
+    /**
+       Find the Fermi energy at which the electrons in these states
+       neutralise the charge of the ionised dopants.
+    */
+    double compute_fermi_energy (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_values,
+				 const dealii::PETScWrappers::Vector              &density_of_states,
+				 const dealii::PETScWrappers::Vector              &doping,
+				 const dealii::PETScWrappers::Vector              &nodal_weights,
+				 const double                                      temperature = 300.,
+				 const Confinement                                 confinement = QuantumWell);
+
+    /**
+       Same as above, for wavefunctions stored as the columns of a
+       multivector.
+    */
+    double compute_fermi_energy (const qdove::MultiVector            &wavefunction,
+				 const std::vector<double>           &energy_values,
+				 const dealii::PETScWrappers::Vector &density_of_states,
+				 const dealii::PETScWrappers::Vector &doping,
+				 const dealii::PETScWrappers::Vector &nodal_weights,
+				 const double                         temperature = 300.,
+				 const Confinement                    confinement = QuantumWell);
+
+    /**
+       Compute the density of states of this confinement from a given
+       effective mass function.
     */
     void compute_density_of_states (const dealii::PETScWrappers::Vector &effective_mass_function,
-				    dealii::PETScWrappers::Vector       &density_of_states);
+				    dealii::PETScWrappers::Vector       &density_of_states,
+				    const Confinement                    confinement = QuantumWell);
+
+    /**
+       Compute the number density function at the quadrature points
+       of the test space from a set of wavefunctions and a density of
+       states given at the same quadrature points. The wavefunctions
+       are evaluated exactly at each quadrature point, so that
+       \f$|\psi|^2\f$ is not interpolated from nodal values. The
+       occupancy is that of the confinement of a device modelled in
+       <code>dim</code> dimensions.
+    */
+    template <int dim>
+    void compute_number_density (qdove::TestSpace<dim>                            &test_space,
+				 const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_values,
+				 const double                                     &fermi_energy_value,
+				 const qdove::QuadratureField<dim>                &density_of_states,
+				 qdove::QuadratureField<dim>                      &density,
+				 const double                                      temperature = 300.);
+
+    /**
+       Compute the density of states at quadrature points from a
+       given effective mass function at the same quadrature points,
+       for the confinement of a device modelled in <code>dim</code>
+       dimensions.
+    */
+    template <int dim>
+    void compute_density_of_states (const qdove::QuadratureField<dim> &effective_mass_function,
+				    qdove::QuadratureField<dim>       &density_of_states);
     
   } // namespace FermiDirac
   
@@ -0,0 +1,144 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/base/profiler.h>
+
+#include <sys/time.h>
+
+#include <iomanip>
+
+namespace qdove
+{
+  bool Profiler::enabled = false;
+
+  std::map<std::string, Profiler::Phase> Profiler::phases;
+
+  Profiler::Phase::Phase ()
+    :
+    n_calls (0),
+    wall_time (0.),
+    n_iterations (0),
+    n_bytes (0)
+  {}
+
+  Profiler::Scope::Scope (const char *phase_name)
+    :
+    phase (enabled ? phase_name : 0),
+    start_time (enabled ? wall_clock () : 0.)
+  {}
+
+  Profiler::Scope::~Scope ()
+  {
+    if (phase==0)
+      return;
+
+    Phase &data = phases[phase];
+    data.wall_time += wall_clock () - start_time;
+    ++data.n_calls;
+  }
+
+  void
+  Profiler::enable (const bool enable)
+  {
+    enabled = enable;
+  }
+
+  bool
+  Profiler::is_enabled ()
+  {
+    return enabled;
+  }
+
+  void
+  Profiler::add_iterations (const char        *phase,
+			    const unsigned int n_iterations)
+  {
+    if (enabled)
+      phases[phase].n_iterations += n_iterations;
+  }
+
+  void
+  Profiler::add_bytes (const char        *phase,
+		       const std::size_t  n_bytes)
+  {
+    if (enabled)
+      phases[phase].n_bytes += n_bytes;
+  }
+
+  void
+  Profiler::reset ()
+  {
+    phases.clear ();
+  }
+
+  void
+  Profiler::print_summary (std::ostream &out)
+  {
+    out << std::left  << std::setw (40) << "phase"
+	<< std::right << std::setw (10) << "calls"
+	<< std::setw (16) << "wall time (s)"
+	<< std::setw (12) << "iterations"
+	<< std::setw (14) << "bytes"
+	<< std::endl;
+
+    std::map<std::string, Phase>::const_iterator phase;
+    for (phase=phases.begin (); phase!=phases.end (); ++phase)
+      out << std::left  << std::setw (40) << phase->first
+	  << std::right << std::setw (10) << phase->second.n_calls
+	  << std::setw (16) << phase->second.wall_time
+	  << std::setw (12) << phase->second.n_iterations
+	  << std::setw (14) << phase->second.n_bytes
+	  << std::endl;
+  }
+
+  void
+  Profiler::print_json (std::ostream &out)
+  {
+    // Phase names are identifiers made by the models, and need no
+    // escaping.
+    const std::streamsize precision = out.precision (9);
+
+    out << "{";
+    std::map<std::string, Phase>::const_iterator phase;
+    for (phase=phases.begin (); phase!=phases.end (); ++phase)
+      out << ((phase==phases.begin ()) ? "\n" : ",\n")
+	  << "  \"" << phase->first << "\": {"
+	  << "\"calls\": "         << phase->second.n_calls << ", "
+	  << "\"wall_time\": "     << phase->second.wall_time << ", "
+	  << "\"iterations\": "    << phase->second.n_iterations << ", "
+	  << "\"bytes\": "         << phase->second.n_bytes << "}";
+    out << "\n}" << std::endl;
+
+    out.precision (precision);
+  }
+
+  double
+  Profiler::wall_clock ()
+  {
+    struct timeval time;
+    gettimeofday (&time, 0);
+    return time.tv_sec + 1e-6*time.tv_usec;
+  }
+
+} // namespace qdove
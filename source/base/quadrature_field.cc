@@ -0,0 +1,219 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/base/quadrature_field.h>
+
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/base/numbers.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace qdove
+{
+  template<int dim>
+  QuadratureField<dim>::QuadratureField ()
+    :
+    q_points (0),
+    revision (0)
+  {}
+
+  template<int dim>
+  QuadratureField<dim>::QuadratureField (qdove::TestSpace<dim>         &test_space,
+					 const dealii::Quadrature<dim> &quadrature)
+    :
+    q_points (0),
+    revision (0)
+  {
+    reinit (test_space, quadrature);
+  }
+
+  template<int dim>
+  void
+  QuadratureField<dim>::reinit (qdove::TestSpace<dim>         &test_space,
+				const dealii::Quadrature<dim> &quadrature)
+  {
+    test_space.distribute_dofs ();
+
+    const dealii::Triangulation<dim> &triangulation = test_space.dofs ().get_tria ();
+
+    q_points = quadrature.size ();
+    revision = test_space.dof_revision ();
+
+    // Number the active cells in the order of iteration, so that a
+    // loop over cells runs through the values contiguously.
+    offsets.resize (triangulation.n_levels ());
+    for (unsigned int level=0; level<triangulation.n_levels (); ++level)
+      offsets[level].assign (triangulation.n_raw_cells (level), dealii::numbers::invalid_unsigned_int);
+
+    std::size_t offset = 0;
+    typename dealii::Triangulation<dim>::active_cell_iterator
+      cell = triangulation.begin_active (),
+      endc = triangulation.end ();
+    for (; cell!=endc; ++cell, offset+=q_points)
+      offsets[cell->level ()][cell->index ()] = offset;
+
+    values.assign (offset, 0.);
+  }
+
+  template<int dim>
+  void
+  QuadratureField<dim>::reinit (const QuadratureField<dim> &field)
+  {
+    q_points = field.q_points;
+    revision = field.revision;
+    offsets  = field.offsets;
+    values.assign (field.values.size (), 0.);
+  }
+
+  template<int dim>
+  void
+  QuadratureField<dim>::interpolate (qdove::TestSpace<dim>               &test_space,
+				     const dealii::Quadrature<dim>       &quadrature,
+				     const dealii::PETScWrappers::Vector &function)
+  {
+    assert ((function.size ()==test_space.n_dofs ()) && "Incompatible vector sizes.");
+    reinit (test_space, quadrature);
+
+    dealii::FEValues<dim> fe_values (test_space.fe (), quadrature, dealii::update_values);
+    std::vector<double> function_values (q_points);
+
+    typename dealii::DoFHandler<dim>::active_cell_iterator
+      cell = test_space.dofs ().begin_active (),
+      endc = test_space.dofs ().end ();
+    for (; cell!=endc; ++cell)
+      {
+	fe_values.reinit (cell);
+	fe_values.get_function_values (function, function_values);
+	std::copy (function_values.begin (), function_values.end (), cell_values (cell));
+      }
+  }
+
+  template<int dim>
+  unsigned int
+  QuadratureField<dim>::n_q_points () const
+  {
+    return q_points;
+  }
+
+  template<int dim>
+  std::size_t
+  QuadratureField<dim>::size () const
+  {
+    return values.size ();
+  }
+
+  template<int dim>
+  unsigned int
+  QuadratureField<dim>::dof_revision () const
+  {
+    return revision;
+  }
+
+  template<int dim>
+  double *
+  QuadratureField<dim>::begin ()
+  {
+    return &values[0];
+  }
+
+  template<int dim>
+  const double *
+  QuadratureField<dim>::begin () const
+  {
+    return &values[0];
+  }
+
+  template<int dim>
+  double *
+  QuadratureField<dim>::end ()
+  {
+    return &values[0] + values.size ();
+  }
+
+  template<int dim>
+  const double *
+  QuadratureField<dim>::end () const
+  {
+    return &values[0] + values.size ();
+  }
+
+  template<int dim>
+  QuadratureField<dim> &
+  QuadratureField<dim>::operator= (const double value)
+  {
+    std::fill (values.begin (), values.end (), value);
+    return *this;
+  }
+
+  template<int dim>
+  QuadratureField<dim> &
+  QuadratureField<dim>::operator*= (const double factor)
+  {
+    for (std::size_t i=0; i<values.size (); ++i)
+      values[i] *= factor;
+    return *this;
+  }
+
+  template<int dim>
+  void
+  QuadratureField<dim>::add (const double                a,
+			     const QuadratureField<dim> &field)
+  {
+    assert ((field.values.size ()==values.size ()) && "Incompatible field layouts.");
+    for (std::size_t i=0; i<values.size (); ++i)
+      values[i] += a * field.values[i];
+  }
+
+  template<int dim>
+  double
+  QuadratureField<dim>::min () const
+  {
+    return (values.size ()>0) ? *std::min_element (values.begin (), values.end ()) : 0.;
+  }
+
+  template<int dim>
+  double
+  QuadratureField<dim>::linfty_norm () const
+  {
+    double norm = 0.;
+    for (std::size_t i=0; i<values.size (); ++i)
+      norm = std::max (norm, std::fabs (values[i]));
+    return norm;
+  }
+
+  template<int dim>
+  std::size_t
+  QuadratureField<dim>::memory_consumption () const
+  {
+    std::size_t bytes = sizeof (*this) + values.capacity () * sizeof (double);
+    for (unsigned int level=0; level<offsets.size (); ++level)
+      bytes += offsets[level].capacity () * sizeof (std::size_t);
+    return bytes;
+  }
+
+} // namespace qdove
+
+#include "quadrature_field.inst"
@@ -24,21 +24,94 @@
 
 #include <qdove/base/test_space.h>
 
+#include <deal.II/base/std_cxx1x/bind.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/dofs/dof_renumbering.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/vector.h>
+
+#include <cassert>
+
 namespace qdove
 {
   template<int dim>
-  TestSpace<dim>::TestSpace ()
+  TestSpace<dim>::TestSpace (const unsigned int degree)
     :
-    finite_element (dealii::FE_Q<dim, dim> (1), 1)
+    trial_space (0),
+    finite_element (dealii::FE_Q<dim, dim> (degree), 1),
+    dofs_are_stale (true),
+    n_distributions (0),
+    communicator (MPI_COMM_WORLD),
+    n_processes (dealii::Utilities::MPI::n_mpi_processes (MPI_COMM_WORLD)),
+    this_process (dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD))
   {}
 
   template<int dim>
-  TestSpace<dim>::TestSpace (qdove::TrialSpace<dim> &trial_space)
+  TestSpace<dim>::TestSpace (qdove::TrialSpace<dim> &trial_space,
+			     const unsigned int      degree)
     :
+    trial_space (&trial_space),
     dof_handler (*(trial_space.triangulation ())),
-    finite_element (dealii::FE_Q<dim, dim> (1), 1)
+    finite_element (dealii::FE_Q<dim, dim> (degree), 1),
+    dofs_are_stale (true),
+    n_distributions (0),
+    communicator (MPI_COMM_WORLD),
+    n_processes (dealii::Utilities::MPI::n_mpi_processes (MPI_COMM_WORLD)),
+    this_process (dealii::Utilities::MPI::this_mpi_process (MPI_COMM_WORLD))
+  {
+    // Listen for changes of the mesh, so that degrees of freedom are
+    // only redistributed when they need to be.
+    triangulation_listener 
+      = trial_space.triangulation ()->signals.any_change.
+      connect (dealii::std_cxx1x::bind (&TestSpace<dim>::mark_dofs_stale, this));
+
+    distribute_dofs ();
+  }
+
+  template<int dim>
+  void
+  TestSpace<dim>::distribute_dofs ()
   {
+    if (!dofs_are_stale)
+      return;
+
+    // Give each process a subdomain of the grid, and number the
+    // degrees of freedom of each subdomain contiguously.
+    if (n_processes>1)
+      {
+	assert ((trial_space!=0) && "The test space has no trial space to partition.");
+	trial_space->partition (n_processes);
+      }
+
     dof_handler.distribute_dofs (finite_element);
+
+    dofs_per_process.assign (n_processes, 0);
+    if (n_processes>1)
+      {
+	dealii::DoFRenumbering::subdomain_wise (dof_handler);
+	for (unsigned int p=0; p<n_processes; ++p)
+	  dofs_per_process[p] = dealii::DoFTools::count_dofs_with_subdomain_association (dof_handler, p);
+      }
+    else
+      dofs_per_process[0] = dof_handler.n_dofs ();
+
+    dofs_are_stale = false;
+    ++n_distributions;
+  }
+
+  template<int dim>
+  unsigned int
+  TestSpace<dim>::dof_revision () const
+  {
+    return this->n_distributions;
+  }
+
+  template<int dim>
+  void
+  TestSpace<dim>::mark_dofs_stale ()
+  {
+    dofs_are_stale = true;
   }
 
   template<int dim>
@@ -62,6 +135,43 @@ namespace qdove
     return this->dof_handler.n_dofs ();
   }
 
+  template<int dim>
+  unsigned int
+  TestSpace<dim>::n_locally_owned_dofs ()
+  {
+    distribute_dofs ();
+    return this->dofs_per_process[this_process];
+  }
+
+  template<int dim>
+  const std::vector<dealii::types::global_dof_index> &
+  TestSpace<dim>::n_locally_owned_dofs_per_process ()
+  {
+    distribute_dofs ();
+    return this->dofs_per_process;
+  }
+
+  template<int dim>
+  MPI_Comm
+  TestSpace<dim>::mpi_communicator () const
+  {
+    return this->communicator;
+  }
+
+  template<int dim>
+  unsigned int
+  TestSpace<dim>::n_mpi_processes () const
+  {
+    return this->n_processes;
+  }
+
+  template<int dim>
+  unsigned int
+  TestSpace<dim>::this_mpi_process () const
+  {
+    return this->this_process;
+  }
+
   template<int dim>
   unsigned int 
   TestSpace<dim>::n_dofs_per_cell ()
@@ -76,6 +186,59 @@ namespace qdove
     return this->finite_element;
   }
 
+  template<int dim>
+  unsigned int
+  TestSpace<dim>::degree () const
+  {
+    return this->finite_element.degree;
+  }
+
+  template<int dim>
+  dealii::QGauss<dim>
+  TestSpace<dim>::quadrature () const
+  {
+    return dealii::QGauss<dim> (this->finite_element.degree+1);
+  }
+
+  template<int dim>
+  void
+  TestSpace<dim>::compute_nodal_weights (dealii::PETScWrappers::Vector &weights)
+  {
+    distribute_dofs ();
+
+    const dealii::QGauss<dim> quadrature_formula = quadrature ();
+    dealii::FEValues<dim> fe_values (finite_element, quadrature_formula,
+				     dealii::update_values | dealii::update_JxW_values);
+
+    const unsigned int dofs_per_cell = finite_element.dofs_per_cell;
+    const unsigned int n_q_points    = quadrature_formula.size ();
+
+    std::vector<dealii::types::global_dof_index> local_dof_indices (dofs_per_cell);
+    dealii::Vector<double> local_weights (dof_handler.n_dofs ());
+
+    typename dealii::DoFHandler<dim>::active_cell_iterator
+      cell = dof_handler.begin_active (),
+      endc = dof_handler.end ();
+
+    for (; cell!=endc; ++cell)
+      {
+	fe_values.reinit (cell);
+	cell->get_dof_indices (local_dof_indices);
+
+	for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	  for (unsigned int i=0; i<dofs_per_cell; ++i)
+	    local_weights (local_dof_indices[i])
+	      +=
+	      fe_values.shape_value (i,q_point) *
+	      fe_values.JxW (q_point);
+      }
+
+    weights.reinit (dof_handler.n_dofs ());
+    for (unsigned int i=0; i<local_weights.size (); ++i)
+      weights (i) = local_weights (i);
+    weights.compress (dealii::VectorOperation::insert);
+  }
+
 } // namespace TestSpace
 
 #include "test_space.inst"
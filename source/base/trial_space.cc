@@ -24,6 +24,14 @@
 
 #include <qdove/base/trial_space.h>
 
+#include <deal.II/base/point.h>
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/grid_tools.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
 namespace qdove
 {
   template<int dim>
@@ -47,7 +55,117 @@ namespace qdove
   template<int dim>
   void
   TrialSpace<dim>::make_unit_grid ()
-  {}
+  {
+    dealii::GridGenerator::hyper_cube (*triangulation_description, 0., 1.);
+  }
+
+  template<int dim>
+  void
+  TrialSpace<dim>::make_graded_grid (const std::vector<double> &thicknesses,
+				     const std::vector<double> &diffusion_lengths,
+				     const unsigned int         n_cells,
+				     const double               origin,
+				     const double               interface_fraction)
+  {
+    assert ((dim==1) && "Graded grids are only implemented in one dimension.");
+    assert ((thicknesses.size ()>0) && (diffusion_lengths.size ()+1==thicknesses.size ()) &&
+	    "There must be one diffusion length for each interface between layers.");
+    assert ((n_cells>0) && "The grid must have at least one cell.");
+    assert ((interface_fraction>=0.) && (interface_fraction<1.) &&
+	    "The interface fraction must be in [0,1).");
+
+    // Positions of the interfaces, and the total length of the
+    // stack.
+    std::vector<double> interfaces (diffusion_lengths.size ());
+    double length = 0.;
+    for (unsigned int i=0; i<thicknesses.size (); ++i)
+      {
+	assert ((thicknesses[i]>0.) && "Layers must have a positive thickness.");
+	length += thicknesses[i];
+	if (i<interfaces.size ())
+	  interfaces[i] = length;
+      }
+
+    // The cell density is uniform in the bulk, plus a Gaussian of
+    // twice the diffusion length around each interface, where the
+    // material function changes. Both parts integrate to one over the
+    // stack before they are weighted. The density is sampled finely
+    // enough to resolve the narrowest interface, and integrated with
+    // the trapezoidal rule.
+    double min_width = length;
+    for (unsigned int k=0; k<diffusion_lengths.size (); ++k)
+      {
+	assert ((diffusion_lengths[k]>0.) && "Diffusion lengths must be positive.");
+	min_width = std::min (min_width, 2.*diffusion_lengths[k]);
+      }
+
+    const unsigned int n_samples
+      = std::max (100*n_cells, static_cast<unsigned int> (std::ceil (20.*length/min_width)));
+    const double dx = length / n_samples;
+
+    std::vector<double> interface (n_samples+1, 0.);
+    for (unsigned int k=0; k<interfaces.size (); ++k)
+      {
+	const double width = 2.*diffusion_lengths[k];
+
+	std::vector<double> peak (n_samples+1);
+	double integral = 0.;
+	for (unsigned int s=0; s<=n_samples; ++s)
+	  {
+	    const double t = (s*dx-interfaces[k]) / width;
+	    peak[s] = std::exp (-t*t);
+	    integral += ((s==0) || (s==n_samples)) ? .5*peak[s]*dx : peak[s]*dx;
+	  }
+
+	for (unsigned int s=0; s<=n_samples; ++s)
+	  interface[s] += peak[s] / (integral*interfaces.size ());
+      }
+
+    const double bulk_fraction = interfaces.empty () ? 1. : 1.-interface_fraction;
+
+    std::vector<double> density (n_samples+1);
+    std::vector<double> cumulative (n_samples+1, 0.);
+    for (unsigned int s=0; s<=n_samples; ++s)
+      {
+	density[s] = bulk_fraction/length + (1.-bulk_fraction)*interface[s];
+	if (s>0)
+	  cumulative[s] = cumulative[s-1] + .5*(density[s-1]+density[s])*dx;
+      }
+
+    // Place the vertices where the cumulative density reaches
+    // multiples of 1/n_cells, so that every cell holds the same
+    // share of it.
+    std::vector<double> vertices (n_cells+1);
+    vertices[0]       = 0.;
+    vertices[n_cells] = length;
+
+    unsigned int s = 0;
+    for (unsigned int i=1; i<n_cells; ++i)
+      {
+	const double target = cumulative[n_samples] * i / n_cells;
+	while (cumulative[s+1]<target)
+	  ++s;
+	const double theta = (target-cumulative[s]) / (cumulative[s+1]-cumulative[s]);
+	vertices[i] = (s+theta) * dx;
+      }
+
+    std::vector<std::vector<double> > step_sizes (dim);
+    step_sizes[0].resize (n_cells);
+    for (unsigned int i=0; i<n_cells; ++i)
+      step_sizes[0][i] = vertices[i+1] - vertices[i];
+
+    dealii::Point<dim> p1, p2;
+    p1[0] = origin;
+    p2[0] = origin + length;
+    dealii::GridGenerator::subdivided_hyper_rectangle (*triangulation_description, step_sizes, p1, p2);
+  }
+
+  template<int dim>
+  void
+  TrialSpace<dim>::partition (const unsigned int n_partitions)
+  {
+    dealii::GridTools::partition_triangulation (n_partitions, *triangulation_description);
+  }
 
 }
 
@@ -0,0 +1,359 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/generic_linear_algebra/multi_vector.h>
+
+#include <petscmat.h>
+#include <petscblaslapack.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace qdove
+{
+  namespace
+  {
+    // Number of rows processed together by the row-wise kernels, so
+    // that a block of the accumulated vector stays in cache while
+    // all columns are streamed through it.
+    const unsigned int row_block_size = 512;
+
+    // deal.II keeps the PETSc handle of a vector protected; a
+    // pointer to the member, formed in a derived class, gives
+    // access to it.
+    template <class VectorType>
+    struct VectorHandle : public VectorType
+    {
+      static Vec &of (VectorType &vector)
+      {
+	return vector.*(&VectorHandle::vector);
+      }
+    };
+  }
+
+  MultiVector::MultiVector ()
+    :
+    rows (0),
+    columns (0)
+  {}
+
+  MultiVector::MultiVector (const unsigned int n_rows,
+			    const unsigned int n_columns)
+    :
+    rows (n_rows),
+    columns (n_columns),
+    values (static_cast<std::size_t> (n_rows) * n_columns, 0.)
+  {}
+
+  void
+  MultiVector::reinit (const unsigned int n_rows,
+		       const unsigned int n_columns)
+  {
+    rows    = n_rows;
+    columns = n_columns;
+
+    // Keep the allocation if it is large enough.
+    values.resize (static_cast<std::size_t> (rows) * columns);
+    std::fill (values.begin (), values.end (), 0.);
+  }
+
+  void
+  MultiVector::reinit (const std::vector<dealii::PETScWrappers::Vector> &vectors)
+  {
+    rows    = vectors.empty () ? 0 : vectors[0].size ();
+    columns = vectors.size ();
+    values.resize (static_cast<std::size_t> (rows) * columns);
+
+    for (unsigned int j=0; j<columns; ++j)
+      {
+	assert ((vectors[j].size ()==rows) && "Incompatible vector sizes.");
+
+	Vec vector = vectors[j];
+	const PetscScalar *array;
+	VecGetArrayRead (vector, &array);
+	std::copy (array, array+rows, column (j));
+	VecRestoreArrayRead (vector, &array);
+      }
+  }
+
+  unsigned int
+  MultiVector::n_rows () const
+  {
+    return rows;
+  }
+
+  unsigned int
+  MultiVector::n_columns () const
+  {
+    return columns;
+  }
+
+  double &
+  MultiVector::operator () (const unsigned int i,
+			    const unsigned int j)
+  {
+    return values[static_cast<std::size_t> (j) * rows + i];
+  }
+
+  double
+  MultiVector::operator () (const unsigned int i,
+			    const unsigned int j) const
+  {
+    return values[static_cast<std::size_t> (j) * rows + i];
+  }
+
+  double *
+  MultiVector::column (const unsigned int j)
+  {
+    assert ((j<columns) && "Column index out of range.");
+    return &values[0] + static_cast<std::size_t> (j) * rows;
+  }
+
+  const double *
+  MultiVector::column (const unsigned int j) const
+  {
+    assert ((j<columns) && "Column index out of range.");
+    return &values[0] + static_cast<std::size_t> (j) * rows;
+  }
+
+  void
+  MultiVector::extract_column (const unsigned int             j,
+			       dealii::PETScWrappers::Vector &vector) const
+  {
+    if (vector.size ()!=rows)
+      vector.reinit (rows);
+
+    Vec petsc_vector = vector;
+    PetscScalar *array;
+    VecGetArray (petsc_vector, &array);
+    std::copy (column (j), column (j)+rows, array);
+    VecRestoreArray (petsc_vector, &array);
+  }
+
+  void
+  MultiVector::view_column (const unsigned int             j,
+			    dealii::PETScWrappers::Vector &vector)
+  {
+    assert ((j<columns) && "Column index out of range.");
+
+    // Destroying a vector created over a user array leaves the
+    // array alone, so the vector can be destroyed by its owner as
+    // usual.
+    Vec &handle = VectorHandle<dealii::PETScWrappers::Vector>::of (vector);
+    PetscErrorCode ierr = VecDestroy (&handle);
+    assert ((ierr==0) && "PETSc could not destroy a vector.");
+
+    ierr = VecCreateSeqWithArray (PETSC_COMM_SELF, 1, rows, column (j), &handle);
+    assert ((ierr==0) && "PETSc could not create a vector over a column.");
+    (void) ierr;
+  }
+
+  void
+  MultiVector::view_column (const unsigned int                  j,
+			    const MPI_Comm                     &communicator,
+			    const unsigned int                  first_row,
+			    const unsigned int                  n_local_rows,
+			    dealii::PETScWrappers::MPI::Vector &vector)
+  {
+    assert ((j<columns) && "Column index out of range.");
+    assert ((first_row+n_local_rows<=rows) && "Row range out of range.");
+
+    Vec &handle = VectorHandle<dealii::PETScWrappers::MPI::Vector>::of (vector);
+    PetscErrorCode ierr = VecDestroy (&handle);
+    assert ((ierr==0) && "PETSc could not destroy a vector.");
+
+    ierr = VecCreateMPIWithArray (communicator, 1, n_local_rows, rows,
+				  column (j) + first_row, &handle);
+    assert ((ierr==0) && "PETSc could not create a distributed vector over a column.");
+    (void) ierr;
+  }
+
+  void
+  MultiVector::gather_rows (const MPI_Comm                                     &communicator,
+			    const std::vector<dealii::types::global_dof_index> &n_rows_per_process)
+  {
+    if (n_rows_per_process.size ()<2)
+      return;
+
+    std::vector<int> counts (n_rows_per_process.size ());
+    std::vector<int> offsets (n_rows_per_process.size ());
+    int n_gathered_rows = 0;
+    for (unsigned int p=0; p<n_rows_per_process.size (); ++p)
+      {
+	counts[p]        = n_rows_per_process[p];
+	offsets[p]       = n_gathered_rows;
+	n_gathered_rows += counts[p];
+      }
+    assert ((n_gathered_rows==static_cast<int> (rows)) && "Incompatible row distribution.");
+
+    // Each process sends its rows from where the others receive
+    // them, so the columns are gathered in place.
+    for (unsigned int j=0; j<columns; ++j)
+      {
+	const int ierr = MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+					 column (j), &counts[0], &offsets[0], MPI_DOUBLE,
+					 communicator);
+	assert ((ierr==MPI_SUCCESS) && "MPI could not gather the rows of a column.");
+	(void) ierr;
+      }
+  }
+
+  void
+  MultiVector::scale_columns (const std::vector<double> &factors)
+  {
+    assert ((factors.size ()==columns) && "Incompatible vector sizes.");
+
+    for (unsigned int j=0; j<columns; ++j)
+      {
+	double *x = column (j);
+	for (unsigned int i=0; i<rows; ++i)
+	  x[i] *= factors[j];
+      }
+  }
+
+  void
+  MultiVector::mmult (MultiVector                             &dst,
+		      const dealii::PETScWrappers::MatrixBase &matrix) const
+  {
+    assert ((matrix.n ()==rows) && "Incompatible matrix and multivector sizes.");
+
+    dst.reinit (matrix.m (), columns);
+    if ((rows==0) || (columns==0))
+      return;
+
+    // Wrap this multivector and the destination as dense matrices
+    // without copying them; PETSc only writes to the destination,
+    // which it reuses as the product.
+    Mat x_matrix;
+    Mat product;
+    PetscErrorCode ierr;
+    ierr = MatCreateSeqDense (PETSC_COMM_SELF, rows, columns,
+			      const_cast<PetscScalar *> (&values[0]), &x_matrix);
+    assert ((ierr==0) && "PETSc could not wrap the multivector.");
+
+    ierr = MatCreateSeqDense (PETSC_COMM_SELF, dst.rows, columns,
+			      &dst.values[0], &product);
+    assert ((ierr==0) && "PETSc could not wrap the destination multivector.");
+
+    ierr = MatMatMult (matrix, x_matrix, MAT_REUSE_MATRIX, PETSC_DEFAULT, &product);
+    assert ((ierr==0) && "PETSc could not multiply the matrix with the multivector.");
+
+    MatDestroy (&product);
+    MatDestroy (&x_matrix);
+    (void) ierr;
+  }
+
+  void
+  MultiVector::Tmmult (dealii::FullMatrix<double> &dst,
+		       const MultiVector          &other) const
+  {
+    assert ((other.rows==rows) && "Incompatible multivector sizes.");
+
+    dst.reinit (columns, other.columns);
+    if ((rows==0) || (columns==0) || (other.columns==0))
+      return;
+
+    // BLAS works column-major, and FullMatrix is stored row-major;
+    // X^T Y is computed into a column-major array and then copied.
+    std::vector<double> product (static_cast<std::size_t> (columns) * other.columns);
+
+    const PetscBLASInt m   = columns;
+    const PetscBLASInt n   = other.columns;
+    const PetscBLASInt k   = rows;
+    const PetscScalar  one  = 1.;
+    const PetscScalar  zero = 0.;
+    BLASgemm_ ("T", "N", &m, &n, &k, &one, &values[0], &k, &other.values[0], &k, &zero, &product[0], &m);
+
+    for (unsigned int j=0; j<other.columns; ++j)
+      for (unsigned int i=0; i<columns; ++i)
+	dst (i, j) = product[static_cast<std::size_t> (j) * columns + i];
+  }
+
+  void
+  MultiVector::column_dots (std::vector<double> &dots,
+			    const MultiVector   &other) const
+  {
+    assert ((other.rows==rows) && (other.columns==columns) && "Incompatible multivector sizes.");
+
+    dots.resize (columns);
+    for (unsigned int j=0; j<columns; ++j)
+      {
+	const double *x = column (j);
+	const double *y = other.column (j);
+
+	double dot = 0.;
+	for (unsigned int i=0; i<rows; ++i)
+	  dot += x[i] * y[i];
+	dots[j] = dot;
+      }
+  }
+
+  void
+  MultiVector::add_weighted_squares (const unsigned int  first,
+				     const unsigned int  n,
+				     const double       *weights,
+				     double             *dst) const
+  {
+    assert ((first+n<=columns) && "Column range out of range.");
+
+    for (unsigned int begin=0; begin<rows; begin+=row_block_size)
+      {
+	const unsigned int end = std::min (begin+row_block_size, rows);
+	for (unsigned int j=0; j<n; ++j)
+	  {
+	    const double *x = column (first+j);
+	    const double  w = weights[j];
+	    for (unsigned int i=begin; i<end; ++i)
+	      dst[i] += w * x[i] * x[i];
+	  }
+      }
+  }
+
+  void
+  MultiVector::weighted_column_norms_square (const double        *weights,
+					     std::vector<double> &norms) const
+  {
+    norms.assign (columns, 0.);
+
+    for (unsigned int begin=0; begin<rows; begin+=row_block_size)
+      {
+	const unsigned int end = std::min (begin+row_block_size, rows);
+	for (unsigned int j=0; j<columns; ++j)
+	  {
+	    const double *x = column (j);
+	    double norm = 0.;
+	    for (unsigned int i=begin; i<end; ++i)
+	      norm += weights[i] * x[i] * x[i];
+	    norms[j] += norm;
+	  }
+      }
+  }
+
+  std::size_t
+  MultiVector::memory_consumption () const
+  {
+    return sizeof (*this) + values.capacity () * sizeof (double);
+  }
+
+} // namespace qdove
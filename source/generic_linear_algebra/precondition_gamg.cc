@@ -0,0 +1,80 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/generic_linear_algebra/precondition_gamg.h>
+
+#include <petscpc.h>
+
+#include <cassert>
+
+namespace qdove
+{
+  PreconditionGAMG::AdditionalData::AdditionalData (const bool         symmetric_operator,
+						    const unsigned int n_smoothing_steps)
+    :
+    symmetric_operator (symmetric_operator),
+    n_smoothing_steps (n_smoothing_steps)
+  {}
+
+  PreconditionGAMG::PreconditionGAMG ()
+  {}
+
+  PreconditionGAMG::PreconditionGAMG (const dealii::PETScWrappers::MatrixBase &matrix,
+				      const AdditionalData                    &additional_data)
+  {
+    initialize (matrix, additional_data);
+  }
+
+  void
+  PreconditionGAMG::initialize (const dealii::PETScWrappers::MatrixBase &matrix_,
+				const AdditionalData                    &additional_data_)
+  {
+    clear ();
+
+    matrix          = static_cast<Mat> (matrix_);
+    additional_data = additional_data_;
+
+    create_pc ();
+
+    int ierr;
+    ierr = PCSetType (pc, const_cast<char *> (PCGAMG));
+    assert ((ierr==0) && "PETSc was not configured with GAMG.");
+
+    ierr = PCGAMGSetType (pc, PCGAMGAGG);
+    assert ((ierr==0) && "Could not set aggregation multigrid.");
+
+    ierr = PCGAMGSetNSmooths (pc, additional_data.n_smoothing_steps);
+    assert ((ierr==0) && "Could not set the number of smoothing steps.");
+
+    ierr = PCGAMGSetSymGraph (pc, additional_data.symmetric_operator ? PETSC_TRUE : PETSC_FALSE);
+    assert ((ierr==0) && "Could not set the symmetry of the matrix graph.");
+
+    // Let command line options override the defaults set here.
+    ierr = PCSetFromOptions (pc);
+    assert ((ierr==0) && "Could not set preconditioner options.");
+
+    ierr = PCSetUp (pc);
+    assert ((ierr==0) && "Could not set up the multigrid hierarchy.");
+  }
+}
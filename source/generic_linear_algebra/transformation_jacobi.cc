@@ -0,0 +1,104 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/generic_linear_algebra/transformation_jacobi.h>
+
+#include <petscksp.h>
+
+#include <cassert>
+
+namespace qdove
+{
+  TransformationJacobi::TransformationJacobi (const dealii::Vector<double> &inverse_diagonal,
+					      const double                  shift)
+    :
+    inverse_diagonal (&inverse_diagonal),
+    shift (shift)
+  {}
+
+  void
+  TransformationJacobi::set_transformation_type (ST &st) const
+  {
+    int ierr;
+    ierr = STSetType (st, const_cast<char *> (STPRECOND));
+    assert ((ierr==0) && "Could not set the preconditioning transformation.");
+
+    ierr = STSetShift (st, shift);
+    assert ((ierr==0) && "Could not set the shift of the transformation.");
+
+    KSP ksp;
+    ierr = STGetKSP (st, &ksp);
+    assert ((ierr==0) && "Could not get the linear solver of the transformation.");
+
+    PC pc;
+    ierr = KSPGetPC (ksp, &pc);
+    assert ((ierr==0) && "Could not get the preconditioner of the transformation.");
+
+    ierr = PCSetType (pc, const_cast<char *> (PCSHELL));
+    assert ((ierr==0) && "Could not set a shell preconditioner.");
+
+    ierr = PCShellSetContext (pc, const_cast<dealii::Vector<double> *> (inverse_diagonal));
+    assert ((ierr==0) && "Could not set the context of the shell preconditioner.");
+
+    ierr = PCShellSetApply (pc, &TransformationJacobi::apply);
+    assert ((ierr==0) && "Could not set the shell preconditioner.");
+
+    ierr = PCShellSetName (pc, "Jacobi");
+    assert ((ierr==0) && "Could not name the shell preconditioner.");
+  }
+
+  PetscErrorCode
+  TransformationJacobi::apply (PC  pc,
+			       Vec src,
+			       Vec dst)
+  {
+    void *context;
+    PetscErrorCode ierr = PCShellGetContext (pc, &context);
+    CHKERRQ (ierr);
+
+    const dealii::Vector<double> &inverse_diagonal = *static_cast<const dealii::Vector<double> *> (context);
+
+    PetscInt size;
+    ierr = VecGetLocalSize (src, &size);
+    CHKERRQ (ierr);
+    assert ((static_cast<unsigned int> (size)==inverse_diagonal.size ()) && "Incompatible vector sizes.");
+
+    const PetscScalar *src_array;
+    PetscScalar       *dst_array;
+    ierr = VecGetArrayRead (src, &src_array);
+    CHKERRQ (ierr);
+    ierr = VecGetArray (dst, &dst_array);
+    CHKERRQ (ierr);
+
+    for (PetscInt i=0; i<size; ++i)
+      dst_array[i] = inverse_diagonal(i) * src_array[i];
+
+    ierr = VecRestoreArray (dst, &dst_array);
+    CHKERRQ (ierr);
+    ierr = VecRestoreArrayRead (src, &src_array);
+    CHKERRQ (ierr);
+
+    return 0;
+  }
+}
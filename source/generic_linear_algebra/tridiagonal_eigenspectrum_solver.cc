@@ -0,0 +1,321 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/generic_linear_algebra/tridiagonal_eigenspectrum_solver.h>
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace qdove
+{
+  /* Constructor */
+  TridiagonalEigenspectrumSolver::TridiagonalEigenspectrumSolver (const double tolerance)
+    :
+    tolerance (tolerance),
+    a_diagonal (0),
+    a_off_diagonal (0),
+    b_diagonal (0),
+    b_off_diagonal (0),
+    n_steps (0)
+  {}
+
+  void
+  TridiagonalEigenspectrumSolver::solve (const std::vector<double>           &a_diag,
+					 const std::vector<double>           &a_off_diag,
+					 const std::vector<double>           &b_diag,
+					 const std::vector<double>           &b_off_diag,
+					 std::vector<double>                 &values,
+					 std::vector<std::vector<double> >   &vectors,
+					 const unsigned int                   n_eigenpairs)
+  {
+    const unsigned int n = a_diag.size ();
+    assert ((n>0) && (n_eigenpairs<=n) && "Too many eigenpairs requested.");
+    assert ((b_diag.size ()==n) && (a_off_diag.size ()+1==n) && (b_off_diag.size ()+1==n) &&
+	    "Incompatible vector sizes.");
+
+    a_diagonal     = &a_diag;
+    a_off_diagonal = &a_off_diag;
+    b_diagonal     = &b_diag;
+    b_off_diagonal = &b_off_diag;
+    n_steps        = 0;
+
+    // The Rayleigh quotient of a unit vector is an upper bound of the
+    // lowest eigenvalue, and the spread of the Rayleigh quotients
+    // gives a scale of the spectrum.
+    double min_ratio = a_diag[0]/b_diag[0];
+    double max_ratio = min_ratio;
+    for (unsigned int i=1; i<n; ++i)
+      {
+	min_ratio = std::min (min_ratio, a_diag[i]/b_diag[i]);
+	max_ratio = std::max (max_ratio, a_diag[i]/b_diag[i]);
+      }
+
+    double scale = std::max (max_ratio-min_ratio, std::max (std::fabs (min_ratio), std::fabs (max_ratio)));
+    if (scale==0)
+      scale = 1.;
+
+    // Find an interval that contains the lowest n_eigenpairs
+    // eigenvalues by expanding around the smallest quotient.
+    double lower_bound = min_ratio;
+    for (double step=scale; count_eigenvalues_below (lower_bound)>0; step*=2.)
+      lower_bound -= step;
+
+    double upper_bound = min_ratio;
+    for (double step=scale; count_eigenvalues_below (upper_bound)<n_eigenpairs; step*=2.)
+      upper_bound += step;
+
+    // Bisection for each eigenvalue. Eigenvalue j lies in the
+    // interval where the Sturm count passes from j to j+1. The left
+    // end of the last interval is a lower bound for the next
+    // eigenvalue.
+    values.resize (n_eigenpairs);
+    double left = lower_bound;
+    for (unsigned int j=0; j<n_eigenpairs; ++j)
+      {
+	double right = upper_bound;
+
+	while ((right-left) > tolerance * std::max (std::fabs (left), std::fabs (right)))
+	  {
+	    const double middle = 0.5 * (left+right);
+
+	    // The interval cannot be split any further
+	    if ((middle<=left) || (middle>=right))
+	      break;
+
+	    if (count_eigenvalues_below (middle)>j)
+	      right = middle;
+	    else
+	      left = middle;
+
+	    ++n_steps;
+	  }
+
+	values[j] = 0.5 * (left+right);
+      }
+
+    // Eigenvectors by inverse iteration. Eigenvectors to (nearly)
+    // degenerate eigenvalues are made B-orthogonal to each other,
+    // since inverse iteration alone does not separate them.
+    const double cluster_tolerance 
+      = 1e-3 * std::max (std::fabs (values[0]), std::fabs (values[n_eigenpairs-1]));
+
+    std::vector<double> b_vector (n);
+
+    vectors.resize (n_eigenpairs);
+    for (unsigned int j=0; j<n_eigenpairs; ++j)
+      {
+	// A starting vector that is unlikely to be orthogonal to the
+	// eigenvector.
+	vectors[j].resize (n);
+	for (unsigned int i=0; i<n; ++i)
+	  vectors[j][i] = 1. + (i%7) / 7.;
+
+	inverse_iteration (values[j], vectors[j]);
+
+	for (unsigned int k=0; k<j; ++k)
+	  if (values[j]-values[k] < cluster_tolerance)
+	    {
+	      vmult_b (b_vector, vectors[k]);
+
+	      double projection = 0.;
+	      for (unsigned int i=0; i<n; ++i)
+		projection += vectors[j][i] * b_vector[i];
+
+	      for (unsigned int i=0; i<n; ++i)
+		vectors[j][i] -= projection * vectors[k][i];
+
+	      // Polish the orthogonalised vector once more.
+	      inverse_iteration (values[j], vectors[j]);
+	    }
+      }
+  }
+
+  unsigned int
+  TridiagonalEigenspectrumSolver::last_step () const
+  {
+    return n_steps;
+  }
+
+  unsigned int
+  TridiagonalEigenspectrumSolver::count_eigenvalues_below (const double sigma) const
+  {
+    const std::vector<double> &a  = *a_diagonal;
+    const std::vector<double> &ae = *a_off_diagonal;
+    const std::vector<double> &b  = *b_diagonal;
+    const std::vector<double> &be = *b_off_diagonal;
+
+    // Pivots of the LDL^T factorisation of A-sigma*B. A vanishing
+    // pivot is replaced by a tiny negative number, as in LAPACK.
+    const double tiny = std::numeric_limits<double>::min ();
+
+    unsigned int count = 0;
+
+    double pivot = a[0] - sigma*b[0];
+    if (pivot==0)
+      pivot = -tiny;
+    if (pivot<0)
+      ++count;
+
+    for (unsigned int i=1; i<a.size (); ++i)
+      {
+	const double off_diagonal = ae[i-1] - sigma*be[i-1];
+	pivot = (a[i] - sigma*b[i]) - off_diagonal*off_diagonal/pivot;
+
+	if (pivot==0)
+	  pivot = -tiny;
+	if (pivot<0)
+	  ++count;
+      }
+
+    return count;
+  }
+
+  void
+  TridiagonalEigenspectrumSolver::inverse_iteration (const double         lambda,
+						     std::vector<double> &vector)
+  {
+    const std::vector<double> &a  = *a_diagonal;
+    const std::vector<double> &ae = *a_off_diagonal;
+    const std::vector<double> &b  = *b_diagonal;
+    const std::vector<double> &be = *b_off_diagonal;
+
+    const unsigned int n = a.size ();
+
+    // Factorise A-lambda*B with partial pivoting (as LAPACK's
+    // dgttrf). The matrix is symmetric, so the lower and upper bands
+    // start out equal.
+    lower.resize (n);
+    diagonal.resize (n);
+    upper.resize (n);
+    upper_2.assign (n, 0.);
+    pivoted.assign (n, false);
+
+    double norm = 0.;
+    for (unsigned int i=0; i<n; ++i)
+      {
+	diagonal[i] = a[i] - lambda*b[i];
+	norm = std::max (norm, std::fabs (diagonal[i]));
+      }
+    for (unsigned int i=0; i+1<n; ++i)
+      {
+	lower[i] = upper[i] = ae[i] - lambda*be[i];
+	norm = std::max (norm, std::fabs (lower[i]));
+      }
+
+    for (unsigned int i=0; i+1<n; ++i)
+      {
+	if (std::fabs (diagonal[i]) >= std::fabs (lower[i]))
+	  {
+	    // No row interchange
+	    if (diagonal[i]!=0)
+	      {
+		const double factor = lower[i] / diagonal[i];
+		lower[i] = factor;
+		diagonal[i+1] -= factor*upper[i];
+	      }
+	  }
+	else
+	  {
+	    // Interchange rows i and i+1
+	    const double factor = diagonal[i] / lower[i];
+	    diagonal[i] = lower[i];
+	    lower[i] = factor;
+	    const double tmp = upper[i];
+	    upper[i] = diagonal[i+1];
+	    diagonal[i+1] = tmp - factor*diagonal[i+1];
+	    if (i+2<n)
+	      {
+		upper_2[i] = upper[i+1];
+		upper[i+1] = -factor*upper[i+1];
+	      }
+	    pivoted[i] = true;
+	  }
+      }
+
+    // The shift is an eigenvalue to machine precision, so a pivot may
+    // vanish. Perturb it, which is harmless for inverse iteration.
+    const double pivot_minimum = std::max (norm, 1.) * std::numeric_limits<double>::epsilon ();
+    for (unsigned int i=0; i<n; ++i)
+      if (std::fabs (diagonal[i]) < pivot_minimum)
+	diagonal[i] = (diagonal[i]<0) ? -pivot_minimum : pivot_minimum;
+
+    // Three steps suffice, since the shift is an eigenvalue to working
+    // accuracy.
+    std::vector<double> rhs (n);
+    for (unsigned int step=0; step<3; ++step)
+      {
+	vmult_b (rhs, vector);
+
+	// Solve L*y = B*x
+	for (unsigned int i=0; i+1<n; ++i)
+	  if (!pivoted[i])
+	    rhs[i+1] -= lower[i]*rhs[i];
+	  else
+	    {
+	      const double tmp = rhs[i];
+	      rhs[i]   = rhs[i+1];
+	      rhs[i+1] = tmp - lower[i]*rhs[i];
+	    }
+
+	// Solve U*x = y
+	rhs[n-1] /= diagonal[n-1];
+	if (n>1)
+	  rhs[n-2] = (rhs[n-2] - upper[n-2]*rhs[n-1]) / diagonal[n-2];
+	for (int i=n-3; i>=0; --i)
+	  rhs[i] = (rhs[i] - upper[i]*rhs[i+1] - upper_2[i]*rhs[i+2]) / diagonal[i];
+
+	// Normalise such that x^T B x = 1
+	vmult_b (vector, rhs);
+	double norm_square = 0.;
+	for (unsigned int i=0; i<n; ++i)
+	  norm_square += rhs[i] * vector[i];
+
+	const double factor = 1./std::sqrt (norm_square);
+	for (unsigned int i=0; i<n; ++i)
+	  vector[i] = factor * rhs[i];
+      }
+  }
+
+  void
+  TridiagonalEigenspectrumSolver::vmult_b (std::vector<double>       &dst,
+					   const std::vector<double> &src) const
+  {
+    const std::vector<double> &b  = *b_diagonal;
+    const std::vector<double> &be = *b_off_diagonal;
+
+    const unsigned int n = b.size ();
+    dst.resize (n);
+
+    for (unsigned int i=0; i<n; ++i)
+      dst[i] = b[i]*src[i];
+
+    for (unsigned int i=0; i+1<n; ++i)
+      {
+	dst[i]   += be[i]*src[i+1];
+	dst[i+1] += be[i]*src[i];
+      }
+  }
+}
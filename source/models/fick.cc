@@ -102,19 +102,17 @@ namespace qdove
     Solution<dim>::value (const dealii::Point<dim> &point,
                           const unsigned int        component) const
     {
-      switch (dim)
-      {
-      case 1:
-        // Simplified solution to Fick's laws 1d.
-        if (profile_is_symmetric)
-          return height * 0.5 * ( std::erf ((length-point[0]) / rate) + std::erf ((length+point[0]) / rate) );
-        else
-          return height * 0.5 * ( 1.0 + std::erf ((point[0]-length) / rate) );
-        break;
-
-      default:
-        assert (false && "Not implemented yet");
-      }
+      // Diffusion is separable in Cartesian coordinates, so the
+      // solution for a box (a wire in 2d, a dot in 3d) is the
+      // product of the 1d solutions in each direction. A single
+      // transition is a plane normal to the x-axis.
+      if (!profile_is_symmetric)
+        return height * 0.5 * ( 1.0 + std::erf ((point[0]-length) / rate) );
+
+      double value = height;
+      for (unsigned int d=0; d<dim; ++d)
+        value *= 0.5 * ( std::erf ((length-point[d]) / rate) + std::erf ((length+point[d]) / rate) );
+      return value;
     }
 
     template <int dim>
@@ -0,0 +1,496 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/models/hamiltonian_operator.h>
+
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/utilities.h>
+#include <deal.II/matrix_free/fe_evaluation.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace qdove
+{
+
+  namespace Schroedinger
+  {
+
+    template <int dim, int fe_degree>
+    OverlapOperator<dim,fe_degree>::OverlapOperator ()
+      :
+      dealii::PETScWrappers::MatrixFree (),
+      matrix_free (0)
+    {}
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::reinit (const dealii::MatrixFree<dim,double> &matrix_free_data,
+					    const unsigned int                    n_dofs)
+    {
+      matrix_free = &matrix_free_data;
+
+      dealii::PETScWrappers::MatrixFree::reinit (n_dofs, n_dofs);
+
+      src_values.reinit (n_dofs);
+      dst_values.reinit (n_dofs);
+
+      // Compute the diagonal by applying the cell operator to local
+      // unit vectors. Constrained entries are not written to and
+      // stay zero.
+      dealii::FEEvaluation<dim,fe_degree,fe_degree+1,1,double> phi (*matrix_free);
+      std::vector<dealii::VectorizedArray<double> > local_diagonal (phi.dofs_per_cell);
+
+      overlap_diagonal.reinit (n_dofs);
+      for (unsigned int cell=0; cell<matrix_free->n_macro_cells (); ++cell)
+	{
+	  phi.reinit (cell);
+
+	  for (unsigned int i=0; i<phi.dofs_per_cell; ++i)
+	    {
+	      for (unsigned int j=0; j<phi.dofs_per_cell; ++j)
+		phi.submit_dof_value (dealii::make_vectorized_array ((i==j) ? 1. : 0.), j);
+
+	      phi.evaluate (true, false, false);
+	      for (unsigned int q_point=0; q_point<phi.n_q_points; ++q_point)
+		phi.submit_value (phi.get_value (q_point), q_point);
+	      phi.integrate (true, false);
+
+	      local_diagonal[i] = phi.get_dof_value (i);
+	    }
+
+	  for (unsigned int i=0; i<phi.dofs_per_cell; ++i)
+	    phi.submit_dof_value (local_diagonal[i], i);
+	  phi.distribute_local_to_global (overlap_diagonal);
+	}
+    }
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::vmult (dealii::PETScWrappers::VectorBase       &dst,
+					   const dealii::PETScWrappers::VectorBase &src) const
+    {
+      dst = 0;
+      vmult_add (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::Tvmult (dealii::PETScWrappers::VectorBase       &dst,
+					    const dealii::PETScWrappers::VectorBase &src) const
+    {
+      vmult (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::Tvmult_add (dealii::PETScWrappers::VectorBase       &dst,
+						const dealii::PETScWrappers::VectorBase &src) const
+    {
+      vmult_add (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::vmult_add (dealii::PETScWrappers::VectorBase       &dst,
+					       const dealii::PETScWrappers::VectorBase &src) const
+    {
+      assert ((matrix_free!=0) && "The operator has not been initialised.");
+
+      const unsigned int n_dofs = overlap_diagonal.size ();
+      assert ((src.size ()==n_dofs) && (dst.size ()==n_dofs) && "Incompatible vector sizes.");
+
+      // Work on the raw arrays of the PETSc vectors.
+      Vec src_vector = src;
+      Vec dst_vector = dst;
+
+      const PetscScalar *src_array;
+      PetscScalar       *dst_array;
+      VecGetArrayRead (src_vector, &src_array);
+      VecGetArray (dst_vector, &dst_array);
+
+      std::copy (src_array, src_array+n_dofs, src_values.begin ());
+
+      dst_values = 0;
+      matrix_free->cell_loop (&OverlapOperator<dim,fe_degree>::local_apply, this, dst_values, src_values);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	if (overlap_diagonal(i)!=0)
+	  dst_array[i] += dst_values(i);
+	else
+	  dst_array[i] += src_array[i];
+
+      VecRestoreArray (dst_vector, &dst_array);
+      VecRestoreArrayRead (src_vector, &src_array);
+    }
+
+    template <int dim, int fe_degree>
+    const dealii::Vector<double> &
+    OverlapOperator<dim,fe_degree>::diagonal () const
+    {
+      return overlap_diagonal;
+    }
+
+    template <int dim, int fe_degree>
+    std::size_t
+    OverlapOperator<dim,fe_degree>::memory_consumption () const
+    {
+      return (overlap_diagonal.memory_consumption () +
+	      src_values.memory_consumption ()       +
+	      dst_values.memory_consumption ());
+    }
+
+    template <int dim, int fe_degree>
+    void
+    OverlapOperator<dim,fe_degree>::local_apply (const dealii::MatrixFree<dim,double>       &data,
+						 dealii::Vector<double>                     &dst,
+						 const dealii::Vector<double>               &src,
+						 const std::pair<unsigned int,unsigned int> &cell_range) const
+    {
+      dealii::FEEvaluation<dim,fe_degree,fe_degree+1,1,double> phi (data);
+
+      for (unsigned int cell=cell_range.first; cell<cell_range.second; ++cell)
+	{
+	  phi.reinit (cell);
+	  phi.read_dof_values (src);
+	  phi.evaluate (true, false, false);
+
+	  for (unsigned int q_point=0; q_point<phi.n_q_points; ++q_point)
+	    phi.submit_value (phi.get_value (q_point), q_point);
+
+	  phi.integrate (true, false);
+	  phi.distribute_local_to_global (dst);
+	}
+    }
+
+    template <int dim, int fe_degree>
+    HamiltonianOperator<dim,fe_degree>::HamiltonianOperator ()
+      :
+      dealii::PETScWrappers::MatrixFree (),
+      constrained_diagonal (1.)
+    {}
+
+    // Setup the matrix-free data
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::reinit (const dealii::DoFHandler<dim>  &dof_handler,
+						const dealii::ConstraintMatrix &constraints)
+    {
+      typename dealii::MatrixFree<dim,double>::AdditionalData additional_data;
+      additional_data.tasks_parallel_scheme = dealii::MatrixFree<dim,double>::AdditionalData::none;
+      additional_data.mapping_update_flags  = (dealii::update_values    |
+					       dealii::update_gradients |
+					       dealii::update_JxW_values);
+
+      matrix_free.reinit (dof_handler, constraints, dealii::QGauss<1> (fe_degree+1), additional_data);
+
+      dealii::PETScWrappers::MatrixFree::reinit (dof_handler.n_dofs (), dof_handler.n_dofs ());
+
+      src_values.reinit (dof_handler.n_dofs ());
+      dst_values.reinit (dof_handler.n_dofs ());
+
+      // Coefficients from an old mesh are useless.
+      ke_coefficient.reinit (0, 0);
+      pe_coefficient.reinit (0, 0);
+
+      overlap.reinit (matrix_free, dof_handler.n_dofs ());
+      hamiltonian_diagonal.reinit (0);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::set_kinetic_energy (const dealii::Vector<double> &ke_function)
+    {
+      evaluate_coefficient (ke_function, ke_coefficient);
+      compute_diagonal ();
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::set_potential_energy (const dealii::Vector<double> &pe_function)
+    {
+      evaluate_coefficient (pe_function, pe_coefficient);
+      compute_diagonal ();
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::set_kinetic_energy (const qdove::QuadratureField<dim> &ke_field)
+    {
+      evaluate_coefficient (ke_field, ke_coefficient);
+      compute_diagonal ();
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::set_potential_energy (const qdove::QuadratureField<dim> &pe_field)
+    {
+      evaluate_coefficient (pe_field, pe_coefficient);
+      compute_diagonal ();
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::vmult (dealii::PETScWrappers::VectorBase       &dst,
+					       const dealii::PETScWrappers::VectorBase &src) const
+    {
+      dst = 0;
+      vmult_add (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::Tvmult (dealii::PETScWrappers::VectorBase       &dst,
+						const dealii::PETScWrappers::VectorBase &src) const
+    {
+      vmult (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::Tvmult_add (dealii::PETScWrappers::VectorBase       &dst,
+						    const dealii::PETScWrappers::VectorBase &src) const
+    {
+      vmult_add (dst, src);
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::vmult_add (dealii::PETScWrappers::VectorBase       &dst,
+						   const dealii::PETScWrappers::VectorBase &src) const
+    {
+      assert ((ke_coefficient.n_elements ()!=0) && (pe_coefficient.n_elements ()!=0) &&
+	      "The kinetic and potential energy functions have not been set.");
+
+      const dealii::Vector<double> &overlap_diagonal = overlap.diagonal ();
+
+      const unsigned int n_dofs = overlap_diagonal.size ();
+      assert ((src.size ()==n_dofs) && (dst.size ()==n_dofs) && "Incompatible vector sizes.");
+
+      // Work on the raw arrays of the PETSc vectors.
+      Vec src_vector = src;
+      Vec dst_vector = dst;
+
+      const PetscScalar *src_array;
+      PetscScalar       *dst_array;
+      VecGetArrayRead (src_vector, &src_array);
+      VecGetArray (dst_vector, &dst_array);
+
+      std::copy (src_array, src_array+n_dofs, src_values.begin ());
+
+      dst_values = 0;
+      matrix_free.cell_loop (&HamiltonianOperator<dim,fe_degree>::local_apply, this, dst_values, src_values);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	if (overlap_diagonal(i)!=0)
+	  dst_array[i] += dst_values(i);
+	else
+	  dst_array[i] += constrained_diagonal * src_array[i];
+
+      VecRestoreArray (dst_vector, &dst_array);
+      VecRestoreArrayRead (src_vector, &src_array);
+    }
+
+    template <int dim, int fe_degree>
+    const OverlapOperator<dim,fe_degree> &
+    HamiltonianOperator<dim,fe_degree>::overlap_operator () const
+    {
+      return overlap;
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::compute_inverse_diagonal (const double            shift,
+								  dealii::Vector<double> &inverse_diagonal) const
+    {
+      assert ((hamiltonian_diagonal.size ()!=0) &&
+	      "The kinetic and potential energy functions have not been set.");
+
+      const dealii::Vector<double> &overlap_diagonal = overlap.diagonal ();
+
+      // The shift lies below the states of interest, so the
+      // diagonal is positive; its absolute value only guards
+      // against a shift set too high.
+      inverse_diagonal.reinit (overlap_diagonal.size ());
+      for (unsigned int i=0; i<overlap_diagonal.size (); ++i)
+	{
+	  const double value = (overlap_diagonal(i)!=0)
+	    ? hamiltonian_diagonal(i) - shift * overlap_diagonal(i)
+	    : constrained_diagonal - shift;
+
+	  inverse_diagonal(i) = (value!=0) ? 1./std::fabs (value) : 1.;
+	}
+    }
+
+    template <int dim, int fe_degree>
+    std::size_t
+    HamiltonianOperator<dim,fe_degree>::memory_consumption () const
+    {
+      return (matrix_free.memory_consumption ()           +
+	      ke_coefficient.memory_consumption ()        +
+	      pe_coefficient.memory_consumption ()        +
+	      overlap.memory_consumption ()               +
+	      hamiltonian_diagonal.memory_consumption ()  +
+	      src_values.memory_consumption ()            +
+	      dst_values.memory_consumption ());
+    }
+
+    // Application of the Hamiltonian on a range of cells with sum
+    // factorisation.
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::local_apply (const dealii::MatrixFree<dim,double>       &data,
+						     dealii::Vector<double>                     &dst,
+						     const dealii::Vector<double>               &src,
+						     const std::pair<unsigned int,unsigned int> &cell_range) const
+    {
+      dealii::FEEvaluation<dim,fe_degree,fe_degree+1,1,double> phi (data);
+
+      for (unsigned int cell=cell_range.first; cell<cell_range.second; ++cell)
+	{
+	  phi.reinit (cell);
+	  phi.read_dof_values (src);
+	  phi.evaluate (true, true, false);
+
+	  for (unsigned int q_point=0; q_point<phi.n_q_points; ++q_point)
+	    {
+	      phi.submit_value (pe_coefficient(cell,q_point) * phi.get_value (q_point), q_point);
+	      phi.submit_gradient (ke_coefficient(cell,q_point) * phi.get_gradient (q_point), q_point);
+	    }
+
+	  phi.integrate (true, true);
+	  phi.distribute_local_to_global (dst);
+	}
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::evaluate_coefficient (const dealii::Vector<double>                        &function,
+							      dealii::Table<2, dealii::VectorizedArray<double> > &coefficient) const
+    {
+      assert ((function.size ()==src_values.size ()) && "Incompatible vector sizes.");
+
+      dealii::FEEvaluation<dim,fe_degree,fe_degree+1,1,double> phi (matrix_free);
+
+      const unsigned int n_cells = matrix_free.n_macro_cells ();
+      coefficient.reinit (n_cells, phi.n_q_points);
+
+      // Read values without applying constraints; the function does
+      // not vanish on the boundary.
+      for (unsigned int cell=0; cell<n_cells; ++cell)
+	{
+	  phi.reinit (cell);
+	  phi.read_dof_values_plain (function);
+	  phi.evaluate (true, false, false);
+
+	  for (unsigned int q_point=0; q_point<phi.n_q_points; ++q_point)
+	    coefficient(cell,q_point) = phi.get_value (q_point);
+	}
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::evaluate_coefficient (const qdove::QuadratureField<dim>                   &field,
+							      dealii::Table<2, dealii::VectorizedArray<double> > &coefficient) const
+    {
+      const unsigned int n_q_points = dealii::Utilities::fixed_power<dim> (fe_degree+1);
+      assert ((field.n_q_points ()==n_q_points) &&
+	      "The field does not match the quadrature formula of the operator.");
+
+      const unsigned int n_cells = matrix_free.n_macro_cells ();
+      coefficient.reinit (n_cells, n_q_points);
+
+      // Each batch holds several cells, one per vector lane. Unused
+      // lanes are never written back, so their values do not matter.
+      for (unsigned int cell=0; cell<n_cells; ++cell)
+	for (unsigned int v=0; v<matrix_free.n_components_filled (cell); ++v)
+	  {
+	    const double *values = field.cell_values (matrix_free.get_cell_iterator (cell, v));
+	    for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	      coefficient(cell,q_point)[v] = values[q_point];
+	  }
+    }
+
+    template <int dim, int fe_degree>
+    void
+    HamiltonianOperator<dim,fe_degree>::compute_diagonal ()
+    {
+      if ((ke_coefficient.n_elements ()==0) || (pe_coefficient.n_elements ()==0))
+	return;
+
+      dealii::FEEvaluation<dim,fe_degree,fe_degree+1,1,double> phi (matrix_free);
+
+      // Compute the diagonal of the Hamiltonian by applying the cell
+      // operator to local unit vectors.
+      hamiltonian_diagonal.reinit (src_values.size ());
+      std::vector<dealii::VectorizedArray<double> > local_diagonal (phi.dofs_per_cell);
+
+      for (unsigned int cell=0; cell<matrix_free.n_macro_cells (); ++cell)
+	{
+	  phi.reinit (cell);
+
+	  for (unsigned int i=0; i<phi.dofs_per_cell; ++i)
+	    {
+	      for (unsigned int j=0; j<phi.dofs_per_cell; ++j)
+		phi.submit_dof_value (dealii::make_vectorized_array ((i==j) ? 1. : 0.), j);
+
+	      phi.evaluate (true, true, false);
+	      for (unsigned int q_point=0; q_point<phi.n_q_points; ++q_point)
+		{
+		  phi.submit_value (pe_coefficient(cell,q_point) * phi.get_value (q_point), q_point);
+		  phi.submit_gradient (ke_coefficient(cell,q_point) * phi.get_gradient (q_point), q_point);
+		}
+	      phi.integrate (true, true);
+
+	      local_diagonal[i] = phi.get_dof_value (i);
+	    }
+
+	  for (unsigned int i=0; i<phi.dofs_per_cell; ++i)
+	    phi.submit_dof_value (local_diagonal[i], i);
+	  phi.distribute_local_to_global (hamiltonian_diagonal);
+	}
+
+      // A constrained row has the eigenvalue constrained_diagonal,
+      // since its overlap row is the identity. The largest ratio
+      // H_ii/M_ii is the Rayleigh quotient of a single shape function,
+      // which lies above the low-lying states the solver targets,
+      // so twice that ratio puts the spurious eigenvalues above them
+      // too. It need not bound the largest eigenvalue of the
+      // operator.
+      const dealii::Vector<double> &overlap_diagonal = overlap.diagonal ();
+
+      double max_diagonal = 0.;
+      for (unsigned int i=0; i<hamiltonian_diagonal.size (); ++i)
+	if (overlap_diagonal(i)!=0)
+	  max_diagonal = std::max (max_diagonal,
+				   std::fabs (hamiltonian_diagonal(i)) / overlap_diagonal(i));
+
+      constrained_diagonal = (max_diagonal>0) ? 2.*max_diagonal : 1.;
+    }
+
+  } // namespace Schroedinger
+
+} // namespace qdove
+
+#include "hamiltonian_operator.inst"
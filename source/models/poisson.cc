@@ -23,10 +23,19 @@
 */
 
 #include <qdove/models/poisson.h>
+#include <qdove/generic_linear_algebra/precondition_gamg.h>
+#include <qdove/models/cell_kernel.h>
+#include <qdove/base/profiler.h>
 
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/lac/compressed_sparsity_pattern.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/work_stream.h>
+#include <deal.II/base/std_cxx1x/bind.h>
 #include <deal.II/fe/fe_values.h>
+#include <deal.II/grid/filtered_iterator.h>
+
+#include <algorithm>
 
 namespace qdove
 {
@@ -37,7 +46,12 @@ namespace qdove
     template <int dim>
     Problem<dim>::Problem ()
       :
-      init (false)
+      init (false),
+      dof_revision (0),
+      preallocation_memory_saved (0),
+      preconditioner_type (BlockJacobi),
+      stiffness_is_assembled (false),
+      preconditioner_is_initialised (false)
     {}
     
     template <int dim>
@@ -46,7 +60,12 @@ namespace qdove
       :
       trial_space (&trial),
       test_space (&test),
-      init (false)
+      init (false),
+      dof_revision (0),
+      preallocation_memory_saved (0),
+      preconditioner_type (BlockJacobi),
+      stiffness_is_assembled (false),
+      preconditioner_is_initialised (false)
     {}
     
     template <int dim>
@@ -58,27 +77,74 @@ namespace qdove
     void 
       Problem<dim>::reinit ()
     {
+      qdove::Profiler::Scope profiler_scope ("Poisson::reinit");
+
       // distribute degrees of freedom on the finite element space
-      test_space->dofs ().distribute_dofs (test_space->fe ());
+      // (only if the mesh has changed)
+      test_space->distribute_dofs ();
 
-      // Initialise system matrices and vectors.
-      system_matrix.reinit (test_space->n_dofs (),
-			    test_space->n_dofs (),
-			    test_space->max_couplings_between_dofs ());
-      
-      system_vector.reinit (test_space->n_dofs ());
-      
-      solution_vector.reinit (test_space->n_dofs ());
-      
-      // Initialise boundary constraints
+      // If the layout of degrees of freedom is the same as it was the
+      // last time round, matrices, vectors and constraints can all be
+      // kept. Only the system vector is zeroed: the stiffness matrix
+      // and its preconditioner remain valid for the next assemble(),
+      // and the last solution is the initial guess of the next
+      // solve().
+      if (init && (dof_revision==test_space->dof_revision ()))
+	{
+	  system_vector = 0;
+	  return;
+	}
+
+      // Initialise hanging node and boundary constraints; there are
+      // hanging nodes once the mesh has been refined adaptively in
+      // more than one dimension.
       constraints.clear ();
+      dealii::DoFTools::make_hanging_node_constraints (test_space->dofs (), constraints);
       dealii::DoFTools::make_zero_boundary_constraints (test_space->dofs (), constraints);
       constraints.close ();
+
+      // Build the exact sparsity pattern; constrained entries are
+      // never written to, so they are left out.
+      dealii::CompressedSparsityPattern sparsity_pattern (test_space->n_dofs ());
+      dealii::DoFTools::make_sparsity_pattern (test_space->dofs (), sparsity_pattern, constraints, false);
+
+      // Initialise system matrices and vectors, with the rows of
+      // each subdomain on its process.
+      const MPI_Comm mpi_communicator = test_space->mpi_communicator ();
+      const std::vector<dealii::types::global_dof_index> &dofs_per_process
+	= test_space->n_locally_owned_dofs_per_process ();
+
+      system_matrix.reinit (mpi_communicator, sparsity_pattern,
+			    dofs_per_process, dofs_per_process,
+			    test_space->this_mpi_process ());
+      stiffness_is_assembled        = false;
+      preconditioner_is_initialised = false;
+      
+      system_vector.reinit (mpi_communicator, test_space->n_dofs (), test_space->n_locally_owned_dofs ());
+      
+      solution_vector.reinit (mpi_communicator, test_space->n_dofs (), test_space->n_locally_owned_dofs ());
+      localized_solution_vector.reinit (test_space->n_dofs ());
+
+      // Record how much memory the exact pattern saves compared to
+      // preallocating max_couplings_between_dofs() entries per row.
+      const std::size_t n_estimated_entries
+	= static_cast<std::size_t> (test_space->n_dofs ()) * test_space->max_couplings_between_dofs ();
+      preallocation_memory_saved
+	= (n_estimated_entries - sparsity_pattern.n_nonzero_elements ())
+	* (sizeof (PetscScalar) + sizeof (PetscInt));
+
+      dof_revision = test_space->dof_revision ();
       
       init = true;
+
+      qdove::Profiler::add_bytes ("Poisson::reinit",
+				  system_matrix.memory_consumption ()   +
+				  system_vector.memory_consumption ()   +
+				  solution_vector.memory_consumption () +
+				  localized_solution_vector.memory_consumption ());
     }
     
-    // Simple CG solver
+    // Assembly
     template <int dim>
     void 
       Problem<dim>::assemble (const dealii::PETScWrappers::Vector &rhs_function)
@@ -86,104 +152,397 @@ namespace qdove
       // assert (false && "Pure virtual function called...   :-|");
       assert (init==true && "Problem has not been initialised");
       assert ((rhs_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
-      
-      dealii::QGauss<dim> quadrature_formula (2);
-      dealii::FEValues<dim> fe_values (test_space->fe (), quadrature_formula,
-				       dealii::update_values            |
-				       dealii::update_gradients         |
-				       dealii::update_quadrature_points |
-				       dealii::update_JxW_values);
-      
-      const unsigned int dofs_per_cell = test_space->n_dofs_per_cell ();
-      const unsigned int n_q_points    = quadrature_formula.size ();
 
-      std::vector<unsigned int> local_dof_indices (dofs_per_cell);
+      // Worker threads read the function from a local copy, since
+      // reading PETSc vectors is not thread-safe.
+      const dealii::Vector<double> local_rhs_function (rhs_function);
 
-      // cell-wise representation of a system of equations
-      dealii::FullMatrix<double> cell_system (dofs_per_cell, dofs_per_cell);
-      dealii::Vector<double>     cell_rhs (dofs_per_cell);
+      // The stiffness matrix does not depend on the right-hand-side
+      // function, so if it is already there only the right-hand-side
+      // vector is assembled.
+      if (stiffness_is_assembled)
+	{
+	  assemble_system (&local_rhs_function, NULL, NULL, true);
+	  return;
+	}
 
-      // cell-wise representation of the function
-      std::vector<double> cell_rhs_function (n_q_points);
+      system_matrix = 0;
+      assemble_system (&local_rhs_function, NULL, NULL, false);
+      stiffness_is_assembled        = true;
+      preconditioner_is_initialised = false;
+    }
 
-      typename dealii::DoFHandler<dim>::active_cell_iterator
-       	cell = test_space->dofs ().begin_active (),
-       	endc = test_space->dofs ().end();
+    // Assembly from a right-hand-side function at quadrature points
+    template <int dim>
+    void 
+      Problem<dim>::assemble (const qdove::QuadratureField<dim> &rhs_field)
+    {
+      assert (init==true && "Problem has not been initialised");
+      assert ((rhs_field.n_q_points ()==test_space->quadrature ().size ()) &&
+	      "The field does not match the quadrature formula of the test space.");
+      assert ((rhs_field.dof_revision ()==test_space->dof_revision ()) &&
+	      "The field was set up on another mesh.");
 
-      // assemble matrices cell-wise
-      for (; cell!=endc; ++cell)
+      if (stiffness_is_assembled)
 	{
-	  cell_system = 0;
-	  cell_rhs    = 0;
-	  fe_values.reinit (cell);
+	  assemble_system (NULL, &rhs_field, NULL, true);
+	  return;
+	}
+
+      system_matrix = 0;
+      assemble_system (NULL, &rhs_field, NULL, false);
+      stiffness_is_assembled        = true;
+      preconditioner_is_initialised = false;
+    }
+
+    // Assembly with a reaction term
+    template <int dim>
+    void 
+      Problem<dim>::assemble (const dealii::PETScWrappers::Vector &rhs_function,
+			      const dealii::PETScWrappers::Vector &reaction_function)
+    {
+      assert (init==true && "Problem has not been initialised");
+      assert ((rhs_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
+      assert ((reaction_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
+
+      const dealii::Vector<double> local_rhs_function (rhs_function);
+      const dealii::Vector<double> local_reaction_function (reaction_function);
+
+      // The reaction term changes the system matrix, so it is
+      // assembled from scratch and the stiffness matrix has to be
+      // reassembled by the next call to assemble(rhs_function).
+      system_matrix = 0;
+      assemble_system (&local_rhs_function, NULL, &local_reaction_function, false);
+      stiffness_is_assembled        = false;
+      preconditioner_is_initialised = false;
+    }
+
+    template <int dim>
+    void 
+      Problem<dim>::assemble_system (const dealii::Vector<double>      *rhs_function,
+				     const qdove::QuadratureField<dim> *rhs_field,
+				     const dealii::Vector<double>      *reaction_function,
+				     const bool                         rhs_only)
+    {
+      qdove::Profiler::Scope profiler_scope ("Poisson::assemble");
+
+      // Assemble matrices cell-wise on all available threads, on the
+      // cells of the subdomain of this process. Local contributions
+      // are copied to the global objects in the order of cells, so
+      // the result is the same as that of a serial loop. Entries in
+      // rows of other processes are sent to them by compress().
+      typedef dealii::FilteredIterator<typename dealii::DoFHandler<dim>::active_cell_iterator> CellFilter;
+      const dealii::IteratorFilters::SubdomainEqualTo subdomain_filter (test_space->this_mpi_process ());
+
+      const dealii::QGauss<dim> quadrature_formula = test_space->quadrature ();
+      dealii::WorkStream::
+	run (CellFilter (subdomain_filter, test_space->dofs ().begin_active ()),
+	     CellFilter (subdomain_filter, test_space->dofs ().end ()),
+	     dealii::std_cxx1x::bind (&Problem<dim>::local_assemble, this,
+				      dealii::std_cxx1x::_1, dealii::std_cxx1x::_2, dealii::std_cxx1x::_3),
+	     dealii::std_cxx1x::bind (&Problem<dim>::copy_local_to_global, this,
+				      dealii::std_cxx1x::_1),
+	     AssemblyScratchData (test_space->fe (), quadrature_formula,
+				  (rhs_only)
+				  ?
+				  dealii::update_values    |
+				  dealii::update_JxW_values
+				  :
+				  dealii::update_values    |
+				  dealii::update_gradients |
+				  dealii::update_JxW_values,
+				  rhs_function,
+				  rhs_field,
+				  reaction_function,
+				  rhs_only),
+	     AssemblyCopyData (test_space->n_dofs_per_cell ()));
+
+      if (!rhs_only)
+	system_matrix.compress (dealii::VectorOperation::add);
+      system_vector.compress (dealii::VectorOperation::add);
+    }
+
+    template <int dim>
+    Problem<dim>::AssemblyScratchData::
+    AssemblyScratchData (const dealii::FiniteElement<dim> &fe,
+			 const dealii::Quadrature<dim>     &quadrature,
+			 const dealii::UpdateFlags          update_flags,
+			 const dealii::Vector<double>      *rhs_function,
+			 const qdove::QuadratureField<dim> *rhs_field,
+			 const dealii::Vector<double>      *reaction_function,
+			 const bool                         rhs_only)
+      :
+      fe_values (fe, quadrature, update_flags),
+      kernel_data (fe, quadrature),
+      cell_rhs_function (quadrature.size ()),
+      cell_reaction_function (quadrature.size ()),
+      rhs_function (rhs_function),
+      rhs_field (rhs_field),
+      reaction_function (reaction_function),
+      rhs_only (rhs_only)
+    {}
+
+    template <int dim>
+    Problem<dim>::AssemblyScratchData::
+    AssemblyScratchData (const AssemblyScratchData &scratch_data)
+      :
+      fe_values (scratch_data.fe_values.get_fe (),
+		 scratch_data.fe_values.get_quadrature (),
+		 scratch_data.fe_values.get_update_flags ()),
+      kernel_data (scratch_data.kernel_data),
+      cell_rhs_function (scratch_data.cell_rhs_function.size ()),
+      cell_reaction_function (scratch_data.cell_reaction_function.size ()),
+      rhs_function (scratch_data.rhs_function),
+      rhs_field (scratch_data.rhs_field),
+      reaction_function (scratch_data.reaction_function),
+      rhs_only (scratch_data.rhs_only)
+    {}
+
+    template <int dim>
+    Problem<dim>::AssemblyCopyData::
+    AssemblyCopyData (const unsigned int dofs_per_cell)
+      :
+      cell_system (dofs_per_cell, dofs_per_cell),
+      cell_rhs (dofs_per_cell),
+      local_dof_indices (dofs_per_cell),
+      rhs_only (false)
+    {}
+
+    // Assembly on a single cell
+    template <int dim>
+    void 
+      Problem<dim>::local_assemble (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+				    AssemblyScratchData                                          &scratch_data,
+				    AssemblyCopyData                                             &copy_data)
+    {
+      dealii::FEValues<dim> &fe_values = scratch_data.fe_values;
+
+      const unsigned int dofs_per_cell = fe_values.get_fe ().dofs_per_cell;
+      const unsigned int n_q_points    = fe_values.n_quadrature_points;
+
+      // cell-wise representation of a system of equations
+      dealii::FullMatrix<double> &cell_system = copy_data.cell_system;
+      dealii::Vector<double>     &cell_rhs    = copy_data.cell_rhs;
+
+      copy_data.rhs_only = scratch_data.rhs_only;
+
+      cell_rhs = 0;
+
+      // Elements up to degree four in one and two dimensions, and up
+      // to degree two in three, have compile-time kernels, which
+      // work from the vertices of affine cells; FEValues are then
+      // only needed to interpolate functions. Other cells are
+      // integrated with FEValues.
+      const unsigned int degree      = fe_values.get_fe ().degree;
+      const unsigned int max_degree  = (dim<3) ? 4 : 2;
+      const bool         have_kernel = ((n_q_points==dealii::Utilities::fixed_power<dim> (degree+1)) &&
+					(degree<=max_degree) &&
+					qdove::cell_is_affine<dim> (cell));
+      const bool         interpolate = (!scratch_data.rhs_field ||
+					(!copy_data.rhs_only && scratch_data.reaction_function));
+      if (!have_kernel || interpolate)
+	fe_values.reinit (cell);
 	  
-	  // get the representation of the function on this cell
-	  fe_values.get_function_values (rhs_function, cell_rhs_function);
+      // get the representation of the function on this cell, either
+      // directly from the field at quadrature points or by
+      // interpolation
+      if (scratch_data.rhs_field)
+	scratch_data.rhs_field->get_cell_values (cell, scratch_data.cell_rhs_function);
+      else
+	fe_values.get_function_values (*scratch_data.rhs_function, scratch_data.cell_rhs_function);
+
+      if (have_kernel)
+	{
+	  if (!copy_data.rhs_only && scratch_data.reaction_function)
+	    fe_values.get_function_values (*scratch_data.reaction_function, scratch_data.cell_reaction_function);
 
+	  switch (degree)
+	    {
+	    case 1: compute_cell_system<1> (cell, scratch_data, copy_data); break;
+	    case 2: compute_cell_system<2> (cell, scratch_data, copy_data); break;
+	    case 3: compute_cell_system<3> (cell, scratch_data, copy_data); break;
+	    case 4: compute_cell_system<4> (cell, scratch_data, copy_data); break;
+	    }
+
+	  cell->get_dof_indices (copy_data.local_dof_indices);
+	  return;
+	}
+
+      if (copy_data.rhs_only)
+	{
 	  for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
 	    for (unsigned int j=0; j<dofs_per_cell; ++j)
+	      cell_rhs(j)
+		+=
+		scratch_data.cell_rhs_function[q_point] *
+		fe_values.shape_value (j,q_point)       *
+		fe_values.JxW (q_point);
+
+	  cell->get_dof_indices (copy_data.local_dof_indices);
+	  return;
+	}
+
+      cell_system = 0;
+
+      // and of the reaction function, if there is one
+      if (scratch_data.reaction_function)
+	fe_values.get_function_values (*scratch_data.reaction_function, scratch_data.cell_reaction_function);
+      else
+	std::fill (scratch_data.cell_reaction_function.begin (), scratch_data.cell_reaction_function.end (), 0.);
+
+      for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	for (unsigned int j=0; j<dofs_per_cell; ++j)
+	  {
+	    for (unsigned int i=0; i<dofs_per_cell; ++i)
 	      {
-		for (unsigned int i=0; i<dofs_per_cell; ++i)
-		  {
-		    
-		    cell_system(i,j)
-		      +=
-		      fe_values.shape_grad (i,q_point) *
-		      fe_values.shape_grad (j,q_point) *
-		      fe_values.JxW(q_point);
-		  } // i
-
-		cell_rhs(j)
+		
+		cell_system(i,j)
 		  +=
-		  cell_rhs_function[q_point]        *
-		  fe_values.shape_value (j,q_point) *
-		  fe_values.JxW (q_point);
+		  (fe_values.shape_grad (i,q_point) *
+		   fe_values.shape_grad (j,q_point)
+		   +
+		   scratch_data.cell_reaction_function[q_point] *
+		   fe_values.shape_value (i,q_point)            *
+		   fe_values.shape_value (j,q_point))           *
+		  fe_values.JxW(q_point);
+	      } // i
 
-	      } // j
+	    cell_rhs(j)
+	      +=
+	      scratch_data.cell_rhs_function[q_point] *
+	      fe_values.shape_value (j,q_point)       *
+	      fe_values.JxW (q_point);
 
-	  // Apply constraints and distribute local objects to global
-	  // objects.
-	  cell->get_dof_indices (local_dof_indices);
-	  
-	  constraints.
-	    distribute_local_to_global (cell_system,
-					local_dof_indices,
-					system_matrix);
-
-	  constraints.
-	    distribute_local_to_global (cell_rhs,
-					local_dof_indices,
-					system_vector);
-	} // cell
-
-      system_matrix.compress (dealii::VectorOperation::add);
-      system_vector.compress (dealii::VectorOperation::add);
+	  } // j
+
+      cell->get_dof_indices (copy_data.local_dof_indices);
+    }
+
+    // The same as the loops in local_assemble(), with the number of
+    // shape functions and quadrature points fixed at compile time.
+    template <int dim>
+    template <int fe_degree>
+    void
+      Problem<dim>::compute_cell_system (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+					 const AssemblyScratchData                                    &scratch_data,
+					 AssemblyCopyData                                             &copy_data) const
+    {
+      CellKernel<dim,fe_degree,fe_degree+1> kernel (scratch_data.kernel_data);
+      kernel.reinit (cell);
+
+      kernel.rhs (&scratch_data.cell_rhs_function[0], copy_data.cell_rhs);
+      if (copy_data.rhs_only)
+	return;
+
+      kernel.stiffness (0, copy_data.cell_system);
+      if (scratch_data.reaction_function)
+	kernel.mass (&scratch_data.cell_reaction_function[0], copy_data.cell_system, true);
+    }
+
+    // Apply constraints and distribute local objects to global
+    // objects. This is called for one cell at a time.
+    template <int dim>
+    void 
+      Problem<dim>::copy_local_to_global (const AssemblyCopyData &copy_data)
+    {
+      if (!copy_data.rhs_only)
+	constraints.
+	  distribute_local_to_global (copy_data.cell_system,
+				      copy_data.local_dof_indices,
+				      system_matrix);
+
+      constraints.
+	distribute_local_to_global (copy_data.cell_rhs,
+				    copy_data.local_dof_indices,
+				    system_vector);
     }
     
-    // Simple CG solver
+    // Simple CG solver. The preconditioner is only rebuilt when the
+    // system matrix has changed, and CG starts from the solution of
+    // the previous call.
     template <int dim>
     unsigned int 
       Problem<dim>::solve ()
     {
+      qdove::Profiler::Scope profiler_scope ("Poisson::solve");
+
       dealii::SolverControl solver_control (solution_vector.size (),
 					    1e-8*system_vector.l2_norm ());
+
+      if (!preconditioner_is_initialised)
+	{
+	  switch (preconditioner_type)
+	    {
+	    case BlockJacobi:
+	      preconditioner.reset (new dealii::PETScWrappers::PreconditionBlockJacobi (system_matrix));
+	      break;
+
+	    case AlgebraicMultigrid:
+	      preconditioner.reset (new qdove::PreconditionGAMG (system_matrix));
+	      break;
+
+	    case BoomerAMG:
+	      {
+		const dealii::PETScWrappers::PreconditionBoomerAMG::AdditionalData additional_data (true);
+		preconditioner.reset (new dealii::PETScWrappers::PreconditionBoomerAMG (system_matrix, additional_data));
+		break;
+	      }
+
+	    default:
+	      assert (false && "Unknown preconditioner type.");
+	    }
+
+	  preconditioner_is_initialised = true;
+	}
       
-      dealii::PETScWrappers::SolverCG cg (solver_control);
-      dealii::PETScWrappers::PreconditionBlockJacobi preconditioner(system_matrix);
-      cg.solve (system_matrix, solution_vector, system_vector, preconditioner);
+      dealii::PETScWrappers::SolverCG cg (solver_control, test_space->mpi_communicator ());
+      cg.solve (system_matrix, solution_vector, system_vector, *preconditioner);
+
+      // The solver sets constrained entries to zero; hanging nodes
+      // take their values from the constraints.
+      constraints.distribute (solution_vector);
+
+      // Gather the whole solution once, for the sequential models
+      // and statistics that read it through solution().
+      localized_solution_vector = solution_vector;
+
+      qdove::Profiler::add_iterations ("Poisson::solve", solver_control.last_step ());
       
       return solver_control.last_step();
     }
 
 
 
-    // Return the eigenpairs
+    template <int dim>
+    void
+    Problem<dim>::set_preconditioner_type (const PreconditionerType type)
+    {
+      if (type!=preconditioner_type)
+	preconditioner_is_initialised = false;
+      preconditioner_type = type;
+    }
+
+    template <int dim>
+    std::size_t
+    Problem<dim>::memory_saved_by_preallocation () const
+    {
+      return preallocation_memory_saved;
+    }
+
+    // Return the solution
     template <int dim>
     void 
     Problem<dim>::get_solution_vector (dealii::PETScWrappers::Vector &vector)
     {
        vector.reinit (test_space->n_dofs ());
-       vector = solution_vector;
+       vector = localized_solution_vector;
+    }
+
+    template <int dim>
+    const dealii::PETScWrappers::Vector &
+      Problem<dim>::solution () const
+    {
+      return localized_solution_vector;
     }
 
 
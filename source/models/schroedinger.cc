@@ -23,10 +23,23 @@
 */
 
 #include <qdove/models/schroedinger.h>
+#include <qdove/generic_linear_algebra/transformation_jacobi.h>
+#include <qdove/generic_linear_algebra/tridiagonal_eigenspectrum_solver.h>
+#include <qdove/models/cell_kernel.h>
+#include <qdove/base/profiler.h>
 
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/lac/compressed_sparsity_pattern.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/work_stream.h>
 #include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
+#include <deal.II/grid/filtered_iterator.h>
+#include <deal.II/base/std_cxx1x/shared_ptr.h>
+#include <deal.II/lac/slepc_spectral_transformation.h>
+
+#include <algorithm>
+#include <stdexcept>
 
 namespace qdove
 {
@@ -38,6 +51,16 @@ namespace qdove
     Problem<dim>::Problem (unsigned int eigenpairs)
       :
       n_eigenpairs (eigenpairs),
+      solver_type (LAPACK),
+      target_energy (0.),
+      target_energy_is_set (false),
+      potential_minimum (0.),
+      initial_value (0.),
+      initial_guess_is_set (false),
+      kinetic_is_assembled (false),
+      dof_revision (0),
+      preallocation_memory_saved (0),
+      use_matrix_free (false),
       init (false)
     {}
 
@@ -49,6 +72,16 @@ namespace qdove
       trial_space (&trial),
       test_space (&test),
       n_eigenpairs (eigenpairs),
+      solver_type (LAPACK),
+      target_energy (0.),
+      target_energy_is_set (false),
+      potential_minimum (0.),
+      initial_value (0.),
+      initial_guess_is_set (false),
+      kinetic_is_assembled (false),
+      dof_revision (0),
+      preallocation_memory_saved (0),
+      use_matrix_free (false),
       init (false)
     {}
 
@@ -61,32 +94,128 @@ namespace qdove
     void
     Problem<dim>::reinit ()
     {
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::reinit");
+
       // distribute degrees of freedom on the finite element space
-      test_space->dofs ().distribute_dofs (test_space->fe ());
+      // (only if the mesh has changed)
+      test_space->distribute_dofs ();
 
-      // Initialise system matrices and vectors.
-      system_matrix.reinit (test_space->n_dofs (),
-			    test_space->n_dofs (),
-			    test_space->max_couplings_between_dofs ());
-      
-      overlap_matrix.reinit (test_space->n_dofs (),
-			     test_space->n_dofs (),
-			     test_space->max_couplings_between_dofs ());
+      // If the layout of degrees of freedom is the same as it was the
+      // last time round, matrices, vectors and constraints can all be
+      // kept. Only the system matrix needs to be zeroed; the kinetic
+      // energy and overlap matrices remain valid for
+      // assemble_potential().
+      if (init && (dof_revision==test_space->dof_revision ()))
+	{
+	  if (!use_matrix_free)
+	    system_matrix = 0;
+	  return;
+	}
+
+      // Initialise hanging node and boundary constraints; there are
+      // hanging nodes once the mesh has been refined adaptively in
+      // more than one dimension.
+      constraints.clear ();
+      dealii::DoFTools::make_hanging_node_constraints (test_space->dofs (), constraints);
+      dealii::DoFTools::make_zero_boundary_constraints (test_space->dofs (), constraints);
+      constraints.close ();
+
+      kinetic_is_assembled = false;
+
+      if (use_matrix_free)
+	{
+	  // No matrices are stored, only the data needed to apply the
+	  // Hamiltonian cell by cell.
+	  hamiltonian_operator.reinit (test_space->dofs (), constraints);
+	  preallocation_memory_saved = 0;
+	}
+      else
+	{
+	  // Build the exact sparsity pattern; constrained entries are
+	  // never written to, so they are left out.
+	  dealii::CompressedSparsityPattern sparsity_pattern (test_space->n_dofs ());
+	  dealii::DoFTools::make_sparsity_pattern (test_space->dofs (), sparsity_pattern, constraints, false);
+
+	  // Initialise system matrices, with the rows of each
+	  // subdomain on its process. All three matrices share one
+	  // nonzero pattern.
+	  const MPI_Comm mpi_communicator = test_space->mpi_communicator ();
+	  const std::vector<dealii::types::global_dof_index> &dofs_per_process
+	    = test_space->n_locally_owned_dofs_per_process ();
+
+	  system_matrix.reinit (mpi_communicator, sparsity_pattern,
+				dofs_per_process, dofs_per_process,
+				test_space->this_mpi_process ());
+	  overlap_matrix.reinit (mpi_communicator, sparsity_pattern,
+				 dofs_per_process, dofs_per_process,
+				 test_space->this_mpi_process ());
+	  kinetic_matrix.reinit (mpi_communicator, sparsity_pattern,
+				 dofs_per_process, dofs_per_process,
+				 test_space->this_mpi_process ());
+
+	  // Record how much memory the exact pattern saves compared to
+	  // preallocating max_couplings_between_dofs() entries per row.
+	  const std::size_t n_estimated_entries
+	    = static_cast<std::size_t> (test_space->n_dofs ()) * test_space->max_couplings_between_dofs ();
+	  preallocation_memory_saved
+	    = 3 * (n_estimated_entries - sparsity_pattern.n_nonzero_elements ())
+	    * (sizeof (PetscScalar) + sizeof (PetscInt));
+	}
       
+      // The solution vectors are views of the columns of the
+      // solution block, which owns their elements. The old views
+      // are dropped before they can be copied.
+      solution_block.reinit (test_space->n_dofs (), n_eigenpairs);
+      solution_vectors.clear ();
       solution_vectors.resize (n_eigenpairs);
       for (unsigned int i=0; i<n_eigenpairs; ++i)
-        solution_vectors[i].reinit (test_space->n_dofs ());
+        solution_block.view_column (i, solution_vectors[i]);
+
+      // The sparse eigensolvers write the rows of this process
+      // through distributed views of the same columns.
+      const std::vector<dealii::types::global_dof_index> &dofs_per_process
+	= test_space->n_locally_owned_dofs_per_process ();
+      unsigned int first_local_dof = 0;
+      for (unsigned int p=0; p<test_space->this_mpi_process (); ++p)
+	first_local_dof += dofs_per_process[p];
+
+      distributed_vectors.clear ();
+      distributed_vectors.resize (n_eigenpairs);
+      for (unsigned int i=0; i<n_eigenpairs; ++i)
+        solution_block.view_column (i, test_space->mpi_communicator (),
+				    first_local_dof, test_space->n_locally_owned_dofs (),
+				    distributed_vectors[i]);
       
       solution_values.resize (n_eigenpairs);
       for (unsigned int i=0; i<n_eigenpairs; ++i)
         solution_values[i] = 0.;
-      
-      // Initialise boundary constraints
-      constraints.clear ();
-      dealii::DoFTools::make_zero_boundary_constraints (test_space->dofs (), constraints);
-      constraints.close ();
+
+      // In one dimension, order unconstrained degrees of freedom by
+      // position for the tridiagonal solver.
+      tridiagonal_ordering.clear ();
+      if (dim==1)
+	{
+	  std::vector<dealii::Point<dim> > support_points (test_space->n_dofs ());
+	  dealii::DoFTools::map_dofs_to_support_points (dealii::MappingQ1<dim> (), test_space->dofs (), support_points);
+
+	  std::vector<std::pair<double, dealii::types::global_dof_index> > positions;
+	  for (unsigned int i=0; i<test_space->n_dofs (); ++i)
+	    if (!constraints.is_constrained (i))
+	      positions.push_back (std::make_pair (support_points[i][0], i));
+	  std::sort (positions.begin (), positions.end ());
+
+	  for (unsigned int i=0; i<positions.size (); ++i)
+	    tridiagonal_ordering.push_back (positions[i].second);
+	}
+
+      // An initial guess on the old layout is useless.
+      initial_guess_is_set = false;
+
+      dof_revision = test_space->dof_revision ();
       
       init = true;
+
+      qdove::Profiler::add_bytes ("Schroedinger::reinit", memory_consumption ());
     }
 
     // Assembly
@@ -95,64 +224,349 @@ namespace qdove
     Problem<dim>::assemble (const dealii::PETScWrappers::Vector &ke_function,
 			    const dealii::PETScWrappers::Vector &pe_function)
     {
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::assemble");
+
       // assert (false && "Pure virtual function called...");
       assert (init==true && "Problem has not been initialised");
       assert ((ke_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
       assert ((pe_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
 
-      dealii::QGauss<dim> quadrature_formula (2);
-      dealii::FEValues<dim> fe_values (test_space->fe (), quadrature_formula,
-               dealii::update_values            |
-               dealii::update_gradients         |
-               dealii::update_quadrature_points |
-               dealii::update_JxW_values);
+      // The kinetic energy term is positive, so no eigenvalue lies
+      // below the minimum of the potential energy.
+      potential_minimum = pe_function.min ();
+
+      // Worker threads read the functions from local copies, since
+      // reading PETSc vectors is not thread-safe.
+      const dealii::Vector<double> local_ke_function (ke_function);
+      const dealii::Vector<double> local_pe_function (pe_function);
+
+      // In matrix-free mode, only the coefficients at quadrature
+      // points are needed.
+      if (use_matrix_free)
+	{
+	  hamiltonian_operator.set_kinetic_energy (local_ke_function);
+	  hamiltonian_operator.set_potential_energy (local_pe_function);
+	  kinetic_is_assembled = true;
+	  return;
+	}
+
+      // The global matrices are summed into, so start from zero.
+      system_matrix  = 0;
+      kinetic_matrix = 0;
+      overlap_matrix = 0;
+
+      assemble_cells (AssemblyScratchData (test_space->fe (), test_space->quadrature (),
+					   dealii::update_values    |
+					   dealii::update_gradients |
+					   dealii::update_JxW_values,
+					   &local_ke_function, &local_pe_function));
+      
+      system_matrix.compress (dealii::VectorOperation::add);
+      kinetic_matrix.compress (dealii::VectorOperation::add);
+      overlap_matrix.compress (dealii::VectorOperation::add);
+
+      set_constrained_diagonal (pe_function.linfty_norm ());
+
+      kinetic_is_assembled = true;
+    }
+
+    // Assembly from functions at quadrature points
+    template <int dim>
+    void
+    Problem<dim>::assemble (const qdove::QuadratureField<dim> &ke_field,
+			    const qdove::QuadratureField<dim> &pe_field)
+    {
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::assemble");
+
+      assert (init==true && "Problem has not been initialised");
+      assert ((ke_field.n_q_points ()==test_space->quadrature ().size ()) &&
+	      (pe_field.n_q_points ()==test_space->quadrature ().size ()) &&
+	      "The fields do not match the quadrature formula of the test space.");
+      assert ((ke_field.dof_revision ()==test_space->dof_revision ()) &&
+	      (pe_field.dof_revision ()==test_space->dof_revision ()) &&
+	      "The fields were set up on another mesh.");
+
+      potential_minimum = pe_field.min ();
+
+      if (use_matrix_free)
+	{
+	  hamiltonian_operator.set_kinetic_energy (ke_field);
+	  hamiltonian_operator.set_potential_energy (pe_field);
+	  kinetic_is_assembled = true;
+	  return;
+	}
+
+      system_matrix  = 0;
+      kinetic_matrix = 0;
+      overlap_matrix = 0;
+
+      assemble_cells (AssemblyScratchData (test_space->fe (), test_space->quadrature (),
+					   dealii::update_values    |
+					   dealii::update_gradients |
+					   dealii::update_JxW_values,
+					   0, 0, &ke_field, &pe_field));
+
+      system_matrix.compress (dealii::VectorOperation::add);
+      kinetic_matrix.compress (dealii::VectorOperation::add);
+      overlap_matrix.compress (dealii::VectorOperation::add);
+
+      set_constrained_diagonal (pe_field.linfty_norm ());
+
+      kinetic_is_assembled = true;
+    }
+
+    // Incremental assembly of the potential energy term
+    template <int dim>
+    void
+    Problem<dim>::assemble_potential (const dealii::PETScWrappers::Vector &pe_function)
+    {
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::assemble_potential");
+
+      assert (init==true && "Problem has not been initialised");
+      assert (kinetic_is_assembled==true && "Problem has not been assembled");
+      assert ((pe_function.size ()==test_space->n_dofs ()) && "Incompatible vector sizes.");
+
+      potential_minimum = pe_function.min ();
+
+      const dealii::Vector<double> local_pe_function (pe_function);
+
+      if (use_matrix_free)
+	{
+	  hamiltonian_operator.set_potential_energy (local_pe_function);
+	  return;
+	}
+
+      // Reset the system matrix to the kinetic energy term. Both
+      // matrices were created from the same sparsity pattern, so this
+      // is a values-only update.
+      system_matrix = 0;
+      const PetscErrorCode ierr = MatAXPY (system_matrix, 1., kinetic_matrix, SAME_NONZERO_PATTERN);
+      assert ((ierr==0) && "PETSc failed to copy the kinetic energy matrix.");
+      (void) ierr;
+
+      // Only shape values are needed for a mass-type term. Without a
+      // kinetic energy function, the workers compute only the
+      // potential energy term.
+      assemble_cells (AssemblyScratchData (test_space->fe (), test_space->quadrature (),
+					   dealii::update_values    |
+					   dealii::update_JxW_values,
+					   0, &local_pe_function));
+
+      system_matrix.compress (dealii::VectorOperation::add);
+
+      set_constrained_diagonal (pe_function.linfty_norm ());
+    }
+
+    // Incremental assembly from a potential energy function at
+    // quadrature points
+    template <int dim>
+    void
+    Problem<dim>::assemble_potential (const qdove::QuadratureField<dim> &pe_field)
+    {
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::assemble_potential");
+
+      assert (init==true && "Problem has not been initialised");
+      assert (kinetic_is_assembled==true && "Problem has not been assembled");
+      assert ((pe_field.n_q_points ()==test_space->quadrature ().size ()) &&
+	      "The field does not match the quadrature formula of the test space.");
+      assert ((pe_field.dof_revision ()==test_space->dof_revision ()) &&
+	      "The field was set up on another mesh.");
+
+      potential_minimum = pe_field.min ();
+
+      if (use_matrix_free)
+	{
+	  hamiltonian_operator.set_potential_energy (pe_field);
+	  return;
+	}
+
+      system_matrix = 0;
+      const PetscErrorCode ierr = MatAXPY (system_matrix, 1., kinetic_matrix, SAME_NONZERO_PATTERN);
+      assert ((ierr==0) && "PETSc failed to copy the kinetic energy matrix.");
+      (void) ierr;
+
+      assemble_cells (AssemblyScratchData (test_space->fe (), test_space->quadrature (),
+					   dealii::update_values    |
+					   dealii::update_JxW_values,
+					   0, 0, 0, &pe_field));
+
+      system_matrix.compress (dealii::VectorOperation::add);
+
+      set_constrained_diagonal (pe_field.linfty_norm ());
+    }
+
+    // The constraint matrix writes the absolute value of the local
+    // diagonal to constrained rows, summed over cells. That of the
+    // potential energy term alone, summed into the kinetic energy
+    // matrix by assemble_potential(), is not the same as that of the
+    // sum of both terms written by assemble(). Both set the diagonal
+    // here instead, from matrices that do not change between the
+    // two. The Rayleigh quotient of a constrained row is then the
+    // kinetic one of a single shape function plus a bound of the
+    // potential, which lies above the states of interest.
+    template <int dim>
+    void
+    Problem<dim>::set_constrained_diagonal (const double potential_bound)
+    {
+      // Each process sets the rows it owns.
+      const std::pair<unsigned int, unsigned int> range = system_matrix.local_range ();
+      for (dealii::types::global_dof_index i=range.first; i<range.second; ++i)
+	if (constraints.is_constrained (i))
+	  system_matrix.set (i, i, kinetic_matrix.el (i, i) + potential_bound * overlap_matrix.el (i, i));
+
+      system_matrix.compress (dealii::VectorOperation::insert);
+    }
+
+    // Assemble matrices cell-wise on all available threads, on the
+    // cells of the subdomain of this process. Local contributions are
+    // copied to the global matrices in the order of cells, so the
+    // result is the same as that of a serial loop. Entries in rows of
+    // other processes are sent to them by compress().
+    template <int dim>
+    void
+    Problem<dim>::assemble_cells (const AssemblyScratchData &scratch_data)
+    {
+      typedef dealii::FilteredIterator<typename dealii::DoFHandler<dim>::active_cell_iterator> CellFilter;
+      const dealii::IteratorFilters::SubdomainEqualTo subdomain_filter (test_space->this_mpi_process ());
+
+      dealii::WorkStream::
+	run (CellFilter (subdomain_filter, test_space->dofs ().begin_active ()),
+	     CellFilter (subdomain_filter, test_space->dofs ().end ()),
+	     *this,
+	     &Problem<dim>::local_assemble,
+	     &Problem<dim>::copy_local_to_global,
+	     scratch_data,
+	     AssemblyCopyData (test_space->n_dofs_per_cell ()));
+    }
+
+    template <int dim>
+    Problem<dim>::AssemblyScratchData::
+    AssemblyScratchData (const dealii::FiniteElement<dim> &fe,
+			 const dealii::Quadrature<dim>     &quadrature,
+			 const dealii::UpdateFlags          update_flags,
+			 const dealii::Vector<double>      *ke_function,
+			 const dealii::Vector<double>      *pe_function,
+			 const qdove::QuadratureField<dim> *ke_field,
+			 const qdove::QuadratureField<dim> *pe_field)
+      :
+      fe_values (fe, quadrature, update_flags),
+      kernel_data (fe, quadrature),
+      cell_ke_function (quadrature.size ()),
+      cell_pe_function (quadrature.size ()),
+      ke_function (ke_function),
+      pe_function (pe_function),
+      ke_field (ke_field),
+      pe_field (pe_field)
+    {}
 
-      const unsigned int dofs_per_cell = test_space->n_dofs_per_cell ();
-      const unsigned int n_q_points    = quadrature_formula.size ();
+    template <int dim>
+    Problem<dim>::AssemblyScratchData::
+    AssemblyScratchData (const AssemblyScratchData &scratch_data)
+      :
+      fe_values (scratch_data.fe_values.get_fe (),
+		 scratch_data.fe_values.get_quadrature (),
+		 scratch_data.fe_values.get_update_flags ()),
+      kernel_data (scratch_data.kernel_data),
+      cell_ke_function (scratch_data.cell_ke_function.size ()),
+      cell_pe_function (scratch_data.cell_pe_function.size ()),
+      ke_function (scratch_data.ke_function),
+      pe_function (scratch_data.pe_function),
+      ke_field (scratch_data.ke_field),
+      pe_field (scratch_data.pe_field)
+    {}
 
-      std::vector<unsigned int> local_dof_indices (dofs_per_cell);
+    template <int dim>
+    Problem<dim>::AssemblyCopyData::
+    AssemblyCopyData (const unsigned int dofs_per_cell)
+      :
+      cell_system (dofs_per_cell, dofs_per_cell),
+      cell_kinetic (dofs_per_cell, dofs_per_cell),
+      cell_overlap (dofs_per_cell, dofs_per_cell),
+      local_dof_indices (dofs_per_cell),
+      potential_only (false)
+    {}
+
+    // Assembly on a single cell
+    template <int dim>
+    void
+    Problem<dim>::local_assemble (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+				  AssemblyScratchData                                          &scratch_data,
+				  AssemblyCopyData                                             &copy_data)
+    {
+      dealii::FEValues<dim> &fe_values = scratch_data.fe_values;
+
+      const unsigned int dofs_per_cell = fe_values.get_fe ().dofs_per_cell;
+      const unsigned int n_q_points    = fe_values.n_quadrature_points;
 
       // cell-wise representation of eigenspectrum problem
-      dealii::FullMatrix<double> cell_system (dofs_per_cell, dofs_per_cell);
-      dealii::FullMatrix<double> cell_overlap (dofs_per_cell, dofs_per_cell);
+      dealii::FullMatrix<double> &cell_system  = copy_data.cell_system;
+      dealii::FullMatrix<double> &cell_kinetic = copy_data.cell_kinetic;
+      dealii::FullMatrix<double> &cell_overlap = copy_data.cell_overlap;
 
-      // cell-wise representation of the function
-      std::vector<double> cell_ke_function (n_q_points);
-      std::vector<double> cell_pe_function (n_q_points);
+      copy_data.potential_only = ((scratch_data.ke_function==0) && (scratch_data.ke_field==0));
 
-      typename dealii::DoFHandler<dim>::active_cell_iterator
-        cell = test_space->dofs ().begin_active (),
-        endc = test_space->dofs ().end();
+      cell_kinetic = 0;
+      cell_overlap = 0;
 
-      // assemble matrices cell-wise
-      for (; cell!=endc; ++cell)
-      {
-        cell_system  = 0;
-        cell_overlap = 0;
-        fe_values.reinit (cell);
+      // Elements up to degree four in one and two dimensions, and up
+      // to degree two in three, have compile-time kernels, which
+      // work from the vertices of affine cells; FEValues are then
+      // only needed to interpolate functions. Other cells are
+      // integrated with FEValues.
+      const unsigned int degree      = fe_values.get_fe ().degree;
+      const unsigned int max_degree  = (dim<3) ? 4 : 2;
+      const bool         have_kernel = ((n_q_points==dealii::Utilities::fixed_power<dim> (degree+1)) &&
+					(degree<=max_degree) &&
+					qdove::cell_is_affine<dim> (cell));
+      const bool         interpolate = ((!copy_data.potential_only && !scratch_data.ke_field) ||
+					!scratch_data.pe_field);
+      if (!have_kernel || interpolate)
+	fe_values.reinit (cell);
 
-        // get the representation of the function on this cell
-        fe_values.get_function_values (ke_function, cell_ke_function);
-        fe_values.get_function_values (pe_function, cell_pe_function);
+      // get the representation of the function on this cell, either
+      // directly from the fields at quadrature points or by
+      // interpolation
+      if (!copy_data.potential_only)
+	{
+	  if (scratch_data.ke_field)
+	    scratch_data.ke_field->get_cell_values (cell, scratch_data.cell_ke_function);
+	  else
+	    fe_values.get_function_values (*scratch_data.ke_function, scratch_data.cell_ke_function);
+	}
+      if (scratch_data.pe_field)
+	scratch_data.pe_field->get_cell_values (cell, scratch_data.cell_pe_function);
+      else
+	fe_values.get_function_values (*scratch_data.pe_function, scratch_data.cell_pe_function);
+
+      if (have_kernel)
+	{
+	  switch (degree)
+	    {
+	    case 1: compute_cell_matrices<1> (cell, scratch_data, copy_data); break;
+	    case 2: compute_cell_matrices<2> (cell, scratch_data, copy_data); break;
+	    case 3: compute_cell_matrices<3> (cell, scratch_data, copy_data); break;
+	    case 4: compute_cell_matrices<4> (cell, scratch_data, copy_data); break;
+	    }
+
+	  cell->get_dof_indices (copy_data.local_dof_indices);
+	  return;
+	}
 
+      // The kinetic and overlap terms are kept separately, so that
+      // assemble_potential() can reuse them.
+      if (!copy_data.potential_only)
         for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
           for (unsigned int j=0; j<dofs_per_cell; ++j)
             for (unsigned int i=0; i<dofs_per_cell; ++i)
 	      {
 		
 		// assemble local matrix
-		cell_system(i,j)
+		cell_kinetic(i,j)
 		  +=
-		  cell_ke_function[q_point]        *
-		  fe_values.shape_grad (i,q_point) *
-		  fe_values.shape_grad (j,q_point) *
-		  fe_values.JxW(q_point)
-		  +
-		  cell_pe_function[q_point]         *
-		  fe_values.shape_value (i,q_point) *
-		  fe_values.shape_value (j,q_point) *
-		  fe_values.JxW (q_point)
-		  ;
+		  scratch_data.cell_ke_function[q_point] *
+		  fe_values.shape_grad (i,q_point)       *
+		  fe_values.shape_grad (j,q_point)       *
+		  fe_values.JxW(q_point);
 		
 		cell_overlap(i,j)
 		  +=
@@ -160,25 +574,68 @@ namespace qdove
 		  fe_values.shape_value (j,q_point) *
 		  fe_values.JxW (q_point);
 	      }
-	
-        // Apply constraints and distribute local objects to global
-        // objects.
-        cell->get_dof_indices (local_dof_indices);
-	
-        constraints.
-          distribute_local_to_global (cell_system,
-				      local_dof_indices,
-				      system_matrix);
-	
-        constraints.
-          distribute_local_to_global (cell_overlap,
-				      local_dof_indices,
-				      overlap_matrix);
-	
-      } // cell
-      
-      system_matrix.compress (dealii::VectorOperation::add);
-      overlap_matrix.compress (dealii::VectorOperation::add);
+
+      // The potential energy term is the overlap weighted by the
+      // potential energy function.
+      cell_system = cell_kinetic;
+      for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+        for (unsigned int j=0; j<dofs_per_cell; ++j)
+          for (unsigned int i=0; i<dofs_per_cell; ++i)
+            cell_system(i,j)
+              +=
+              scratch_data.cell_pe_function[q_point] *
+              fe_values.shape_value (i,q_point)      *
+              fe_values.shape_value (j,q_point)      *
+              fe_values.JxW (q_point);
+
+      cell->get_dof_indices (copy_data.local_dof_indices);
+    }
+
+    // The same as the loops in local_assemble(), with the number of
+    // shape functions and quadrature points fixed at compile time.
+    template <int dim>
+    template <int fe_degree>
+    void
+    Problem<dim>::compute_cell_matrices (const typename dealii::DoFHandler<dim>::active_cell_iterator &cell,
+					 const AssemblyScratchData                                    &scratch_data,
+					 AssemblyCopyData                                             &copy_data) const
+    {
+      CellKernel<dim,fe_degree,fe_degree+1> kernel (scratch_data.kernel_data);
+      kernel.reinit (cell);
+
+      if (!copy_data.potential_only)
+	{
+	  kernel.stiffness (&scratch_data.cell_ke_function[0], copy_data.cell_kinetic);
+	  kernel.mass (0, copy_data.cell_overlap);
+	}
+
+      copy_data.cell_system = copy_data.cell_kinetic;
+      kernel.mass (&scratch_data.cell_pe_function[0], copy_data.cell_system, true);
+    }
+
+    // Apply constraints and distribute local objects to global
+    // objects. This is called for one cell at a time.
+    template <int dim>
+    void
+    Problem<dim>::copy_local_to_global (const AssemblyCopyData &copy_data)
+    {
+      constraints.
+	distribute_local_to_global (copy_data.cell_system,
+				    copy_data.local_dof_indices,
+				    system_matrix);
+
+      if (copy_data.potential_only)
+	return;
+
+      constraints.
+	distribute_local_to_global (copy_data.cell_kinetic,
+				    copy_data.local_dof_indices,
+				    kinetic_matrix);
+
+      constraints.
+	distribute_local_to_global (copy_data.cell_overlap,
+				    copy_data.local_dof_indices,
+				    overlap_matrix);
     }
 
     // Simple solver. \todo Figure out why scaling the matrices did
@@ -188,25 +645,334 @@ namespace qdove
     unsigned int
     Problem<dim>::solve ()
     {
+      assert (init==true && "Problem has not been initialised");
+
       // const double factor = overlap_matrix (0,0);
       // assert ((factor!=0) && "A highly improbable internal error has occured in the schroedinger solver routine.");
       // system_matrix  /= factor;
       // overlap_matrix /= factor;
 
-      dealii::SolverControl solver_control (n_eigenpairs*system_matrix.m (), 1e-24);
-      dealii::SLEPcWrappers::SolverLAPACK lapack (solver_control);
+      qdove::Profiler::Scope profiler_scope ("Schroedinger::solve");
 
-      lapack.set_which_eigenpairs (EPS_SMALLEST_REAL);
-      lapack.solve (system_matrix, overlap_matrix, solution_values, solution_vectors, n_eigenpairs);
+      if (use_matrix_free)
+	{
+	  const unsigned int n_iterations = solve_matrix_free ();
+	  qdove::Profiler::add_iterations ("Schroedinger::solve", n_iterations);
+	  return n_iterations;
+	}
 
-      for (unsigned int i=0; i<n_eigenpairs; ++i)
+      unsigned int n_iterations = 0;
+
+      const MPI_Comm mpi_communicator = test_space->mpi_communicator ();
+
+      if (solver_type==LAPACK)
+        {
+          dealii::SolverControl solver_control (n_eigenpairs*system_matrix.m (), 1e-24);
+          dealii::SLEPcWrappers::SolverLAPACK lapack (solver_control, mpi_communicator);
+
+          lapack.set_which_eigenpairs (EPS_SMALLEST_REAL);
+          lapack.solve (system_matrix, overlap_matrix, solution_values, distributed_vectors, n_eigenpairs);
+          solution_block.gather_rows (mpi_communicator, test_space->n_locally_owned_dofs_per_process ());
+
+          n_iterations = solver_control.last_step ();
+        }
+      else if (solver_type==Tridiagonal)
+        {
+          assert ((dim==1) && (test_space->fe ().degree==1) &&
+                  "The tridiagonal solver needs linear elements in one dimension.");
+          assert ((test_space->n_mpi_processes ()==1) &&
+                  "The tridiagonal solver is sequential.");
+
+          // Extract the bands of the system and overlap matrices in
+          // the order of position. Constrained rows are decoupled and
+          // left out; their entries of the eigenvectors are zero.
+          const unsigned int n = tridiagonal_ordering.size ();
+
+          // The bands below have n-1 off-diagonal entries, so there
+          // must be at least one unconstrained degree of freedom, and
+          // one for each eigenpair. This is also what is left of a
+          // problem that is not one-dimensional in release mode, so
+          // it is checked there too.
+          if ((n==0) || (n<n_eigenpairs))
+            throw std::runtime_error ("The tridiagonal solver needs at least as many unconstrained "
+                                      "degrees of freedom as eigenpairs.");
+
+          std::vector<double> a_diagonal (n), a_off_diagonal (n-1);
+          std::vector<double> b_diagonal (n), b_off_diagonal (n-1);
+          for (unsigned int k=0; k<n; ++k)
+            {
+              const dealii::types::global_dof_index row = tridiagonal_ordering[k];
+              a_diagonal[k] = system_matrix.el (row, row);
+              b_diagonal[k] = overlap_matrix.el (row, row);
+
+              if (k+1<n)
+                {
+                  const dealii::types::global_dof_index column = tridiagonal_ordering[k+1];
+                  a_off_diagonal[k] = system_matrix.el (row, column);
+                  b_off_diagonal[k] = overlap_matrix.el (row, column);
+                }
+            }
+
+          qdove::TridiagonalEigenspectrumSolver tridiagonal_solver;
+          std::vector<std::vector<double> > vectors;
+          tridiagonal_solver.solve (a_diagonal, a_off_diagonal, b_diagonal, b_off_diagonal,
+                                    solution_values, vectors, n_eigenpairs);
+
+          for (unsigned int i=0; i<n_eigenpairs; ++i)
+            {
+              solution_vectors[i] = 0;
+              solution_vectors[i].set (tridiagonal_ordering, vectors[i]);
+              solution_vectors[i].compress (dealii::VectorOperation::insert);
+            }
+
+          n_iterations = tridiagonal_solver.last_step ();
+        }
+      else
+        {
+          // Sparse iterative solvers compute only the n_eigenpairs
+          // closest to the target energy. SLEPc uses a convergence
+          // criterion relative to the eigenvalue, so the tolerance
+          // does not depend on the units of the problem.
+          dealii::SolverControl solver_control (1000, 1e-10);
+
+          dealii::std_cxx1x::shared_ptr<dealii::SLEPcWrappers::SolverBase> eigensolver;
+          switch (solver_type)
+            {
+            case KrylovSchur:
+              eigensolver.reset (new dealii::SLEPcWrappers::SolverKrylovSchur (solver_control, mpi_communicator));
+              break;
+
+            case Lanczos:
+              eigensolver.reset (new dealii::SLEPcWrappers::SolverLanczos (solver_control, mpi_communicator));
+              break;
+
+            case JacobiDavidson:
+              eigensolver.reset (new dealii::SLEPcWrappers::SolverJacobiDavidson (solver_control, mpi_communicator));
+              break;
+
+            default:
+              assert (false && "Unknown eigenspectrum solver type.");
+            }
+
+          const double target = compute_target_energy ();
+
+          // Shift-and-invert around the target energy. Davidson-type
+          // solvers precondition with the target internally and must
+          // not be given a spectral transformation.
+          dealii::SLEPcWrappers::TransformationShiftInvert
+            shift_invert (dealii::SLEPcWrappers::TransformationShiftInvert::AdditionalData (target));
+          if (solver_type!=JacobiDavidson)
+            eigensolver->set_transformation (shift_invert);
+
+          eigensolver->set_problem_type (EPS_GHEP);
+          eigensolver->set_target_eigenvalue (target);
+          eigensolver->set_which_eigenpairs (EPS_TARGET_REAL);
+
+          // A Krylov subspace started from the sum of the previous
+          // eigenvectors contains all of them after n_eigenpairs
+          // steps, so a small change of the potential leaves only a
+          // few iterations to do. Each process passes on the rows it
+          // owns.
+          dealii::PETScWrappers::MPI::Vector distributed_initial_vector;
+          if (initial_guess_is_set)
+            {
+              assert ((initial_vector.size ()==system_matrix.m ()) && "Incompatible vector sizes.");
+
+              distributed_initial_vector.reinit (mpi_communicator, test_space->n_dofs (),
+                                                 test_space->n_locally_owned_dofs ());
+              const std::pair<unsigned int, unsigned int> range = distributed_initial_vector.local_range ();
+
+              const PetscScalar *initial_values;
+              PetscScalar       *local_values;
+              VecGetArrayRead (initial_vector, &initial_values);
+              VecGetArray (distributed_initial_vector, &local_values);
+              std::copy (initial_values+range.first, initial_values+range.second, local_values);
+              VecRestoreArray (distributed_initial_vector, &local_values);
+              VecRestoreArrayRead (initial_vector, &initial_values);
+
+              eigensolver->set_initial_vector (distributed_initial_vector);
+            }
+
+          eigensolver->solve (system_matrix, overlap_matrix, solution_values, distributed_vectors, n_eigenpairs);
+          solution_block.gather_rows (mpi_communicator, test_space->n_locally_owned_dofs_per_process ());
+
+          n_iterations = solver_control.last_step ();
+
+          // Eigenpairs are returned in order of distance from the
+          // target, which need not be ascending if some lie below the
+          // target. Sort them (insertion sort, there are only a few).
+          // The elements are swapped, since each vector is tied to
+          // its column of the solution block.
+          for (unsigned int i=1; i<n_eigenpairs; ++i)
+            for (unsigned int j=i; (j>0) && (solution_values[j]<solution_values[j-1]); --j)
+              {
+                std::swap (solution_values[j], solution_values[j-1]);
+                VecSwap (solution_vectors[j], solution_vectors[j-1]);
+              }
+        }
+
+      // The initial guess is consumed.
+      initial_guess_is_set = false;
+
+      qdove::Profiler::add_iterations ("Schroedinger::solve", n_iterations);
+
+      // Normalise all eigenvectors with respect to the overlap
+      // matrix at once: one sparse times dense matrix product gives
+      // the products of the overlap matrix with all of them.
       {
-        constraints.distribute (solution_vectors[i]);
-        const double overlap_norm_square = overlap_matrix.matrix_norm_square (solution_vectors[i]);
-        solution_vectors[i] /= sqrt (overlap_norm_square);
+	qdove::Profiler::Scope normalise_scope ("Schroedinger::normalise");
+
+	for (unsigned int i=0; i<n_eigenpairs; ++i)
+	  constraints.distribute (solution_vectors[i]);
+
+	multiply_overlap_block ();
+
+	std::vector<double> factors;
+	solution_block.column_dots (factors, overlap_block);
+	for (unsigned int i=0; i<n_eigenpairs; ++i)
+	  solution_vectors[i] *= 1./sqrt (factors[i]);
       }
 
-      return solver_control.last_step();
+      return n_iterations;
+    }
+
+    // Choose the target energy: An explicitly set target takes
+    // precedence. Otherwise, if the eigenpairs of a previous cycle are
+    // known, shift half way from the bottom of the potential towards
+    // the previous ground state, which keeps the target close to, but
+    // below, the lowest eigenvalue.
+    template <int dim>
+    double
+    Problem<dim>::compute_target_energy () const
+    {
+      if (target_energy_is_set)
+        return target_energy;
+
+      if (initial_guess_is_set)
+        return 0.5 * (potential_minimum + std::max (potential_minimum, initial_value));
+
+      return potential_minimum;
+    }
+
+    // Matrix-free solver. Neither the Hamiltonian nor the overlap
+    // matrix can be factorised, so the generalised problem is solved
+    // with the Jacobi-Davidson solver, whose correction equation is
+    // preconditioned with the diagonal of the shifted Hamiltonian.
+    template <int dim>
+    unsigned int
+    Problem<dim>::solve_matrix_free ()
+    {
+      assert ((solver_type==JacobiDavidson) &&
+              "The matrix-free operator needs the Jacobi-Davidson solver.");
+
+      dealii::SolverControl solver_control (10000, 1e-10);
+      dealii::SLEPcWrappers::SolverJacobiDavidson eigensolver (solver_control);
+
+      const double target = compute_target_energy ();
+
+      dealii::Vector<double> inverse_diagonal;
+      hamiltonian_operator.compute_inverse_diagonal (target, inverse_diagonal);
+
+      qdove::TransformationJacobi jacobi (inverse_diagonal, target);
+      eigensolver.set_transformation (jacobi);
+
+      eigensolver.set_problem_type (EPS_GHEP);
+      eigensolver.set_target_eigenvalue (target);
+      eigensolver.set_which_eigenpairs (EPS_TARGET_REAL);
+
+      if (initial_guess_is_set)
+        eigensolver.set_initial_vector (initial_vector);
+      initial_guess_is_set = false;
+
+      const OverlapOperator<dim,1> &overlap_operator = hamiltonian_operator.overlap_operator ();
+      eigensolver.solve (hamiltonian_operator, overlap_operator, solution_values, solution_vectors, n_eigenpairs);
+
+      for (unsigned int i=1; i<n_eigenpairs; ++i)
+        for (unsigned int j=i; (j>0) && (solution_values[j]<solution_values[j-1]); --j)
+          {
+            std::swap (solution_values[j], solution_values[j-1]);
+            VecSwap (solution_vectors[j], solution_vectors[j-1]);
+          }
+
+      // Normalise with respect to the consistent overlap matrix. The
+      // constrained entries are zero, since constrained rows are
+      // decoupled, and are set only afterwards.
+      {
+	qdove::Profiler::Scope normalise_scope ("Schroedinger::normalise");
+
+	dealii::PETScWrappers::Vector overlap_vector (solution_vectors[0].size ());
+	for (unsigned int i=0; i<n_eigenpairs; ++i)
+	  {
+	    overlap_operator.vmult (overlap_vector, solution_vectors[i]);
+	    solution_vectors[i] *= 1./sqrt (solution_vectors[i] * overlap_vector);
+	    constraints.distribute (solution_vectors[i]);
+	  }
+      }
+
+      return solver_control.last_step ();
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_matrix_free (const bool matrix_free)
+    {
+      assert ((init==false) && "The operator mode must be set before the problem is initialised.");
+      assert ((!matrix_free || test_space->degree ()==1) &&
+	      "The matrix-free operator is only available for linear elements.");
+      use_matrix_free = matrix_free;
+    }
+
+    template <int dim>
+    std::size_t
+    Problem<dim>::memory_consumption () const
+    {
+      if (use_matrix_free)
+        return (hamiltonian_operator.memory_consumption () +
+                solution_block.memory_consumption ());
+
+      return (system_matrix.memory_consumption ()  +
+              kinetic_matrix.memory_consumption () +
+              overlap_matrix.memory_consumption () +
+              solution_block.memory_consumption () +
+              overlap_block.memory_consumption ());
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_solver_type (const SolverType type)
+    {
+      solver_type = type;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_target_energy (const double energy)
+    {
+      target_energy        = energy;
+      target_energy_is_set = true;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_initial_eigenpairs (const std::vector<double>                        &values,
+                                          const std::vector<dealii::PETScWrappers::Vector> &vectors)
+    {
+      assert ((values.size ()!=0) && (values.size ()==vectors.size ()) && "Incompatible vector sizes.");
+
+      initial_vector.reinit (vectors[0].size ());
+      for (unsigned int i=0; i<vectors.size (); ++i)
+        initial_vector.add (vectors[i]);
+
+      initial_value = *std::min_element (values.begin (), values.end ());
+
+      initial_guess_is_set = true;
+    }
+
+    template <int dim>
+    std::size_t
+    Problem<dim>::memory_saved_by_preallocation () const
+    {
+      return preallocation_memory_saved;
     }
 
     // Return the eigenpairs
@@ -228,6 +994,67 @@ namespace qdove
 	  values[i] = solution_values[i];
 	}
     }
+
+    template <int dim>
+    const std::vector<double> &
+    Problem<dim>::solution_eigenvalues () const
+    {
+      return solution_values;
+    }
+
+    template <int dim>
+    const std::vector<dealii::PETScWrappers::Vector> &
+    Problem<dim>::solution_eigenvectors () const
+    {
+      return solution_vectors;
+    }
+
+    template <int dim>
+    const qdove::MultiVector &
+    Problem<dim>::solution_multivector () const
+    {
+      return solution_block;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::compute_overlaps (dealii::FullMatrix<double> &overlaps) const
+    {
+      assert ((use_matrix_free==false) && "There is no overlap matrix in matrix-free mode.");
+
+      multiply_overlap_block ();
+      solution_block.Tmmult (overlaps, overlap_block);
+    }
+
+    // On one process, this is one sparse times dense matrix product.
+    // Otherwise each process multiplies the rows it owns, column by
+    // column through distributed views of both blocks, and the rows
+    // are then gathered.
+    template <int dim>
+    void
+    Problem<dim>::multiply_overlap_block () const
+    {
+      if (test_space->n_mpi_processes ()==1)
+	{
+	  solution_block.mmult (overlap_block, overlap_matrix);
+	  return;
+	}
+
+      overlap_block.reinit (solution_block.n_rows (), solution_block.n_columns ());
+
+      dealii::PETScWrappers::MPI::Vector overlap_vector;
+      for (unsigned int i=0; i<n_eigenpairs; ++i)
+	{
+	  const std::pair<unsigned int, unsigned int> range = distributed_vectors[i].local_range ();
+	  overlap_block.view_column (i, test_space->mpi_communicator (),
+				     range.first, range.second-range.first,
+				     overlap_vector);
+	  overlap_matrix.vmult (overlap_vector, distributed_vectors[i]);
+	}
+
+      overlap_block.gather_rows (test_space->mpi_communicator (),
+				 test_space->n_locally_owned_dofs_per_process ());
+    }
     
     
   } // namespace Schroedinger
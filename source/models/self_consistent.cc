@@ -0,0 +1,669 @@
+/* 
+   Copyright (C) 2013 the QuantumDove authors
+   
+   Permission is hereby granted, free of charge, to any person
+   obtaining a copy of this software and associated documentation
+   files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy,
+   modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+   HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+
+#include <qdove/models/self_consistent.h>
+#include <qdove/models/statistics.h>
+#include <qdove/materials/constants.h>
+
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/grid/grid_refinement.h>
+#include <deal.II/lac/constraint_matrix.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+#include <deal.II/numerics/error_estimator.h>
+#include <deal.II/numerics/solution_transfer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace qdove
+{
+
+  namespace SelfConsistent
+  {
+
+    template <int dim>
+    Problem<dim>::Problem (qdove::TrialSpace<dim> &trial,
+			   qdove::TestSpace<dim>  &test,
+			   const unsigned int      n_eigenpairs)
+      :
+      trial_space (&trial),
+      test_space (&test),
+      schroedinger_problem (trial, test, n_eigenpairs),
+      poisson_problem (trial, test),
+      mixing_type (Anderson),
+      alpha (0.1),
+      history (5),
+      tolerance (1e-5*qdove::E0),
+      max_cycles (100),
+      max_newton_steps (50),
+      fermi_energy (0.),
+      permittivity (1.),
+      temperature (300.),
+      charge_neutrality (false),
+      last_residual_norm (std::numeric_limits<double>::max ()),
+      have_previous_cycle (false)
+    {
+      // Only the lowest few states are needed, so use a sparse
+      // eigensolver by default.
+      schroedinger_problem.set_solver_type (qdove::Schroedinger::KrylovSchur);
+    }
+
+    template <int dim>
+    Problem<dim>::~Problem ()
+    {}
+
+    template <int dim>
+    void
+    Problem<dim>::set_mixing (const MixingType   type,
+			      const double       mixing_parameter,
+			      const unsigned int n_history)
+    {
+      assert ((mixing_parameter>0.) && (mixing_parameter<=1.) && "The mixing parameter must be in (0,1].");
+      mixing_type = type;
+      alpha       = mixing_parameter;
+      history     = n_history;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_tolerance (const double       residual_tolerance,
+				 const unsigned int n_max_cycles)
+    {
+      tolerance  = residual_tolerance;
+      max_cycles = n_max_cycles;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_effective_mass (const dealii::PETScWrappers::Vector &effective_mass)
+    {
+      kinetic.reinit (effective_mass.size ());
+      for (unsigned int i=0; i<effective_mass.size (); ++i)
+	kinetic[i] = (qdove::HBAR*qdove::HBAR) / (2.*effective_mass[i]*qdove::M0);
+      kinetic.compress (dealii::VectorOperation::insert);
+
+      qdove::FermiDirac::compute_density_of_states (effective_mass, density_of_states,
+						    qdove::FermiDirac::confinement_of_dimension (dim));
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_band_edge (const dealii::PETScWrappers::Vector &band_edge_potential)
+    {
+      band_edge = band_edge_potential;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_doping (const dealii::PETScWrappers::Vector &doping_profile)
+    {
+      doping = doping_profile;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_material (const double fermi_energy_value,
+				const double permittivity_value)
+    {
+      fermi_energy = fermi_energy_value;
+      permittivity = permittivity_value;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_charge_neutrality (const bool neutrality)
+    {
+      charge_neutrality = neutrality;
+    }
+
+    template <int dim>
+    double
+    Problem<dim>::get_fermi_energy () const
+    {
+      return fermi_energy;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_temperature (const double temperature_value)
+    {
+      assert ((temperature_value>0.) && "The temperature must be positive.");
+      temperature = temperature_value;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::set_solver_type (const qdove::Schroedinger::SolverType type)
+    {
+      schroedinger_problem.set_solver_type (type);
+    }
+
+    template <int dim>
+    unsigned int
+    Problem<dim>::run ()
+    {
+      return run (band_edge);
+    }
+
+    template <int dim>
+    unsigned int
+    Problem<dim>::run (const dealii::PETScWrappers::Vector &initial_potential)
+    {
+      const unsigned int n_dofs = test_space->n_dofs ();
+      assert ((kinetic.size ()==n_dofs) && "The effective mass has not been set.");
+      assert ((band_edge.size ()==n_dofs) && "The band edge has not been set.");
+      assert ((doping.size ()==n_dofs) && "The doping profile has not been set.");
+      assert ((initial_potential.size ()==n_dofs) && "Incompatible vector sizes.");
+
+      // The models read the material functions at quadrature
+      // points; they are evaluated there once per run, since the mesh
+      // may have changed since the last one.
+      const dealii::QGauss<dim> quadrature = test_space->quadrature ();
+      kinetic_field.interpolate (*test_space, quadrature, kinetic);
+      density_of_states_field.interpolate (*test_space, quadrature, density_of_states);
+      doping_field.interpolate (*test_space, quadrature, doping);
+
+      // Start afresh: mixing histories of a previous run do not
+      // belong to this one.
+      potential = initial_potential;
+      have_previous_cycle = false;
+
+      if (charge_neutrality)
+	test_space->compute_nodal_weights (nodal_weights);
+      potential_differences.clear ();
+      residual_differences.clear ();
+      broyden_u.clear ();
+      broyden_v.clear ();
+
+      dealii::PETScWrappers::Vector output_potential (n_dofs);
+      dealii::PETScWrappers::Vector residual (n_dofs);
+
+      last_residual_norm = std::numeric_limits<double>::max ();
+      n_eigensolver_iterations.clear ();
+
+      unsigned int cycle = 0;
+      while (cycle<max_cycles)
+	{
+	  compute_output_potential (cycle, potential, output_potential);
+	  ++cycle;
+
+	  residual  = output_potential;
+	  residual -= potential;
+	  last_residual_norm = residual.linfty_norm ();
+
+	  // The potential is kept as the input potential of the last
+	  // cycle, so that it stays consistent with the electron states
+	  // and density.
+	  if (last_residual_norm<tolerance)
+	    break;
+
+	  mix (potential, residual);
+	}
+
+      // Keep the states of this run, to start the next one from
+      // and to be transferred by refine_mesh().
+      eigenvalues  = schroedinger_problem.solution_eigenvalues ();
+      eigenvectors = schroedinger_problem.solution_eigenvectors ();
+
+      return cycle;
+    }
+
+    template <int dim>
+    unsigned int
+    Problem<dim>::run_adaptive (const unsigned int n_refinements,
+				const double       refine_fraction,
+				const double       coarsen_fraction)
+    {
+      unsigned int n_cycles = run ();
+
+      // Each run starts its own record of solver iterations; keep
+      // those of all runs.
+      std::vector<unsigned int> iterations (n_eigensolver_iterations);
+
+      for (unsigned int refinement=0; refinement<n_refinements; ++refinement)
+	{
+	  refine_mesh (refine_fraction, coarsen_fraction);
+
+	  // The transferred potential is close to self-consistent on
+	  // the new mesh, and is used as the input potential of the
+	  // next run.
+	  const dealii::PETScWrappers::Vector initial_potential (potential);
+	  n_cycles += run (initial_potential);
+
+	  iterations.insert (iterations.end (),
+			     n_eigensolver_iterations.begin (), n_eigensolver_iterations.end ());
+	}
+
+      n_eigensolver_iterations.swap (iterations);
+
+      return n_cycles;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::refine_mesh (const double refine_fraction,
+			       const double coarsen_fraction)
+    {
+      dealii::Triangulation<dim> &triangulation = *(trial_space->triangulation ());
+      dealii::DoFHandler<dim>    &dof_handler   = test_space->dofs ();
+
+      // Estimate the error of each electron state and of the
+      // potential. Each estimate is normalised, so that states and
+      // potential weigh the same, and a cell is marked by the largest
+      // of them: cells are refined where any state or the potential
+      // varies strongly, that is near interfaces and in wells, and
+      // coarsened where all of them are flat.
+      std::vector<const dealii::PETScWrappers::Vector*> solutions;
+      for (unsigned int i=0; i<eigenvectors.size (); ++i)
+	solutions.push_back (&eigenvectors[i]);
+      solutions.push_back (&potential);
+
+      std::vector<dealii::Vector<float> >  errors (solutions.size (),
+						   dealii::Vector<float> (triangulation.n_active_cells ()));
+      std::vector<dealii::Vector<float>*> error_pointers (solutions.size ());
+      for (unsigned int i=0; i<errors.size (); ++i)
+	error_pointers[i] = &errors[i];
+
+      dealii::KellyErrorEstimator<dim>::estimate (dof_handler,
+						  dealii::QGauss<dim-1> (test_space->degree ()+1),
+						  typename dealii::FunctionMap<dim>::type (),
+						  solutions,
+						  error_pointers);
+
+      dealii::Vector<float> indicator (triangulation.n_active_cells ());
+      for (unsigned int i=0; i<errors.size (); ++i)
+	{
+	  const double norm = errors[i].l2_norm ();
+	  if (norm==0.)
+	    continue;
+
+	  for (unsigned int c=0; c<indicator.size (); ++c)
+	    indicator (c) = std::max (indicator (c), static_cast<float> (errors[i] (c)/norm));
+	}
+
+      dealii::GridRefinement::refine_and_coarsen_fixed_number (triangulation, indicator,
+							       refine_fraction, coarsen_fraction);
+
+      // Everything given at degrees of freedom moves to the new
+      // mesh. The electron states are kept, so that the eigensolver
+      // of the next run can start from them.
+      std::vector<dealii::PETScWrappers::Vector*> functions;
+      functions.push_back (&kinetic);
+      functions.push_back (&density_of_states);
+      functions.push_back (&band_edge);
+      functions.push_back (&doping);
+      functions.push_back (&potential);
+      for (unsigned int i=0; i<eigenvectors.size (); ++i)
+	functions.push_back (&eigenvectors[i]);
+
+      std::vector<dealii::PETScWrappers::Vector> old_functions;
+      for (unsigned int i=0; i<functions.size (); ++i)
+	old_functions.push_back (*functions[i]);
+
+      dealii::SolutionTransfer<dim, dealii::PETScWrappers::Vector> solution_transfer (dof_handler);
+
+      triangulation.prepare_coarsening_and_refinement ();
+      solution_transfer.prepare_for_coarsening_and_refinement (old_functions);
+      triangulation.execute_coarsening_and_refinement ();
+      test_space->distribute_dofs ();
+
+      const unsigned int n_dofs = test_space->n_dofs ();
+      std::vector<dealii::PETScWrappers::Vector> new_functions (functions.size (),
+								 dealii::PETScWrappers::Vector (n_dofs));
+      solution_transfer.interpolate (old_functions, new_functions);
+
+      // Interpolation leaves the values at hanging nodes of the new
+      // mesh undefined; they are set from the constraints so that the
+      // functions are continuous.
+      dealii::ConstraintMatrix hanging_node_constraints;
+      dealii::DoFTools::make_hanging_node_constraints (dof_handler, hanging_node_constraints);
+      hanging_node_constraints.close ();
+
+      for (unsigned int i=0; i<functions.size (); ++i)
+	{
+	  hanging_node_constraints.distribute (new_functions[i]);
+	  functions[i]->reinit (n_dofs);
+	  *functions[i] = new_functions[i];
+	}
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::compute_output_potential (const unsigned int                   cycle,
+					    const dealii::PETScWrappers::Vector &input_potential,
+					    dealii::PETScWrappers::Vector       &output_potential)
+    {
+      potential_field.interpolate (*test_space, test_space->quadrature (), input_potential);
+
+      // The kinetic energy term does not change between cycles, so
+      // after the first cycle only the potential energy is assembled
+      // and the eigensolver is started from the previous states.
+      if (cycle==0)
+	{
+	  schroedinger_problem.reinit ();
+	  schroedinger_problem.assemble (kinetic_field, potential_field);
+
+	  // States of a previous run, possibly transferred from a
+	  // coarser mesh, are a good start for the eigensolver.
+	  if (!eigenvectors.empty () && (eigenvectors[0].size ()==test_space->n_dofs ()))
+	    schroedinger_problem.set_initial_eigenpairs (eigenvalues, eigenvectors);
+	}
+      else
+	{
+	  schroedinger_problem.assemble_potential (potential_field);
+	  schroedinger_problem.set_initial_eigenpairs (schroedinger_problem.solution_eigenvalues (),
+						       schroedinger_problem.solution_eigenvectors ());
+	}
+
+      n_eigensolver_iterations.push_back (schroedinger_problem.solve ());
+
+      // The statistics read the states in place, from the
+      // contiguous block of the Schroedinger problem.
+      const std::vector<double> &energies = schroedinger_problem.solution_eigenvalues ();
+      const qdove::MultiVector  &states   = schroedinger_problem.solution_multivector ();
+
+      if (charge_neutrality)
+	fermi_energy = qdove::FermiDirac::compute_fermi_energy (states, energies, density_of_states,
+								doping, nodal_weights, temperature,
+								qdove::FermiDirac::confinement_of_dimension (dim));
+
+      if (mixing_type==PredictorCorrector)
+	{
+	  solve_nonlinear_poisson (input_potential, output_potential);
+	  return;
+	}
+
+      // The nodal density is what get_density() returns.
+      qdove::FermiDirac::compute_number_density (states, energies, fermi_energy,
+						 density_of_states, density, temperature,
+						 qdove::FermiDirac::confinement_of_dimension (dim));
+
+      // The charge density of the right-hand side of Poisson's
+      // equation is evaluated from the states at quadrature points,
+      // rather than interpolated from the nodal density. It is that
+      // of the electrons less that of the ionised dopants,
+      // multiplied by 4*pi*e*e/permittivity.
+      qdove::FermiDirac::compute_number_density (*test_space, schroedinger_problem.solution_eigenvectors (),
+						 energies, fermi_energy,
+						 density_of_states_field, charge_field, temperature);
+      charge_field.add (-1., doping_field);
+      charge_field *= 4. * qdove::PI * qdove::E0 * qdove::E0 / permittivity;
+
+      poisson_problem.reinit ();
+      poisson_problem.assemble (charge_field);
+      poisson_problem.solve ();
+
+      output_potential  = band_edge;
+      output_potential += poisson_problem.solution ();
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::solve_nonlinear_poisson (const dealii::PETScWrappers::Vector &input_potential,
+					   dealii::PETScWrappers::Vector       &output_potential)
+    {
+      const unsigned int n_dofs = test_space->n_dofs ();
+      const double charge_factor = 4. * qdove::PI * qdove::E0 * qdove::E0 / permittivity;
+
+      // Start Newton's method from the Hartree potential of the input
+      // potential.
+      dealii::PETScWrappers::Vector hartree (input_potential);
+      hartree -= band_edge;
+
+      dealii::PETScWrappers::Vector potential_shift (n_dofs);
+      dealii::PETScWrappers::Vector density_derivative (n_dofs);
+      dealii::PETScWrappers::Vector rhs (n_dofs);
+      dealii::PETScWrappers::Vector reaction (n_dofs);
+      dealii::PETScWrappers::Vector update (n_dofs);
+
+      for (unsigned int step=0; step<max_newton_steps; ++step)
+	{
+	  // Predict the density at the potential band_edge+hartree.
+	  potential_shift  = band_edge;
+	  potential_shift += hartree;
+	  potential_shift -= input_potential;
+	  qdove::FermiDirac::compute_predicted_number_density (schroedinger_problem.solution_eigenvectors (),
+							       schroedinger_problem.solution_eigenvalues (),
+							       fermi_energy,
+							       density_of_states, potential_shift,
+							       density, density_derivative, temperature,
+							       qdove::FermiDirac::confinement_of_dimension (dim));
+
+	  // Linearise the charge density around the current Hartree
+	  // potential. The density decreases with the potential, so
+	  // the reaction term is non-negative.
+	  for (unsigned int i=0; i<n_dofs; ++i)
+	    {
+	      rhs[i]      = charge_factor * (density[i] - doping[i] - density_derivative[i]*hartree[i]);
+	      reaction[i] = -charge_factor * density_derivative[i];
+	    }
+	  rhs.compress (dealii::VectorOperation::insert);
+	  reaction.compress (dealii::VectorOperation::insert);
+
+	  poisson_problem.reinit ();
+	  poisson_problem.assemble (rhs, reaction);
+	  poisson_problem.solve ();
+
+	  update   = poisson_problem.solution ();
+	  update  -= hartree;
+	  hartree += update;
+
+	  if (update.linfty_norm ()<tolerance)
+	    break;
+	}
+
+      output_potential  = band_edge;
+      output_potential += hartree;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::mix (dealii::PETScWrappers::Vector       &input_potential,
+		       const dealii::PETScWrappers::Vector &residual)
+    {
+      // Differences of input potentials and residuals between this
+      // cycle and the previous one.
+      dealii::PETScWrappers::Vector potential_difference (input_potential);
+      dealii::PETScWrappers::Vector residual_difference (residual);
+      const bool have_difference = have_previous_cycle;
+      if (have_difference)
+	{
+	  potential_difference -= previous_potential;
+	  residual_difference  -= previous_residual;
+	}
+
+      previous_potential  = input_potential;
+      previous_residual   = residual;
+      have_previous_cycle = true;
+
+      switch (mixing_type)
+	{
+	case Linear:
+	  {
+	    input_potential.add (alpha, residual);
+	    break;
+	  }
+
+	case Anderson:
+	  {
+	    if (have_difference)
+	      {
+		potential_differences.push_back (potential_difference);
+		residual_differences.push_back (residual_difference);
+		if (potential_differences.size ()>history)
+		  {
+		    potential_differences.pop_front ();
+		    residual_differences.pop_front ();
+		  }
+	      }
+
+	    // Find the combination of previous residual differences
+	    // that best cancels the residual, in the least-squares
+	    // sense, from the normal equations. A tiny shift of the
+	    // diagonal keeps them solvable when differences are
+	    // nearly linearly dependent.
+	    const unsigned int n_history = residual_differences.size ();
+
+	    dealii::FullMatrix<double> normal_matrix (n_history, n_history);
+	    dealii::Vector<double>     normal_rhs (n_history);
+	    dealii::Vector<double>     gamma (n_history);
+
+	    double max_diagonal = 0.;
+	    for (unsigned int i=0; i<n_history; ++i)
+	      {
+		for (unsigned int j=0; j<=i; ++j)
+		  {
+		    normal_matrix (i, j) = residual_differences[i] * residual_differences[j];
+		    normal_matrix (j, i) = normal_matrix (i, j);
+		  }
+		normal_rhs (i) = residual_differences[i] * residual;
+		max_diagonal = std::max (max_diagonal, normal_matrix (i, i));
+	      }
+
+	    if (n_history>0)
+	      {
+		for (unsigned int i=0; i<n_history; ++i)
+		  normal_matrix (i, i) += 1e-12 * max_diagonal;
+		normal_matrix.gauss_jordan ();
+		normal_matrix.vmult (gamma, normal_rhs);
+	      }
+
+	    input_potential.add (alpha, residual);
+	    for (unsigned int i=0; i<n_history; ++i)
+	      {
+		input_potential.add (-gamma (i), potential_differences[i]);
+		input_potential.add (-gamma (i)*alpha, residual_differences[i]);
+	      }
+	    break;
+	  }
+
+	case Broyden:
+	  {
+	    // Update the approximation G to the negative inverse
+	    // Jacobian of the residual such that the secant condition
+	    // G*residual_difference=-potential_difference holds, with a
+	    // rank-one correction u*v^T.
+	    if (have_difference)
+	      {
+		const double norm_sqr = residual_difference * residual_difference;
+		if (norm_sqr>0.)
+		  {
+		    dealii::PETScWrappers::Vector u (potential_difference);
+		    u *= -1.;
+		    u.add (-alpha, residual_difference);
+		    for (unsigned int i=0; i<broyden_u.size (); ++i)
+		      u.add (-(broyden_v[i] * residual_difference), broyden_u[i]);
+		    u *= 1./norm_sqr;
+
+		    broyden_u.push_back (u);
+		    broyden_v.push_back (residual_difference);
+		    if (broyden_u.size ()>history)
+		      {
+			broyden_u.pop_front ();
+			broyden_v.pop_front ();
+		      }
+		  }
+	      }
+
+	    // Step by G*residual.
+	    for (unsigned int i=0; i<broyden_u.size (); ++i)
+	      input_potential.add (broyden_v[i] * residual, broyden_u[i]);
+	    input_potential.add (alpha, residual);
+	    break;
+	  }
+
+	case PredictorCorrector:
+	  {
+	    // The output potential is already the corrected potential.
+	    input_potential.add (1., residual);
+	    break;
+	  }
+
+	default:
+	  assert (false && "Unknown mixing type.");
+	}
+    }
+
+    template <int dim>
+    double
+    Problem<dim>::residual_norm () const
+    {
+      return last_residual_norm;
+    }
+
+    template <int dim>
+    const std::vector<unsigned int> &
+    Problem<dim>::eigensolver_iterations () const
+    {
+      return n_eigensolver_iterations;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::get_potential (dealii::PETScWrappers::Vector &vector) const
+    {
+      vector = potential;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::get_density (dealii::PETScWrappers::Vector &vector) const
+    {
+      vector = density;
+    }
+
+    template <int dim>
+    void
+    Problem<dim>::get_solution_eigenpairs (std::vector<double>                        &values,
+					   std::vector<dealii::PETScWrappers::Vector> &vectors) const
+    {
+      values = eigenvalues;
+
+      vectors.resize (eigenvectors.size ());
+      for (unsigned int i=0; i<eigenvectors.size (); ++i)
+	vectors[i] = eigenvectors[i];
+    }
+
+    template <int dim>
+    const std::vector<double> &
+    Problem<dim>::solution_eigenvalues () const
+    {
+      return eigenvalues;
+    }
+
+    template <int dim>
+    const std::vector<dealii::PETScWrappers::Vector> &
+    Problem<dim>::solution_eigenvectors () const
+    {
+      return eigenvectors;
+    }
+
+  } // namespace SelfConsistent
+
+} // namespace qdove
+
+#include "self_consistent.inst"
@@ -24,6 +24,15 @@
 
 #include <qdove/models/statistics.h>
 #include <qdove/materials/constants.h>
+#include <qdove/base/profiler.h>
+
+#include <deal.II/fe/fe_values.h>
+
+#include <petscvec.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 
 
 namespace qdove
@@ -32,6 +41,12 @@ namespace qdove
   namespace FermiDirac
   {
 
+    Confinement confinement_of_dimension (const unsigned int dim)
+    {
+      assert ((dim>=1) && (dim<=3) && "Devices are modelled in one to three dimensions.");
+      return ((dim==1) ? QuantumWell : ((dim==2) ? QuantumWire : QuantumDot));
+    }
+
     void compute_density (const dealii::PETScWrappers::Vector &wavefunction,
 			  dealii::PETScWrappers::Vector       &density)
     {
@@ -43,61 +58,816 @@ namespace qdove
 	density[i] = wavefunction[i] * wavefunction[i];
     }
 
+    namespace
+    {
+      // Number of rows accumulated together, so that a block of the
+      // density stays in cache while the states are streamed
+      // through it, and the number of states whose occupancies are
+      // kept on the stack at a time.
+      const unsigned int block_size       = 512;
+      const unsigned int state_block_size = 64;
+
+      // Integrated Fermi-Dirac occupancy log(1+exp(x)), written such
+      // that exp() never overflows and no precision is lost for large
+      // negative x.
+      inline double softplus (const double x)
+      {
+	return std::max (x, 0.) + log1p (std::exp (-std::fabs (x)));
+      }
+
+      // Fermi function 1/(1+exp(-x)), which is the derivative of
+      // softplus(x), again without overflow.
+      inline double logistic (const double x)
+      {
+	const double e = std::exp (-std::fabs (x));
+	return (x>=0.) ? 1./(1.+e) : e/(1.+e);
+      }
+
+      // Complete Fermi-Dirac integral of order -1/2,
+      // F(x)=1/sqrt(pi) int_0^inf t^{-1/2}/(1+exp(t-x)) dt, and its
+      // derivative, which is the integral of order -3/2.
+      void fermi_dirac_integral_minus_half (const double  x,
+					    double       &value,
+					    double       &derivative)
+      {
+	const double factor = 2./std::sqrt (qdove::PI);
+
+	// Sommerfeld expansion for degenerate states. The first term
+	// left out is of order 1e-10 of the value.
+	if (x>=40.)
+	  {
+	    const double pi2    = qdove::PI*qdove::PI;
+	    const double pi6    = pi2*pi2*pi2;
+	    const double sqrt_x = std::sqrt (x);
+	    const double x2     = x*x;
+	    value      = factor * (sqrt_x
+				   - pi2/(24.*x*sqrt_x)
+				   - 7.*pi2*pi2/(384.*x2*x*sqrt_x)
+				   - 31.*pi6/(1024.*x2*x2*x*sqrt_x));
+	    derivative = factor * (0.5/sqrt_x
+				   + pi2/(16.*x2*sqrt_x)
+				   + 49.*pi2*pi2/(768.*x2*x2*sqrt_x)
+				   + 341.*pi6/(2048.*x2*x2*x2*sqrt_x));
+	    return;
+	  }
+
+	// With t=u^2, F(x)=2/sqrt(pi) int_0^inf du/(1+exp(u^2-x)). The
+	// integrand is even in u and analytic in a strip of half width
+	// d, bounded by the poles at u^2=x+-i*pi, so the trapezoidal
+	// rule with step h converges like exp(-2*pi*d/h). The step is
+	// also kept small enough to resolve exp(-u^2) for negative x,
+	// and the integrand is cut off where it has decayed below
+	// exp(-40) of its value at u=0.
+	const double d = std::sqrt (0.5 * (std::sqrt (x*x + qdove::PI*qdove::PI) - x));
+	const double h = std::min (2.*qdove::PI*d/32., 0.5);
+	const unsigned int n_points = static_cast<unsigned int> (std::sqrt (std::max (x, 0.) + 40.) / h);
+
+	value      = 0.5 * logistic (x);
+	derivative = 0.5 * logistic (x) * logistic (-x);
+	for (unsigned int k=1; k<=n_points; ++k)
+	  {
+	    const double y = x - (k*h)*(k*h);
+	    const double f = logistic (y);
+	    value      += f;
+	    derivative += f * logistic (-y);
+	  }
+
+	value      *= factor * h;
+	derivative *= factor * h;
+      }
+
+      // Number of electrons per unit density of states in a state at
+      // x=(E_F-E)/kbt, and its derivative with respect to x. See the
+      // documentation of Confinement.
+      inline void evaluate_occupancy (const Confinement  confinement,
+				      const double       kbt,
+				      const double       x,
+				      double            &occupancy,
+				      double            &derivative)
+      {
+	switch (confinement)
+	  {
+	  case QuantumWell:
+	    occupancy  = kbt * softplus (x);
+	    derivative = kbt * logistic (x);
+	    break;
+
+	  case QuantumWire:
+	    {
+	      const double sqrt_kbt = std::sqrt (kbt);
+	      fermi_dirac_integral_minus_half (x, occupancy, derivative);
+	      occupancy  *= sqrt_kbt;
+	      derivative *= sqrt_kbt;
+	      break;
+	    }
+
+	  case QuantumDot:
+	    {
+	      const double f = logistic (x);
+	      occupancy  = 2. * f;
+	      derivative = 2. * f * logistic (-x);
+	      break;
+	    }
+
+	  default:
+	    assert (false && "Unknown confinement.");
+	    occupancy  = 0.;
+	    derivative = 0.;
+	  }
+      }
+
+      inline double occupancy (const Confinement confinement,
+			       const double      kbt,
+			       const double      x)
+      {
+	double value, derivative;
+	evaluate_occupancy (confinement, kbt, x, value, derivative);
+	return value;
+      }
+
+      // Number of electrons in states with these weights and
+      // energies at a Fermi energy, less the target number, and its
+      // derivative with respect to the Fermi energy, which is always
+      // positive.
+      void evaluate_number_of_electrons (const std::vector<double> &state_weights,
+					 const std::vector<double> &energy_values,
+					 const double               kbt,
+					 const Confinement          confinement,
+					 const double               number_of_electrons,
+					 const double               fermi_energy,
+					 double                    &residual,
+					 double                    &derivative)
+      {
+	residual   = -number_of_electrons;
+	derivative = 0.;
+	for (unsigned int j=0; j<energy_values.size (); ++j)
+	  {
+	    const double x = (fermi_energy-energy_values[j]) / kbt;
+
+	    double state_occupancy, state_derivative;
+	    evaluate_occupancy (confinement, kbt, x, state_occupancy, state_derivative);
+
+	    residual   += state_weights[j] * state_occupancy;
+	    derivative += state_weights[j] * state_derivative / kbt;
+	  }
+      }
+    }
+
     void compute_number_density (const dealii::PETScWrappers::Vector &wavefunction,
 				 const double                        &energy_value,
 				 const double                        &fermi_energy_value,
 				 const dealii::PETScWrappers::Vector &density_of_states,
-				 dealii::PETScWrappers::Vector       &density)
+				 dealii::PETScWrappers::Vector       &density,
+				 const double                         temperature,
+				 const Confinement                    confinement)
     {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_number_density");
+
       // Assume that the input wavefunction is correct
       assert (wavefunction.size ()==density_of_states.size () && "Incompatible vector sizes.");
-      density.reinit (wavefunction.size ());
+
+      const unsigned int n_dofs = density_of_states.size ();
+      if (density.size ()!=n_dofs)
+	density.reinit (n_dofs);
 
       // Compute the occupancy level from integrated Fermi-Dirac
-      // statistics. Make use of fixed temperature 300K for now.
-      const double kbt = qdove::KB * 300;
-      const double occupancy = kbt * std::log (1.+std::exp ( (fermi_energy_value-energy_value) / kbt) );
+      // statistics.
+      assert ((temperature>0.) && "The temperature must be positive.");
+      const double kbt = qdove::KB * temperature;
+      const double state_occupancy = occupancy (confinement, kbt, (fermi_energy_value-energy_value) / kbt);
+
+      Vec density_vector           = density;
+      Vec wavefunction_vector      = wavefunction;
+      Vec density_of_states_vector = density_of_states;
+      PetscScalar       *density_array;
+      const PetscScalar *wavefunction_array;
+      const PetscScalar *density_of_states_array;
+      VecGetArray (density_vector, &density_array);
+      VecGetArrayRead (wavefunction_vector, &wavefunction_array);
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
 
       // Do a straight point-wise multiplication
-      for (unsigned int i=0; i<wavefunction.size (); ++i)
-	density[i] = density_of_states[i] * wavefunction[i] * wavefunction[i] * occupancy;
+      for (unsigned int i=0; i<n_dofs; ++i)
+	density_array[i] = density_of_states_array[i] * wavefunction_array[i] * wavefunction_array[i] * state_occupancy;
+
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+      VecRestoreArrayRead (wavefunction_vector, &wavefunction_array);
+      VecRestoreArray (density_vector, &density_array);
     }
 
     void compute_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
 				 const std::vector<double>                        &energy_values,
 				 const double                                     &fermi_energy_value,
 				 const dealii::PETScWrappers::Vector              &density_of_states,
-				 dealii::PETScWrappers::Vector                    &density)
+				 dealii::PETScWrappers::Vector                    &density,
+				 const double                                      temperature,
+				 const Confinement                                 confinement)
     {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_number_density");
+
       // Assume that the input wavefunction is correct
       assert (wavefunction.size ()==energy_values.size () && "Incompatible vector sizes.");
       assert (wavefunction[0].size ()==density_of_states.size () && "Incompatible vector sizes.");
-      density.reinit (wavefunction[0].size ());
 
-      // Make use of a temporary vector
-      dealii::PETScWrappers::Vector tmp (density.size ());
+      const unsigned int n_dofs = density_of_states.size ();
+      if (density.size ()!=n_dofs)
+	density.reinit (n_dofs);
 
-      // Do a straight point-wise multiplication
-      for (unsigned int i=0; i<wavefunction.size (); ++i)
-         {
-	   FermiDirac::compute_number_density (wavefunction[i], 
-					       energy_values[i], 
-					       fermi_energy_value, 
-					       density_of_states, 
-					       tmp);
-	   density.add (tmp);
-	 }
+      // Compute the occupancy level from integrated Fermi-Dirac
+      // statistics.
+      assert ((temperature>0.) && "The temperature must be positive.");
+      const double kbt = qdove::KB * temperature;
+
+      // Work on the raw arrays of the PETSc vectors: accumulate the
+      // occupancy-weighted squares of the wavefunctions block by
+      // block of rows, a few states at a time, and scale by the
+      // density of states once at the end.
+      Vec density_vector = density;
+      PetscScalar *density_array;
+      VecGetArray (density_vector, &density_array);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	density_array[i] = 0.;
+
+      const unsigned int n_states = wavefunction.size ();
+      double             occupancies[state_block_size];
+      const PetscScalar *wavefunction_arrays[state_block_size];
+      double             weight[block_size];
+
+      for (unsigned int first=0; first<n_states; first+=state_block_size)
+	{
+	  const unsigned int n = std::min (state_block_size, n_states-first);
+	  for (unsigned int j=0; j<n; ++j)
+	    {
+	      occupancies[j] = occupancy (confinement, kbt, (fermi_energy_value-energy_values[first+j]) / kbt);
+
+	      Vec wavefunction_vector = wavefunction[first+j];
+	      VecGetArrayRead (wavefunction_vector, &wavefunction_arrays[j]);
+	    }
+
+	  for (unsigned int begin=0; begin<n_dofs; begin+=block_size)
+	    {
+	      const unsigned int end = std::min (begin+block_size, n_dofs);
+
+	      for (unsigned int i=begin; i<end; ++i)
+		weight[i-begin] = 0.;
+
+	      for (unsigned int j=0; j<n; ++j)
+		{
+		  const double       state_occupancy    = occupancies[j];
+		  const PetscScalar *wavefunction_array = wavefunction_arrays[j];
+		  for (unsigned int i=begin; i<end; ++i)
+		    weight[i-begin] += state_occupancy * wavefunction_array[i] * wavefunction_array[i];
+		}
+
+	      for (unsigned int i=begin; i<end; ++i)
+		density_array[i] += weight[i-begin];
+	    }
+
+	  for (unsigned int j=0; j<n; ++j)
+	    {
+	      Vec wavefunction_vector = wavefunction[first+j];
+	      VecRestoreArrayRead (wavefunction_vector, &wavefunction_arrays[j]);
+	    }
+	}
+
+      Vec density_of_states_vector = density_of_states;
+      const PetscScalar *density_of_states_array;
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	density_array[i] *= density_of_states_array[i];
+
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+      VecRestoreArray (density_vector, &density_array);
+    }
+
+    void compute_number_density (const qdove::MultiVector            &wavefunction,
+				 const std::vector<double>           &energy_values,
+				 const double                        &fermi_energy_value,
+				 const dealii::PETScWrappers::Vector &density_of_states,
+				 dealii::PETScWrappers::Vector       &density,
+				 const double                         temperature,
+				 const Confinement                    confinement)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_number_density");
+
+      assert (wavefunction.n_columns ()==energy_values.size () && "Incompatible vector sizes.");
+      assert (wavefunction.n_rows ()==density_of_states.size () && "Incompatible vector sizes.");
+
+      const unsigned int n_dofs = density_of_states.size ();
+      if (density.size ()!=n_dofs)
+	density.reinit (n_dofs);
+
+      assert ((temperature>0.) && "The temperature must be positive.");
+      const double kbt = qdove::KB * temperature;
+
+      Vec density_vector           = density;
+      Vec density_of_states_vector = density_of_states;
+      PetscScalar       *density_array;
+      const PetscScalar *density_of_states_array;
+      VecGetArray (density_vector, &density_array);
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	density_array[i] = 0.;
+
+      // The occupancies of a few states at a time are kept on the
+      // stack, so that nothing is allocated.
+      const unsigned int n_states = energy_values.size ();
+      double occupancies[state_block_size];
+      for (unsigned int first=0; first<n_states; first+=state_block_size)
+	{
+	  const unsigned int n = std::min (state_block_size, n_states-first);
+	  for (unsigned int j=0; j<n; ++j)
+	    occupancies[j] = occupancy (confinement, kbt, (fermi_energy_value-energy_values[first+j]) / kbt);
+
+	  wavefunction.add_weighted_squares (first, n, occupancies, density_array);
+	}
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	density_array[i] *= density_of_states_array[i];
+
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+      VecRestoreArray (density_vector, &density_array);
+    }
+
+    void compute_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_values,
+				 const std::vector<double>                        &temperatures,
+				 const std::vector<double>                        &fermi_energy_values,
+				 const dealii::PETScWrappers::Vector              &density_of_states,
+				 std::vector<dealii::PETScWrappers::Vector>       &densities,
+				 const Confinement                                 confinement)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_number_density");
+
+      assert (wavefunction.size ()==energy_values.size () && "Incompatible vector sizes.");
+      assert (wavefunction[0].size ()==density_of_states.size () && "Incompatible vector sizes.");
+      assert (temperatures.size ()==fermi_energy_values.size () && "Incompatible vector sizes.");
+
+      const unsigned int n_dofs   = density_of_states.size ();
+      const unsigned int n_states = wavefunction.size ();
+      const unsigned int n_pairs  = temperatures.size ();
+
+      densities.resize (n_pairs);
+      for (unsigned int k=0; k<n_pairs; ++k)
+	if (densities[k].size ()!=n_dofs)
+	  densities[k].reinit (n_dofs);
+
+      // Occupancy of each state for each pair of temperature and
+      // Fermi energy. This is a small table of n_pairs*n_states.
+      std::vector<double> occupancies (n_pairs*n_states);
+      for (unsigned int k=0; k<n_pairs; ++k)
+	{
+	  assert ((temperatures[k]>0.) && "The temperature must be positive.");
+	  const double kbt = qdove::KB * temperatures[k];
+	  for (unsigned int j=0; j<n_states; ++j)
+	    occupancies[k*n_states+j] = occupancy (confinement, kbt, (fermi_energy_values[k]-energy_values[j]) / kbt);
+	}
+
+      std::vector<PetscScalar*> density_arrays (n_pairs);
+      for (unsigned int k=0; k<n_pairs; ++k)
+	{
+	  Vec density_vector = densities[k];
+	  VecGetArray (density_vector, &density_arrays[k]);
+	  for (unsigned int i=0; i<n_dofs; ++i)
+	    density_arrays[k][i] = 0.;
+	}
+
+      // Work through each wavefunction in blocks that stay in cache
+      // while they are added to all densities of the batch.
+      double weight[block_size];
+
+      for (unsigned int j=0; j<n_states; ++j)
+	{
+	  Vec wavefunction_vector = wavefunction[j];
+	  const PetscScalar *wavefunction_array;
+	  VecGetArrayRead (wavefunction_vector, &wavefunction_array);
+
+	  for (unsigned int begin=0; begin<n_dofs; begin+=block_size)
+	    {
+	      const unsigned int end = std::min (begin+block_size, n_dofs);
+
+	      for (unsigned int i=begin; i<end; ++i)
+		weight[i-begin] = wavefunction_array[i] * wavefunction_array[i];
+
+	      for (unsigned int k=0; k<n_pairs; ++k)
+		{
+		  const double state_occupancy = occupancies[k*n_states+j];
+		  PetscScalar *density_array   = density_arrays[k];
+		  for (unsigned int i=begin; i<end; ++i)
+		    density_array[i] += state_occupancy * weight[i-begin];
+		}
+	    }
+
+	  VecRestoreArrayRead (wavefunction_vector, &wavefunction_array);
+	}
+
+      Vec density_of_states_vector = density_of_states;
+      const PetscScalar *density_of_states_array;
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+
+      for (unsigned int k=0; k<n_pairs; ++k)
+	{
+	  for (unsigned int i=0; i<n_dofs; ++i)
+	    density_arrays[k][i] *= density_of_states_array[i];
+
+	  Vec density_vector = densities[k];
+	  VecRestoreArray (density_vector, &density_arrays[k]);
+	}
+
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+    }
+
+    void compute_predicted_number_density (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+					   const std::vector<double>                        &energy_values,
+					   const double                                     &fermi_energy_value,
+					   const dealii::PETScWrappers::Vector              &density_of_states,
+					   const dealii::PETScWrappers::Vector              &potential_shift,
+					   dealii::PETScWrappers::Vector                    &density,
+					   dealii::PETScWrappers::Vector                    &density_derivative,
+					   const double                                      temperature,
+					   const Confinement                                 confinement)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_predicted_number_density");
+
+      assert (wavefunction.size ()==energy_values.size () && "Incompatible vector sizes.");
+      assert (wavefunction[0].size ()==density_of_states.size () && "Incompatible vector sizes.");
+      assert (wavefunction[0].size ()==potential_shift.size () && "Incompatible vector sizes.");
+
+      const unsigned int n_dofs = density_of_states.size ();
+      if (density.size ()!=n_dofs)
+	density.reinit (n_dofs);
+      if (density_derivative.size ()!=n_dofs)
+	density_derivative.reinit (n_dofs);
+
+      assert ((temperature>0.) && "The temperature must be positive.");
+      const double kbt = qdove::KB * temperature;
+
+      Vec density_vector            = density;
+      Vec density_derivative_vector = density_derivative;
+      Vec potential_shift_vector    = potential_shift;
+      PetscScalar       *density_array;
+      PetscScalar       *density_derivative_array;
+      const PetscScalar *potential_shift_array;
+      VecGetArray (density_vector, &density_array);
+      VecGetArray (density_derivative_vector, &density_derivative_array);
+      VecGetArrayRead (potential_shift_vector, &potential_shift_array);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	{
+	  density_array[i]            = 0.;
+	  density_derivative_array[i] = 0.;
+	}
+
+      for (unsigned int j=0; j<wavefunction.size (); ++j)
+	{
+	  Vec wavefunction_vector = wavefunction[j];
+	  const PetscScalar *wavefunction_array;
+	  VecGetArrayRead (wavefunction_vector, &wavefunction_array);
+
+	  // The derivative of the occupancy with respect to the
+	  // potential is minus its derivative with respect to x,
+	  // divided by kbt.
+	  const double x0 = (fermi_energy_value-energy_values[j]) / kbt;
+	  for (unsigned int i=0; i<n_dofs; ++i)
+	    {
+	      const double x      = x0 - potential_shift_array[i] / kbt;
+	      const double weight = wavefunction_array[i] * wavefunction_array[i];
+
+	      double state_occupancy, state_derivative;
+	      evaluate_occupancy (confinement, kbt, x, state_occupancy, state_derivative);
+
+	      density_array[i]            += weight * state_occupancy;
+	      density_derivative_array[i] -= weight * state_derivative / kbt;
+	    }
+
+	  VecRestoreArrayRead (wavefunction_vector, &wavefunction_array);
+	}
+
+      Vec density_of_states_vector = density_of_states;
+      const PetscScalar *density_of_states_array;
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+
+      for (unsigned int i=0; i<n_dofs; ++i)
+	{
+	  density_array[i]            *= density_of_states_array[i];
+	  density_derivative_array[i] *= density_of_states_array[i];
+	}
+
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+      VecRestoreArrayRead (potential_shift_vector, &potential_shift_array);
+      VecRestoreArray (density_derivative_vector, &density_derivative_array);
+      VecRestoreArray (density_vector, &density_array);
+    }
+
+    void compute_state_weights (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				const dealii::PETScWrappers::Vector              &density_of_states,
+				const dealii::PETScWrappers::Vector              &nodal_weights,
+				std::vector<double>                              &state_weights)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_state_weights");
+
+      assert (wavefunction[0].size ()==density_of_states.size () && "Incompatible vector sizes.");
+      assert (nodal_weights.size ()==density_of_states.size () && "Incompatible vector sizes.");
+
+      const unsigned int n_dofs = density_of_states.size ();
+      state_weights.resize (wavefunction.size ());
+
+      Vec density_of_states_vector = density_of_states;
+      Vec nodal_weights_vector     = nodal_weights;
+      const PetscScalar *density_of_states_array;
+      const PetscScalar *nodal_weights_array;
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+      VecGetArrayRead (nodal_weights_vector, &nodal_weights_array);
+
+      for (unsigned int j=0; j<wavefunction.size (); ++j)
+	{
+	  Vec wavefunction_vector = wavefunction[j];
+	  const PetscScalar *wavefunction_array;
+	  VecGetArrayRead (wavefunction_vector, &wavefunction_array);
+
+	  double weight = 0.;
+	  for (unsigned int i=0; i<n_dofs; ++i)
+	    weight += nodal_weights_array[i] * density_of_states_array[i] * wavefunction_array[i] * wavefunction_array[i];
+	  state_weights[j] = weight;
+
+	  VecRestoreArrayRead (wavefunction_vector, &wavefunction_array);
+	}
+
+      VecRestoreArrayRead (nodal_weights_vector, &nodal_weights_array);
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+    }
+
+    void compute_state_weights (const qdove::MultiVector            &wavefunction,
+				const dealii::PETScWrappers::Vector &density_of_states,
+				const dealii::PETScWrappers::Vector &nodal_weights,
+				std::vector<double>                 &state_weights)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_state_weights");
+
+      assert (wavefunction.n_rows ()==density_of_states.size () && "Incompatible vector sizes.");
+      assert (nodal_weights.size ()==density_of_states.size () && "Incompatible vector sizes.");
+
+      const unsigned int n_dofs = density_of_states.size ();
+
+      Vec density_of_states_vector = density_of_states;
+      Vec nodal_weights_vector     = nodal_weights;
+      const PetscScalar *density_of_states_array;
+      const PetscScalar *nodal_weights_array;
+      VecGetArrayRead (density_of_states_vector, &density_of_states_array);
+      VecGetArrayRead (nodal_weights_vector, &nodal_weights_array);
+
+      std::vector<double> weights (n_dofs);
+      for (unsigned int i=0; i<n_dofs; ++i)
+	weights[i] = nodal_weights_array[i] * density_of_states_array[i];
+
+      VecRestoreArrayRead (nodal_weights_vector, &nodal_weights_array);
+      VecRestoreArrayRead (density_of_states_vector, &density_of_states_array);
+
+      wavefunction.weighted_column_norms_square (n_dofs ? &weights[0] : 0, state_weights);
+    }
+
+    double compute_fermi_energy (const std::vector<double> &state_weights,
+				 const std::vector<double> &energy_values,
+				 const double               number_of_electrons,
+				 const double               temperature,
+				 const Confinement          confinement)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_fermi_energy");
+
+      assert ((state_weights.size ()==energy_values.size ()) && (energy_values.size ()>0) &&
+	      "Incompatible vector sizes.");
+      assert ((number_of_electrons>0.) && "The number of electrons must be positive.");
+      assert ((temperature>0.) && "The temperature must be positive.");
+
+      const double kbt = qdove::KB * temperature;
+      const unsigned int n_states = energy_values.size ();
+
+      double total_weight = 0.;
+      for (unsigned int j=0; j<n_states; ++j)
+	total_weight += state_weights[j];
+      assert ((total_weight>0.) && "The states hold no electrons.");
+      assert (((confinement!=QuantumDot) || (number_of_electrons<2.*total_weight)) &&
+	      "The states of the dot cannot hold this many electrons.");
+
+      const double min_energy = *std::min_element (energy_values.begin (), energy_values.end ());
+      const double max_energy = *std::max_element (energy_values.begin (), energy_values.end ());
+
+      double residual, derivative;
+
+      // Bracket the root. The number of electrons grows with the
+      // Fermi energy, so the upper bound is moved up until it holds
+      // at least the requested number, and the lower bound down
+      // until it holds fewer. For a well, where softplus(x)>=x, the
+      // first upper bound already does.
+      double upper = max_energy + kbt;
+      if (confinement==QuantumWell)
+	upper += number_of_electrons/total_weight;
+      double lower = min_energy - 10.*kbt;
+      for (double step=10.*kbt; upper-lower<1e300; step*=2.)
+	{
+	  evaluate_number_of_electrons (state_weights, energy_values, kbt, confinement, number_of_electrons, upper, residual, derivative);
+	  if (residual>=0.)
+	    break;
+	  lower  = upper;
+	  upper += step;
+	}
+      for (double step=10.*kbt; ; step*=2.)
+	{
+	  evaluate_number_of_electrons (state_weights, energy_values, kbt, confinement, number_of_electrons, lower, residual, derivative);
+	  if (residual<=0.)
+	    break;
+	  upper  = lower;
+	  lower -= step;
+	}
+
+      // Newton's method, falling back to bisection whenever a step
+      // would leave the bracket.
+      double fermi_energy = 0.5*(lower+upper);
+      unsigned int iteration = 0;
+      for (; iteration<200; ++iteration)
+	{
+	  evaluate_number_of_electrons (state_weights, energy_values, kbt, confinement, number_of_electrons, fermi_energy, residual, derivative);
+
+	  if (std::fabs (residual)<=1e-12*number_of_electrons)
+	    break;
+
+	  if (residual>0.)
+	    upper = fermi_energy;
+	  else
+	    lower = fermi_energy;
+
+	  if ((upper-lower)<=1e-14*std::max (std::fabs (upper), kbt))
+	    break;
+
+	  const double newton = (derivative>0.) ? fermi_energy-residual/derivative : upper;
+	  fermi_energy = ((newton>lower) && (newton<upper)) ? newton : 0.5*(lower+upper);
+	}
+
+      qdove::Profiler::add_iterations ("FermiDirac::compute_fermi_energy", iteration);
+
+      return fermi_energy;
+    }
+
+    double compute_fermi_energy (const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_values,
+				 const dealii::PETScWrappers::Vector              &density_of_states,
+				 const dealii::PETScWrappers::Vector              &doping,
+				 const dealii::PETScWrappers::Vector              &nodal_weights,
+				 const double                                      temperature,
+				 const Confinement                                 confinement)
+    {
+      assert ((doping.size ()==nodal_weights.size ()) && "Incompatible vector sizes.");
+
+      std::vector<double> state_weights;
+      FermiDirac::compute_state_weights (wavefunction, density_of_states, nodal_weights, state_weights);
+
+      // The number of electrons needed is the number of ionised
+      // dopants.
+      const double number_of_electrons = doping * nodal_weights;
+
+      return FermiDirac::compute_fermi_energy (state_weights, energy_values, number_of_electrons, temperature, confinement);
+    }
+
+    double compute_fermi_energy (const qdove::MultiVector            &wavefunction,
+				 const std::vector<double>           &energy_values,
+				 const dealii::PETScWrappers::Vector &density_of_states,
+				 const dealii::PETScWrappers::Vector &doping,
+				 const dealii::PETScWrappers::Vector &nodal_weights,
+				 const double                         temperature,
+				 const Confinement                    confinement)
+    {
+      assert ((doping.size ()==nodal_weights.size ()) && "Incompatible vector sizes.");
+
+      std::vector<double> state_weights;
+      FermiDirac::compute_state_weights (wavefunction, density_of_states, nodal_weights, state_weights);
+
+      const double number_of_electrons = doping * nodal_weights;
+
+      return FermiDirac::compute_fermi_energy (state_weights, energy_values, number_of_electrons, temperature, confinement);
+    }
+
+    namespace
+    {
+      // Density of states of this confinement for an effective mass
+      // in units of the electron mass. See the documentation of
+      // Confinement.
+      inline double density_of_states_value (const Confinement confinement,
+					     const double      effective_mass)
+      {
+	switch (confinement)
+	  {
+	  case QuantumWell:
+	    return (effective_mass*qdove::M0) / (qdove::HBAR*qdove::HBAR*qdove::PI);
+
+	  case QuantumWire:
+	    return std::sqrt (2.*effective_mass*qdove::M0/qdove::PI) / qdove::HBAR;
+
+	  case QuantumDot:
+	    return 1.;
+
+	  default:
+	    assert (false && "Unknown confinement.");
+	  }
+	return 0.;
+      }
     }
 
     void compute_density_of_states (const dealii::PETScWrappers::Vector &effective_mass_function,
-				    dealii::PETScWrappers::Vector       &density_of_states)
+				    dealii::PETScWrappers::Vector       &density_of_states,
+				    const Confinement                    confinement)
     {
       // Assume that the input wavefunction is correct
       density_of_states.reinit (effective_mass_function.size ());
 
-      // Do a straight point-wise multiplication
+      // Do a straight point-wise evaluation
       for (unsigned int i=0; i<density_of_states.size (); ++i)
-	density_of_states[i] = (effective_mass_function[i]*qdove::M0) / (qdove::HBAR*qdove::HBAR*qdove::PI);
+	density_of_states[i] = density_of_states_value (confinement, effective_mass_function[i]);
+    }
+
+    template <int dim>
+    void compute_number_density (qdove::TestSpace<dim>                            &test_space,
+				 const std::vector<dealii::PETScWrappers::Vector> &wavefunction,
+				 const std::vector<double>                        &energy_values,
+				 const double                                     &fermi_energy_value,
+				 const qdove::QuadratureField<dim>                &density_of_states,
+				 qdove::QuadratureField<dim>                      &density,
+				 const double                                      temperature)
+    {
+      qdove::Profiler::Scope profiler_scope ("FermiDirac::compute_number_density");
+
+      assert (wavefunction.size ()==energy_values.size () && "Incompatible vector sizes.");
+      assert (wavefunction[0].size ()==test_space.n_dofs () && "Incompatible vector sizes.");
+
+      const dealii::Quadrature<dim> quadrature = test_space.quadrature ();
+      assert ((density_of_states.n_q_points ()==quadrature.size ()) &&
+	      "The field does not match the quadrature formula of the test space.");
+      assert ((density_of_states.dof_revision ()==test_space.dof_revision ()) &&
+	      "The field was set up on another mesh.");
+
+      if ((density.size ()!=density_of_states.size ()) ||
+	  (density.dof_revision ()!=density_of_states.dof_revision ()))
+	density.reinit (density_of_states);
+
+      assert ((temperature>0.) && "The temperature must be positive.");
+      const double kbt = qdove::KB * temperature;
+
+      const unsigned int n_states   = wavefunction.size ();
+      const unsigned int n_q_points = quadrature.size ();
+
+      const Confinement confinement = confinement_of_dimension (dim);
+
+      std::vector<double> occupancies (n_states);
+      for (unsigned int j=0; j<n_states; ++j)
+	occupancies[j] = occupancy (confinement, kbt, (fermi_energy_value-energy_values[j]) / kbt);
+
+      dealii::FEValues<dim> fe_values (test_space.fe (), quadrature, dealii::update_values);
+      std::vector<double> wavefunction_values (n_q_points);
+
+      // Accumulate the occupancy-weighted squares of all
+      // wavefunctions at the quadrature points of each cell, and
+      // scale by the density of states once per cell.
+      typename dealii::DoFHandler<dim>::active_cell_iterator
+	cell = test_space.dofs ().begin_active (),
+	endc = test_space.dofs ().end ();
+      for (; cell!=endc; ++cell)
+	{
+	  fe_values.reinit (cell);
+
+	  double       *cell_density           = density.cell_values (cell);
+	  const double *cell_density_of_states = density_of_states.cell_values (cell);
+
+	  for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	    cell_density[q_point] = 0.;
+
+	  for (unsigned int j=0; j<n_states; ++j)
+	    {
+	      fe_values.get_function_values (wavefunction[j], wavefunction_values);
+	      for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+		cell_density[q_point] += occupancies[j] * wavefunction_values[q_point] * wavefunction_values[q_point];
+	    }
+
+	  for (unsigned int q_point=0; q_point<n_q_points; ++q_point)
+	    cell_density[q_point] *= cell_density_of_states[q_point];
+	}
+    }
+
+    template <int dim>
+    void compute_density_of_states (const qdove::QuadratureField<dim> &effective_mass_function,
+				    qdove::QuadratureField<dim>       &density_of_states)
+    {
+      if ((density_of_states.size ()!=effective_mass_function.size ()) ||
+	  (density_of_states.dof_revision ()!=effective_mass_function.dof_revision ()))
+	density_of_states.reinit (effective_mass_function);
+
+      const Confinement confinement = confinement_of_dimension (dim);
+
+      const double *effective_mass = effective_mass_function.begin ();
+      double       *dos            = density_of_states.begin ();
+      for (std::size_t i=0; i<density_of_states.size (); ++i)
+	dos[i] = density_of_states_value (confinement, effective_mass[i]);
     }
 
     
@@ -110,4 +880,4 @@ namespace qdove
 
 } // namespace qdove
 
-// #include "fermi_dirac.inst"
+#include "statistics.inst"